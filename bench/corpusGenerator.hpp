@@ -0,0 +1,439 @@
+/**************************************************************************
+Generates reproducible PDF and DOCX files and text for the benchmarks.
+
+Copyright (C) 2021 Chris Morrison (gnosticist@protonmail.com)
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <http://www.gnu.org/licenses/>.
+**************************************************************************/
+
+#ifndef _CORPUS_GENERATOR_HPP_
+#define _CORPUS_GENERATOR_HPP_
+
+#include <cstdint>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <random>
+#include <sstream>
+#include <stdexcept>
+#include <string>
+#include <vector>
+#include <podofo/podofo.h>
+#include <zlib.h>
+
+namespace fsl::bench
+{
+    struct corpusSpec
+    {
+        unsigned int pages = 20;
+        std::vector<std::string> fonts{ "Helvetica", "Times-Roman", "Courier" };
+        unsigned int wordsPerPage = 400;
+        double kerning = 0.25;              // The fraction of lines drawn with TJ and kerning adjustments.
+        unsigned int imagesPerPage = 0;
+        unsigned int imageSize = 256;       // Pixels along each side of an image.
+        uint32_t seed = 1;
+    };
+
+    // Makes up words and sentences from a seeded generator, the same seed always gives the same text.
+    class wordSource
+    {
+    private:
+        std::mt19937 _random;
+        unsigned int _sinceStop = 0;
+
+    public:
+        explicit wordSource(uint32_t seed) : _random(seed)
+        {
+        }
+
+        std::string word()
+        {
+            static const char* syllables[] = { "ka", "lo", "mi", "ter", "son", "ra", "vel", "du", "pen", "sta", "qui", "no", "bar", "ex", "ful", "tion" };
+            std::string w;
+            unsigned int n = 1 + _random() % 3;
+            for (unsigned int i = 0; i < n; ++i) w += syllables[_random() % (sizeof(syllables) / sizeof(syllables[0]))];
+
+            return w;
+        }
+
+        // A word followed by its punctuation, roughly one sentence in twelve words.
+        std::string token()
+        {
+            std::string w = word();
+            if ((_sinceStop == 0) && !w.empty()) w[0] = static_cast<char>(w[0] - 'a' + 'A');
+            ++_sinceStop;
+            unsigned int r = _random() % 12;
+            if ((r == 0) && (_sinceStop > 3))
+            {
+                w += '.';
+                _sinceStop = 0;
+            }
+            else if (r == 1)
+            {
+                w += ',';
+            }
+
+            return w;
+        }
+
+        uint32_t next()
+        {
+            return _random();
+        }
+    };
+
+    // Text with the shape of a document: sentences, lines and paragraphs, of about the given number of
+    // characters.
+    inline std::wstring generateText(size_t characters, uint32_t seed)
+    {
+        wordSource words(seed);
+        std::wstring text;
+        text.reserve(characters + 64);
+        size_t line = 0;
+        while (text.size() < characters)
+        {
+            std::string w = words.token();
+            text.append(w.begin(), w.end());
+            line += w.size() + 1;
+            if (line > 70)
+            {
+                line = 0;
+                text += ((words.next() % 8) == 0) ? L"\n\n" : L"\n";
+            }
+            else
+            {
+                text += L' ';
+            }
+        }
+
+        return text;
+    }
+
+    // Writes the entries of a zip archive one after another, deflating them as they are written.
+    class zipWriter
+    {
+    private:
+        struct written
+        {
+            std::string name;
+            uint32_t crc;
+            uint32_t compressed;
+            uint32_t size;
+            uint32_t offset;
+        };
+
+        std::ofstream _out;
+        std::vector<written> _entries;
+        z_stream _z;
+        bool _open = false;
+        std::vector<char> _buffer = std::vector<char>(1 << 16);
+
+        void _u16(std::string& out, uint32_t v)
+        {
+            out.push_back(static_cast<char>(v & 0xFF));
+            out.push_back(static_cast<char>((v >> 8) & 0xFF));
+        }
+
+        void _u32(std::string& out, uint32_t v)
+        {
+            _u16(out, v & 0xFFFF);
+            _u16(out, v >> 16);
+        }
+
+        std::string _header(const written& e, bool central)
+        {
+            std::string h;
+            _u32(h, central ? 0x02014b50 : 0x04034b50);
+            if (central) _u16(h, 20);
+            _u16(h, 20);
+            _u16(h, 0);
+            _u16(h, 8);
+            _u16(h, 0);
+            _u16(h, 0x21);
+            _u32(h, e.crc);
+            _u32(h, e.compressed);
+            _u32(h, e.size);
+            _u16(h, static_cast<uint32_t>(e.name.size()));
+            _u16(h, 0);
+            if (central)
+            {
+                _u16(h, 0);
+                _u16(h, 0);
+                _u16(h, 0);
+                _u32(h, 0);
+                _u32(h, e.offset);
+            }
+
+            return h + e.name;
+        }
+
+        void _deflate(const char* data, size_t size, int flush)
+        {
+            _z.next_in = reinterpret_cast<Bytef*>(const_cast<char*>(data));
+            _z.avail_in = static_cast<uInt>(size);
+            do
+            {
+                _z.next_out = reinterpret_cast<Bytef*>(_buffer.data());
+                _z.avail_out = static_cast<uInt>(_buffer.size());
+                if (::deflate(&_z, flush) == Z_STREAM_ERROR) throw std::runtime_error("deflate failed.");
+                _out.write(_buffer.data(), static_cast<std::streamsize>(_buffer.size() - _z.avail_out));
+            } while (_z.avail_out == 0);
+        }
+
+    public:
+        explicit zipWriter(const std::filesystem::path& file) : _out(file, std::ios::binary | std::ios::trunc)
+        {
+            if (!_out) throw std::runtime_error("Could not create " + file.string() + ".");
+        }
+
+        zipWriter(const zipWriter&) = delete;
+        zipWriter& operator=(const zipWriter&) = delete;
+
+        ~zipWriter()
+        {
+            if (_open) deflateEnd(&_z);
+        }
+
+        // Starts an entry. Its sizes and CRC are written into its local header when it is closed.
+        void begin(const std::string& name)
+        {
+            if (_open) end();
+            std::memset(&_z, 0, sizeof(_z));
+            if (deflateInit2(&_z, Z_DEFAULT_COMPRESSION, Z_DEFLATED, -MAX_WBITS, 8, Z_DEFAULT_STRATEGY) != Z_OK) throw std::runtime_error("deflateInit2 failed.");
+            _open = true;
+            _entries.push_back({ name, 0, 0, 0, static_cast<uint32_t>(_out.tellp()) });
+            std::string h = _header(_entries.back(), false);
+            _out.write(h.data(), static_cast<std::streamsize>(h.size()));
+        }
+
+        void write(const std::string& data)
+        {
+            written& e = _entries.back();
+            if (static_cast<uint64_t>(e.size) + data.size() > UINT32_MAX) throw std::runtime_error("The entry is too large for a zip archive without Zip64.");
+            e.crc = static_cast<uint32_t>(crc32(e.crc, reinterpret_cast<const Bytef*>(data.data()), static_cast<uInt>(data.size())));
+            e.size += static_cast<uint32_t>(data.size());
+            _deflate(data.data(), data.size(), Z_NO_FLUSH);
+        }
+
+        void end()
+        {
+            _deflate(nullptr, 0, Z_FINISH);
+            written& e = _entries.back();
+            e.compressed = static_cast<uint32_t>(_z.total_out);
+            deflateEnd(&_z);
+            _open = false;
+            auto here = _out.tellp();
+            _out.seekp(e.offset);
+            std::string h = _header(e, false);
+            _out.write(h.data(), static_cast<std::streamsize>(h.size()));
+            _out.seekp(here);
+        }
+
+        void finish()
+        {
+            if (_open) end();
+            std::string directory;
+            for (const auto& e : _entries) directory += _header(e, true);
+            std::string tail;
+            _u32(tail, 0x06054b50);
+            _u16(tail, 0);
+            _u16(tail, 0);
+            _u16(tail, static_cast<uint32_t>(_entries.size()));
+            _u16(tail, static_cast<uint32_t>(_entries.size()));
+            _u32(tail, static_cast<uint32_t>(directory.size()));
+            _u32(tail, static_cast<uint32_t>(_out.tellp()));
+            _u16(tail, 0);
+            _out.write(directory.data(), static_cast<std::streamsize>(directory.size()));
+            _out.write(tail.data(), static_cast<std::streamsize>(tail.size()));
+            _out.close();
+            if (!_out) throw std::runtime_error("The zip archive could not be written.");
+        }
+    };
+
+    // Writes a DOCX file whose word/document.xml is about the given number of bytes. The paragraphs are split
+    // into runs with properties, as word processors save them, so roughly a third of the XML is text. There is
+    // a heading every 30 paragraphs or so, a bulleted list now and then and a page break every 40 paragraphs.
+    // Returns the size of word/document.xml.
+    inline size_t generateDocx(size_t bytes, uint32_t seed, const std::filesystem::path& file)
+    {
+        static const char* w = "xmlns:w=\"http://schemas.openxmlformats.org/wordprocessingml/2006/main\"";
+        zipWriter zip(file);
+        zip.begin("[Content_Types].xml");
+        zip.write("<?xml version=\"1.0\" encoding=\"UTF-8\" standalone=\"yes\"?>\n"
+                  "<Types xmlns=\"http://schemas.openxmlformats.org/package/2006/content-types\"><Default Extension=\"rels\" ContentType=\"application/vnd.openxmlformats-package.relationships+xml\"/>"
+                  "<Default Extension=\"xml\" ContentType=\"application/xml\"/><Override PartName=\"/word/document.xml\" ContentType=\"application/vnd.openxmlformats-officedocument.wordprocessingml.document.main+xml\"/>"
+                  "<Override PartName=\"/word/styles.xml\" ContentType=\"application/vnd.openxmlformats-officedocument.wordprocessingml.styles+xml\"/></Types>");
+        zip.begin("_rels/.rels");
+        zip.write("<?xml version=\"1.0\" encoding=\"UTF-8\" standalone=\"yes\"?>\n"
+                  "<Relationships xmlns=\"http://schemas.openxmlformats.org/package/2006/relationships\"><Relationship Id=\"rId1\" "
+                  "Type=\"http://schemas.openxmlformats.org/officeDocument/2006/relationships/officeDocument\" Target=\"word/document.xml\"/></Relationships>");
+        zip.begin("word/_rels/document.xml.rels");
+        zip.write("<?xml version=\"1.0\" encoding=\"UTF-8\" standalone=\"yes\"?>\n"
+                  "<Relationships xmlns=\"http://schemas.openxmlformats.org/package/2006/relationships\"><Relationship Id=\"rId1\" "
+                  "Type=\"http://schemas.openxmlformats.org/officeDocument/2006/relationships/styles\" Target=\"styles.xml\"/></Relationships>");
+        zip.begin("word/styles.xml");
+        zip.write(std::string("<?xml version=\"1.0\" encoding=\"UTF-8\" standalone=\"yes\"?>\n<w:styles ") + w + ">"
+                  "<w:style w:type=\"paragraph\" w:default=\"1\" w:styleId=\"Normal\"><w:name w:val=\"Normal\"/></w:style>"
+                  "<w:style w:type=\"paragraph\" w:styleId=\"Heading1\"><w:name w:val=\"heading 1\"/><w:basedOn w:val=\"Normal\"/><w:pPr><w:outlineLvl w:val=\"0\"/></w:pPr></w:style>"
+                  "<w:style w:type=\"paragraph\" w:styleId=\"ListBullet\"><w:name w:val=\"List Bullet\"/><w:basedOn w:val=\"Normal\"/><w:pPr><w:numPr><w:numId w:val=\"1\"/></w:numPr></w:pPr></w:style>"
+                  "</w:styles>");
+
+        zip.begin("word/document.xml");
+        wordSource words(seed);
+        std::string xml = std::string("<?xml version=\"1.0\" encoding=\"UTF-8\" standalone=\"yes\"?>\n<w:document ") + w + "><w:body>";
+        size_t total = 0;
+        unsigned int paragraph = 0;
+        while (total + xml.size() < bytes)
+        {
+            unsigned int kind = words.next() % 30;
+            xml += "<w:p w:rsidR=\"00A1B2C3\" w:rsidRDefault=\"00A1B2C3\">";
+            if (kind == 0) xml += "<w:pPr><w:pStyle w:val=\"Heading1\"/></w:pPr>";
+            else if (kind < 4) xml += "<w:pPr><w:pStyle w:val=\"ListBullet\"/></w:pPr>";
+            else xml += "<w:pPr><w:spacing w:after=\"120\" w:line=\"276\" w:lineRule=\"auto\"/><w:jc w:val=\"both\"/></w:pPr>";
+            unsigned int runs = (kind == 0) ? 1 : 2 + words.next() % 5;
+            for (unsigned int r = 0; r < runs; ++r)
+            {
+                xml += "<w:r><w:rPr><w:rFonts w:ascii=\"Calibri\" w:hAnsi=\"Calibri\"/>";
+                if ((words.next() % 6) == 0) xml += "<w:i/>";
+                xml += "<w:lang w:val=\"en-GB\"/></w:rPr><w:t xml:space=\"preserve\">";
+                unsigned int count = (kind == 0) ? 3 : 4 + words.next() % 12;
+                for (unsigned int i = 0; i < count; ++i)
+                {
+                    xml += words.token();
+                    xml += ' ';
+                }
+                xml += "</w:t></w:r>";
+            }
+            if ((++paragraph % 40) == 0) xml += "<w:r><w:br w:type=\"page\"/></w:r>";
+            xml += "</w:p>\n";
+            if (xml.size() >= (1 << 20))
+            {
+                zip.write(xml);
+                total += xml.size();
+                xml.clear();
+            }
+        }
+        xml += "<w:sectPr><w:pgSz w:w=\"11906\" w:h=\"16838\"/></w:sectPr></w:body></w:document>";
+        zip.write(xml);
+        total += xml.size();
+        zip.finish();
+
+        return total;
+    }
+
+    // Writes a PDF laid out from spec with PoDoFo. The same spec always gives the same pages, text and images.
+    inline void generateCorpus(const corpusSpec& spec, const std::filesystem::path& file)
+    {
+        if (spec.fonts.empty()) throw std::invalid_argument("spec.fonts is empty.");
+
+        PoDoFo::PdfMemDocument doc;
+        std::vector<PoDoFo::PdfFont*> fonts;
+        for (const auto& name : spec.fonts)
+        {
+            PoDoFo::PdfFont* font = doc.CreateFont(name.c_str());
+            if (!font) throw std::runtime_error("Font " + name + " could not be created.");
+            fonts.push_back(font);
+        }
+
+        wordSource words(spec.seed);
+        std::vector<char> pixels(static_cast<size_t>(spec.imageSize) * spec.imageSize * 3);
+        const double top = 800;
+        const double bottom = 60;
+        const double leading = 14;
+
+        for (unsigned int p = 0; p < spec.pages; ++p)
+        {
+            PoDoFo::PdfPage* page = doc.CreatePage(PoDoFo::PdfPage::CreateStandardPageSize(PoDoFo::ePdfPageSize_A4));
+            PoDoFo::PdfObject* resources = page->GetResources();
+
+            PoDoFo::PdfDictionary fontResources;
+            for (size_t f = 0; f < fonts.size(); ++f) fontResources.AddKey(PoDoFo::PdfName("F" + std::to_string(f)), fonts[f]->GetObject()->Reference());
+            resources->GetDictionary().AddKey(PoDoFo::PdfName("Font"), fontResources);
+
+            std::ostringstream content;
+            if (spec.imagesPerPage)
+            {
+                PoDoFo::PdfDictionary imageResources;
+                for (unsigned int i = 0; i < spec.imagesPerPage; ++i)
+                {
+                    // A gradient with noise, so it neither compresses to nothing nor is pure noise.
+                    for (size_t k = 0; k < pixels.size(); ++k) pixels[k] = static_cast<char>(((k / 3) % spec.imageSize) + (words.next() % 32));
+                    PoDoFo::PdfImage image(&doc);
+                    image.SetImageColorSpace(PoDoFo::ePdfColorSpace_DeviceRGB);
+                    PoDoFo::PdfMemoryInputStream in(pixels.data(), static_cast<PoDoFo::pdf_long>(pixels.size()));
+                    image.SetImageData(spec.imageSize, spec.imageSize, 8, &in);
+                    std::string name = "Im" + std::to_string(i);
+                    imageResources.AddKey(PoDoFo::PdfName(name), image.GetObject()->Reference());
+                    double size = 72 + (words.next() % 96);
+                    double x = 40 + (words.next() % 380);
+                    double y = bottom + (words.next() % 600);
+                    content << "q " << size << " 0 0 " << size << ' ' << x << ' ' << y << " cm /" << name << " Do Q\n";
+                }
+                resources->GetDictionary().AddKey(PoDoFo::PdfName("XObject"), imageResources);
+            }
+
+            content << "BT\n";
+            double y = top;
+            size_t font = 0;
+            content << "/F0 11 Tf " << leading << " TL 50 " << y << " Td\n";
+            unsigned int written = 0;
+            while ((written < spec.wordsPerPage) && (y > bottom))
+            {
+                // Start a paragraph in another font now and then.
+                if ((words.next() % 10) == 0)
+                {
+                    font = (font + 1) % fonts.size();
+                    content << "/F" << font << " 11 Tf T*\n";
+                    y -= leading;
+                }
+
+                std::vector<std::string> line;
+                size_t length = 0;
+                while ((length < 80) && (written < spec.wordsPerPage))
+                {
+                    line.push_back(words.token());
+                    length += line.back().size() + 1;
+                    ++written;
+                }
+
+                if ((words.next() % 1000) < spec.kerning * 1000)
+                {
+                    // Spaces become wide negative adjustments and words are kerned inside, as typesetters do.
+                    content << '[';
+                    for (const auto& w : line)
+                    {
+                        size_t split = w.size() / 2;
+                        content << '(' << w.substr(0, split) << ") " << -static_cast<int>(words.next() % 40) << " (" << w.substr(split) << ") -250 ";
+                    }
+                    content << "] TJ T*\n";
+                }
+                else
+                {
+                    content << '(';
+                    for (size_t i = 0; i < line.size(); ++i) content << (i ? " " : "") << line[i];
+                    content << ") Tj T*\n";
+                }
+                y -= leading;
+            }
+            content << "ET\n";
+
+            std::string s = content.str();
+            page->GetContentsForAppending()->GetStream()->Set(s.data(), static_cast<PoDoFo::pdf_long>(s.size()));
+        }
+
+        doc.Write(file.string().c_str());
+    }
+}
+
+#endif // _CORPUS_GENERATOR_HPP_
@@ -0,0 +1,392 @@
+/**************************************************************************
+End to end benchmarks over a generated PDF corpus, with JSON results.
+
+The parsing cases run over --parse-chars characters of generated text, 4 Mi
+by default. Speedups of parseStringParallel() over parseString() should be
+measured on 100 MB or more, e.g.
+
+    fsl-bench --pages 10 --parse-chars 104857600 --repeat 3
+
+The DOCX cases read a generated file whose word/document.xml is --docx-mb
+MiB, 16 by default, and report MiB of that XML per second: inflating it,
+inflating and pull parsing it, and loading it into text corpora with
+loadWordFile(). Run them on 100 MiB or more, e.g.
+
+    fsl-bench --pages 10 --docx-mb 100 --repeat 3
+
+Copyright (C) 2021 Chris Morrison (gnosticist@protonmail.com)
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <http://www.gnu.org/licenses/>.
+**************************************************************************/
+
+#include <algorithm>
+#include <chrono>
+#include <cstdlib>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <functional>
+#include <iostream>
+#include <memory>
+#include <sstream>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <fsl/documentFractionator.hpp>
+
+#include "corpusGenerator.hpp"
+
+namespace
+{
+    using namespace fsl::text;
+
+    struct result
+    {
+        std::string name;
+        std::vector<std::pair<std::string, std::string>> params;
+        std::vector<double> seconds;    // One per repetition.
+        double units;                   // Work done by one repetition, in unit.
+        std::string unit;
+        double baseline = 0;            // The best time of the case this one is compared with, zero if none.
+    };
+
+    struct options
+    {
+        fsl::bench::corpusSpec spec;
+        unsigned int repeat = 5;
+        double dpi = 96;
+        unsigned int renderPages = 10;
+        size_t parseCharacters = 4 * 1024 * 1024;
+        size_t docxBytes = 16 * 1024 * 1024;
+        std::filesystem::path directory = std::filesystem::temp_directory_path();
+        std::filesystem::path out;
+        bool keep = false;
+    };
+
+    // Times body repeat times, setup runs before each repetition and is not timed.
+    result measure(const std::string& name, std::vector<std::pair<std::string, std::string>> params, unsigned int repeat, double units, const std::string& unit, const std::function<void()>& setup, const std::function<void()>& body)
+    {
+        result r{ name, std::move(params), {}, units, unit };
+        for (unsigned int i = 0; i < repeat; ++i)
+        {
+            if (setup) setup();
+            auto start = std::chrono::steady_clock::now();
+            body();
+            r.seconds.push_back(std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count());
+        }
+        std::cerr << name;
+        for (const auto& p : r.params) std::cerr << ' ' << p.first << '=' << p.second;
+        std::cerr << ": " << *std::min_element(r.seconds.begin(), r.seconds.end()) << " s\n";
+
+        return r;
+    }
+
+    std::string quote(const std::string& s)
+    {
+        std::string q = "\"";
+        for (char c : s)
+        {
+            if ((c == '"') || (c == '\\')) q += '\\';
+            if (static_cast<unsigned char>(c) < 0x20) continue;
+            q += c;
+        }
+
+        return q + '"';
+    }
+
+    void writeJson(std::ostream& out, const options& opt, const std::vector<result>& results)
+    {
+        out << "{\n  \"corpus\": {\"pages\": " << opt.spec.pages << ", \"wordsPerPage\": " << opt.spec.wordsPerPage << ", \"fonts\": [";
+        for (size_t i = 0; i < opt.spec.fonts.size(); ++i) out << (i ? ", " : "") << quote(opt.spec.fonts[i]);
+        out << "], \"kerning\": " << opt.spec.kerning << ", \"imagesPerPage\": " << opt.spec.imagesPerPage << ", \"seed\": " << opt.spec.seed << "},\n";
+        out << "  \"results\": [";
+        for (size_t i = 0; i < results.size(); ++i)
+        {
+            const auto& r = results[i];
+            auto sorted = r.seconds;
+            std::sort(sorted.begin(), sorted.end());
+            double best = sorted.front();
+            double median = sorted[sorted.size() / 2];
+            out << (i ? "," : "") << "\n    {\"name\": " << quote(r.name) << ", \"params\": {";
+            for (size_t k = 0; k < r.params.size(); ++k) out << (k ? ", " : "") << quote(r.params[k].first) << ": " << quote(r.params[k].second);
+            out << "}, \"repetitions\": " << sorted.size() << ", \"min_s\": " << best << ", \"median_s\": " << median << ", \"units\": " << r.units
+                << ", \"unit\": " << quote(r.unit) << ", \"per_s\": " << ((best > 0) ? r.units / best : 0.0);
+            if (r.baseline > 0) out << ", \"speedup\": " << ((best > 0) ? r.baseline / best : 0.0);
+            out << "}";
+        }
+        out << "\n  ]\n}\n";
+    }
+
+    const char* name(textBackend backend)
+    {
+        return (backend == textBackend::podofo) ? "podofo" : "poppler";
+    }
+
+    const char* name(imageFormat format)
+    {
+        return (format == imageFormat::png) ? "png" : (format == imageFormat::tiff) ? "tiff" : "jpeg";
+    }
+
+    const char* name(exportFormat format)
+    {
+        return (format == exportFormat::jsonl) ? "jsonl" : "plainText";
+    }
+
+    void usage()
+    {
+        std::cerr << "usage: fsl-bench [--pages N] [--words N] [--fonts A,B,...] [--kerning F] [--images N] [--image-size N]\n"
+                     "                 [--seed N] [--repeat N] [--dpi N] [--render-pages N] [--parse-chars N] [--docx-mb N]\n"
+                     "                 [--dir PATH] [--out FILE] [--keep]\n";
+    }
+
+    bool parseArgs(int argc, char** argv, options& opt)
+    {
+        for (int i = 1; i < argc; ++i)
+        {
+            std::string arg = argv[i];
+            if (arg == "--keep")
+            {
+                opt.keep = true;
+                continue;
+            }
+            if (i + 1 >= argc) return false;
+            std::string value = argv[++i];
+            if (arg == "--pages") opt.spec.pages = static_cast<unsigned int>(std::stoul(value));
+            else if (arg == "--words") opt.spec.wordsPerPage = static_cast<unsigned int>(std::stoul(value));
+            else if (arg == "--kerning") opt.spec.kerning = std::stod(value);
+            else if (arg == "--images") opt.spec.imagesPerPage = static_cast<unsigned int>(std::stoul(value));
+            else if (arg == "--image-size") opt.spec.imageSize = static_cast<unsigned int>(std::stoul(value));
+            else if (arg == "--seed") opt.spec.seed = static_cast<uint32_t>(std::stoul(value));
+            else if (arg == "--repeat") opt.repeat = std::max(1u, static_cast<unsigned int>(std::stoul(value)));
+            else if (arg == "--dpi") opt.dpi = std::stod(value);
+            else if (arg == "--render-pages") opt.renderPages = static_cast<unsigned int>(std::stoul(value));
+            else if (arg == "--parse-chars") opt.parseCharacters = std::stoull(value);
+            else if (arg == "--docx-mb") opt.docxBytes = static_cast<size_t>(std::stoull(value)) * 1024 * 1024;
+            else if (arg == "--dir") opt.directory = value;
+            else if (arg == "--out") opt.out = value;
+            else if (arg == "--fonts")
+            {
+                opt.spec.fonts.clear();
+                std::stringstream ss(value);
+                std::string font;
+                while (std::getline(ss, font, ',')) if (!font.empty()) opt.spec.fonts.push_back(font);
+            }
+            else return false;
+        }
+
+        return opt.spec.pages > 0;
+    }
+}
+
+int main(int argc, char** argv)
+{
+    options opt;
+    try
+    {
+        if (!parseArgs(argc, argv, opt))
+        {
+            usage();
+            return 2;
+        }
+    }
+    catch (const std::exception&)
+    {
+        usage();
+        return 2;
+    }
+
+    std::vector<result> results;
+    std::filesystem::path pdf = opt.directory / ("fsl-bench-" + std::to_string(opt.spec.seed) + ".pdf");
+    std::filesystem::path docx = opt.directory / ("fsl-bench-" + std::to_string(opt.spec.seed) + ".docx");
+    try
+    {
+        results.push_back(measure("generate", {}, 1, opt.spec.pages, "pages", nullptr, [&] { fsl::bench::generateCorpus(opt.spec, pdf); }));
+        unsigned int pages = opt.spec.pages;
+
+        for (auto backend : { textBackend::podofo, textBackend::poppler })
+        {
+            results.push_back(measure("load", { { "backend", name(backend) } }, opt.repeat, 1, "documents", nullptr, [&]
+                {
+                    documentFractionator doc(96, 96);
+                    doc.loadPdfFile(pdf, std::string(), std::string(), backend);
+                }));
+        }
+
+        for (auto backend : { textBackend::podofo, textBackend::poppler })
+        {
+            std::unique_ptr<documentFractionator> doc;
+            results.push_back(measure("getText", { { "backend", name(backend) } }, opt.repeat, pages, "pages", [&]
+                {
+                    doc = std::make_unique<documentFractionator>(96, 96);
+                    doc->loadPdfFile(pdf, std::string(), std::string(), backend);
+                }, [&]
+                {
+                    for (unsigned int p = 1; p <= pages; ++p)
+                    {
+                        doc->setCurrentPage(p);
+                        doc->getText();
+                    }
+                }));
+        }
+
+        {
+            documentFractionator doc(96, 96);
+            doc.loadPdfFile(pdf);
+            unsigned int renderPages = std::min(pages, std::max(1u, opt.renderPages));
+            for (auto format : { imageFormat::png, imageFormat::tiff, imageFormat::jpeg })
+            {
+                results.push_back(measure("renderPage", { { "format", name(format) }, { "dpi", std::to_string(static_cast<int>(opt.dpi)) } }, opt.repeat, renderPages, "pages", nullptr, [&]
+                    {
+                        for (unsigned int p = 1; p <= renderPages; ++p)
+                        {
+                            doc.setCurrentPage(p);
+                            doc.renderPage(opt.dpi, format, true);
+                        }
+                    }));
+            }
+        }
+
+        std::wstring text = fsl::bench::generateText(opt.parseCharacters, opt.spec.seed);
+        double mb = static_cast<double>(text.size()) / (1024.0 * 1024.0);
+        size_t serial = 0;
+        for (int mode = 0; mode < 4; ++mode)
+        {
+            bool sentences = (mode & 1) != 0;
+            bool paragraphs = (mode & 2) != 0;
+            std::vector<std::pair<std::string, std::string>> params = { { "splitSentences", sentences ? "true" : "false" }, { "splitParagraphs", paragraphs ? "true" : "false" } };
+            if (sentences && paragraphs) serial = results.size();
+            results.push_back(measure("parseString", params, opt.repeat, mb, "MiB", nullptr, [&]
+                {
+                    textCorpus tc;
+                    tc.setSplitSentences(sentences);
+                    tc.setSplitParagraphs(paragraphs);
+                    tc.parseString(text, false);
+                }));
+        }
+
+        // The sentence splitter on its own, over the text as parseString() normalises it.
+        {
+            std::wstring prepped;
+            fsl::_private::_prep_string(text, prepped);
+            std::wstring work;
+            std::vector<size_t> boundaries;
+            results.push_back(measure("splitSentences", {}, opt.repeat, mb, "MiB", [&]
+                {
+                    work = prepped;
+                    boundaries.clear();
+                }, [&]
+                {
+                    fsl::_private::_split_sentences(work, &boundaries);
+                }));
+        }
+
+        // The storage and threading variants, with both splits on.
+        results.push_back(measure("parseString", { { "storage", "compact" } }, opt.repeat, mb, "MiB", nullptr, [&]
+            {
+                textCorpus tc;
+                tc.setCompactStorage(true);
+                tc.setSplitSentences(true);
+                tc.setSplitParagraphs(true);
+                tc.parseString(text, false);
+            }));
+        // Against the serial parse of the same text with both splits on, the speedup is the ratio of the best times.
+        results.push_back(measure("parseStringParallel", { { "threads", std::to_string(std::max(1u, std::thread::hardware_concurrency())) } }, opt.repeat, mb, "MiB", nullptr, [&]
+            {
+                textCorpus tc;
+                tc.setSplitSentences(true);
+                tc.setSplitParagraphs(true);
+                tc.parseStringParallel(text, false, 0, 1 << 18);
+            }));
+        const auto& serialTimes = results[serial].seconds;
+        results.back().baseline = *std::min_element(serialTimes.begin(), serialTimes.end());
+        std::cerr << "parseStringParallel speedup over parseString: " << results.back().baseline / *std::min_element(results.back().seconds.begin(), results.back().seconds.end()) << '\n';
+
+        // Writing the same text back out, to a file next to the PDF.
+        std::vector<textCorpus> corpus(1);
+        corpus[0].setSplitSentences(true);
+        corpus[0].setSplitParagraphs(true);
+        corpus[0].parseString(text, false);
+        std::filesystem::path exported = pdf;
+        exported.replace_extension(".export");
+        for (auto format : { exportFormat::jsonl, exportFormat::plainText })
+        {
+            results.push_back(measure("exportCorpus", { { "format", name(format) } }, opt.repeat, mb, "MiB", nullptr, [&]
+                {
+                    exportCorpus(exported, corpus, format);
+                }));
+        }
+        std::error_code ec;
+        std::filesystem::remove(exported, ec);
+
+        // Reading a DOCX file, one stage at a time, in MiB of word/document.xml.
+        double docxMb = 0;
+        results.push_back(measure("generateDocx", {}, 1, static_cast<double>(opt.docxBytes) / (1024.0 * 1024.0), "MiB", nullptr, [&]
+            {
+                docxMb = static_cast<double>(fsl::bench::generateDocx(opt.docxBytes, opt.spec.seed, docx)) / (1024.0 * 1024.0);
+            }));
+        results.push_back(measure("readDocx", { { "stage", "inflate" } }, opt.repeat, docxMb, "MiB", nullptr, [&]
+            {
+                fsl::_private::_zipArchive zip(docx);
+                auto reader = zip.open(*zip.find("word/document.xml"));
+                std::vector<char> buffer(64 * 1024);
+                while (reader->read(buffer.data(), buffer.size()) > 0)
+                {
+                }
+            }));
+        results.push_back(measure("readDocx", { { "stage", "pullParse" } }, opt.repeat, docxMb, "MiB", nullptr, [&]
+            {
+                fsl::_private::_zipArchive zip(docx);
+                auto reader = zip.open(*zip.find("word/document.xml"));
+                fsl::_private::_xmlPullParser xml([&](char* buffer, size_t size) { return reader->read(buffer, size); });
+                while (xml.next() != fsl::_private::_xmlPullParser::event::end)
+                {
+                }
+            }));
+        results.push_back(measure("loadWordFile", {}, opt.repeat, docxMb, "MiB", nullptr, [&]
+            {
+                documentFractionator doc(96, 96);
+                doc.loadWordFile(docx);
+            }));
+    }
+    catch (const std::exception& e)
+    {
+        std::cerr << "fsl-bench: " << e.what() << '\n';
+        return 1;
+    }
+
+    if (!opt.keep)
+    {
+        std::error_code ec;
+        std::filesystem::remove(pdf, ec);
+        std::filesystem::remove(docx, ec);
+    }
+
+    if (opt.out.empty())
+    {
+        writeJson(std::cout, opt, results);
+    }
+    else
+    {
+        std::ofstream out(opt.out);
+        writeJson(out, opt, results);
+        if (!out)
+        {
+            std::cerr << "fsl-bench: could not write " << opt.out << '\n';
+            return 1;
+        }
+    }
+
+    return 0;
+}
@@ -0,0 +1,252 @@
+/**************************************************************************
+Executors, cancellation and awaitable operations for the asynchronous API.
+
+Copyright (C) 2021 Chris Morrison (gnosticist@protonmail.com)
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <http://www.gnu.org/licenses/>.
+**************************************************************************/
+
+#ifndef _ASYNC_OPERATION_HPP_
+#define _ASYNC_OPERATION_HPP_
+
+#include <algorithm>
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <exception>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <optional>
+#include <stdexcept>
+#include <thread>
+#include <type_traits>
+#include <vector>
+
+// The awaitable operations need C++20 coroutines, the rest of this header does not.
+#if defined(__cpp_impl_coroutine) && (__cpp_impl_coroutine >= 201902L) && __has_include(<coroutine>)
+#include <coroutine>
+#define FSL_HAS_COROUTINES 1
+#endif
+
+namespace fsl::text
+{
+    // Runs work somewhere else, e.g. on a thread pool or the event loop of the caller.
+    class executor
+    {
+    public:
+        virtual ~executor() = default;
+        virtual void post(std::function<void()> work) = 0;
+    };
+
+    // A fixed pool of threads taking work in the order it was posted. Work still queued when the pool is
+    // destroyed is run first.
+    class threadPoolExecutor : public executor
+    {
+    private:
+        std::mutex _mutex;
+        std::condition_variable _posted;
+        std::deque<std::function<void()>> _queue;
+        std::vector<std::thread> _threads;
+        bool _stop = false;
+
+        void _run()
+        {
+            std::unique_lock<std::mutex> lock(_mutex);
+            while (true)
+            {
+                _posted.wait(lock, [this] { return _stop || !_queue.empty(); });
+                if (_queue.empty()) return;
+                auto work = std::move(_queue.front());
+                _queue.pop_front();
+                lock.unlock();
+                work();
+                lock.lock();
+            }
+        }
+
+    public:
+        // The hardware concurrency if threads is zero.
+        explicit threadPoolExecutor(unsigned int threads = 0)
+        {
+            if (threads == 0) threads = std::max(1u, std::thread::hardware_concurrency());
+            for (unsigned int i = 0; i < threads; ++i) _threads.emplace_back(&threadPoolExecutor::_run, this);
+        }
+
+        ~threadPoolExecutor() override
+        {
+            {
+                std::lock_guard<std::mutex> lock(_mutex);
+                _stop = true;
+            }
+            _posted.notify_all();
+            for (auto& t : _threads) t.join();
+        }
+
+        threadPoolExecutor(const threadPoolExecutor&) = delete;
+        threadPoolExecutor& operator=(const threadPoolExecutor&) = delete;
+
+        void post(std::function<void()> work) override
+        {
+            {
+                std::lock_guard<std::mutex> lock(_mutex);
+                _queue.push_back(std::move(work));
+            }
+            _posted.notify_one();
+        }
+    };
+
+    // The executor asynchronous operations run on unless told otherwise.
+    inline executor& defaultExecutor()
+    {
+        static threadPoolExecutor pool;
+        return pool;
+    }
+
+    // Thrown by an operation that noticed its cancellation token had been cancelled.
+    class operationCancelled : public std::runtime_error
+    {
+    public:
+        operationCancelled() : std::runtime_error("The operation was cancelled.")
+        {
+        }
+    };
+
+    class cancellationSource;
+
+    // Observes a cancellationSource. A default constructed token is never cancelled.
+    class cancellationToken
+    {
+        friend class cancellationSource;
+
+    private:
+        std::shared_ptr<const std::atomic<bool>> _state;
+
+    public:
+        cancellationToken() = default;
+
+        [[nodiscard]] bool cancelled() const noexcept
+        {
+            return _state && _state->load(std::memory_order_relaxed);
+        }
+
+        void throwIfCancelled() const
+        {
+            if (cancelled()) throw operationCancelled();
+        }
+    };
+
+    class cancellationSource
+    {
+    private:
+        std::shared_ptr<std::atomic<bool>> _state = std::make_shared<std::atomic<bool>>(false);
+
+    public:
+        [[nodiscard]] cancellationToken token() const
+        {
+            cancellationToken t;
+            t._state = _state;
+            return t;
+        }
+
+        void cancel() noexcept
+        {
+            _state->store(true, std::memory_order_relaxed);
+        }
+
+        [[nodiscard]] bool cancelled() const noexcept
+        {
+            return _state->load(std::memory_order_relaxed);
+        }
+    };
+
+    // Where an asynchronous operation runs and resumes its caller, and how it is cancelled.
+    struct asyncContext
+    {
+        executor* runOn = nullptr;      // defaultExecutor() if null.
+        executor* resumeOn = nullptr;   // The caller is resumed on the thread that ran the operation if null.
+        cancellationToken cancel;
+    };
+
+#ifdef FSL_HAS_COROUTINES
+    // Awaiting the operation runs its work on the executor of its context and resumes the awaiting coroutine
+    // with the result, or the exception the work threw. T may be a reference, void or a value. If the token
+    // is cancelled before the work starts, operationCancelled is thrown without running it.
+    template<typename T>
+    class asyncOperation
+    {
+    private:
+        using _stored = std::conditional_t<std::is_void_v<T>, bool, std::conditional_t<std::is_reference_v<T>, std::remove_reference_t<T>*, T>>;
+
+        std::function<T()> _work;
+        asyncContext _context;
+        std::optional<_stored> _result;
+        std::exception_ptr _error;
+
+    public:
+        asyncOperation(std::function<T()> work, asyncContext context) : _work(std::move(work)), _context(std::move(context))
+        {
+        }
+
+        bool await_ready() const noexcept
+        {
+            return false;
+        }
+
+        void await_suspend(std::coroutine_handle<> caller)
+        {
+            executor& on = _context.runOn ? *_context.runOn : defaultExecutor();
+            on.post([this, caller]
+                {
+                    try
+                    {
+                        _context.cancel.throwIfCancelled();
+                        if constexpr (std::is_void_v<T>)
+                        {
+                            _work();
+                            _result.emplace(true);
+                        }
+                        else if constexpr (std::is_reference_v<T>)
+                        {
+                            _result.emplace(&_work());
+                        }
+                        else
+                        {
+                            _result.emplace(_work());
+                        }
+                    }
+                    catch (...)
+                    {
+                        _error = std::current_exception();
+                    }
+
+                    // This object lives in the frame of the caller and may be gone once it has been resumed.
+                    executor* resumeOn = _context.resumeOn;
+                    if (resumeOn) resumeOn->post([caller] { caller.resume(); });
+                    else caller.resume();
+                });
+        }
+
+        T await_resume()
+        {
+            if (_error) std::rethrow_exception(_error);
+            if constexpr (std::is_void_v<T>) return;
+            else if constexpr (std::is_reference_v<T>) return **_result;
+            else return std::move(*_result);
+        }
+    };
+#endif
+}
+
+#endif // _ASYNC_OPERATION_HPP_
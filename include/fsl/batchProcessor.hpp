@@ -0,0 +1,433 @@
+/**************************************************************************
+Renders and extracts the pages of many PDF files across a pool of threads.
+
+Copyright (C) 2021 Chris Morrison (gnosticist@protonmail.com)
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <http://www.gnu.org/licenses/>.
+**************************************************************************/
+
+#ifndef _BATCH_PROCESSOR_HPP_
+#define _BATCH_PROCESSOR_HPP_
+
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <deque>
+#include <exception>
+#include <filesystem>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <random>
+#include <stdexcept>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "textCorpus.hpp"
+#include "pdfDocument.hpp"
+
+namespace fsl::_private
+{
+    // Counts bytes in use against a budget. A request larger than the whole budget is let through once nothing
+    // else is in use, so it cannot wait forever.
+    class _byteBudget
+    {
+    private:
+        std::mutex _mutex;
+        std::condition_variable _released;
+        size_t _budget;
+        size_t _used = 0;
+
+    public:
+        explicit _byteBudget(size_t budget) : _budget(budget)
+        {
+        }
+
+        void acquire(size_t bytes)
+        {
+            std::unique_lock<std::mutex> lock(_mutex);
+            _released.wait(lock, [&] { return (_used == 0) || (_used + bytes <= _budget); });
+            _used += bytes;
+        }
+
+        void release(size_t bytes)
+        {
+            {
+                std::lock_guard<std::mutex> lock(_mutex);
+                _used -= bytes;
+            }
+            _released.notify_all();
+        }
+    };
+}
+
+namespace fsl::text
+{
+    // What to do with each page of a document.
+    struct batchJob
+    {
+        std::vector<unsigned int> pages;    // Page numbers from 1, every page if empty.
+        bool render = true;
+        double dpi = 96;
+        imageFormat format = imageFormat::png;
+        bool compress = true;
+        bool text = true;
+        bool splitSentences = true;
+        bool splitParagraphs = true;
+        textBackend backend = textBackend::podofo;
+        std::string ownerPassword;
+        std::string userPassword;
+    };
+
+    struct batchOptions
+    {
+        unsigned int threads = 0;           // The hardware concurrency if zero.
+        size_t memoryBudget = 1024 * 1024 * 1024;   // For the pixels of the pages being rendered, and their images until delivered.
+        size_t maxOpenDocuments = 0;        // Twice the number of threads if zero.
+    };
+
+    // The result for one page. If the page failed, error holds the exception and the rest is empty.
+    struct batchPageResult
+    {
+        size_t document = 0;                // The index of the document in the list of paths.
+        const std::filesystem::path* path = nullptr;
+        unsigned int page = 0;
+        std::vector<uint8_t> image;
+        std::shared_ptr<const textCorpus> text;
+        std::exception_ptr error;
+    };
+
+    // Reported once every page of a document has been delivered, or when it could not be opened, in which case
+    // error holds the exception.
+    struct batchDocumentResult
+    {
+        size_t document = 0;
+        std::filesystem::path path;
+        unsigned int pages = 0;
+        size_t failedPages = 0;
+        std::exception_ptr error;
+    };
+
+    // Processes a list of PDF files a page at a time on a pool of threads. Each thread keeps a queue of the pages
+    // of the documents it opened and works through them in order; a thread with nothing to do opens the next
+    // document, or once enough are open, steals pages from the back of another thread's queue, so a long
+    // document is shared out instead of holding up the rest. Rendering waits while the rasters in flight would
+    // exceed the memory budget. The callbacks are called on the pool threads, possibly at the same time.
+    class batchProcessor
+    {
+    public:
+        using pageCallback = std::function<void(batchPageResult&)>;
+        using documentCallback = std::function<void(const batchDocumentResult&)>;
+
+    private:
+        struct _document
+        {
+            size_t index = 0;
+            std::filesystem::path path;
+            batchJob job;
+            std::shared_ptr<pdfDocument> doc;
+            unsigned int pages = 0;
+            std::atomic<size_t> remaining{ 0 };
+            std::atomic<size_t> failed{ 0 };
+        };
+
+        struct _task
+        {
+            std::shared_ptr<_document> document;
+            unsigned int page = 0;
+        };
+
+        struct _worker
+        {
+            std::mutex mutex;
+            std::deque<_task> tasks;
+        };
+
+        batchOptions _options;
+        pageCallback _onPage;
+        documentCallback _onDocument;
+        std::atomic<bool> _cancelled{ false };
+
+        // The state of a run.
+        const std::vector<std::filesystem::path>* _paths = nullptr;
+        std::function<batchJob(const std::filesystem::path&)> _jobFor;
+        std::unique_ptr<_worker[]> _workers;
+        unsigned int _threads = 0;
+        size_t _maxOpen = 0;
+        std::atomic<size_t> _nextPath{ 0 };
+        std::atomic<size_t> _openDocuments{ 0 };
+        std::unique_ptr<fsl::_private::_byteBudget> _budget;
+        std::mutex _idleMutex;
+        std::condition_variable _idle;
+        std::mutex _errorMutex;
+        std::exception_ptr _error;
+
+        // Calls back into the caller, an exception stops the run and is rethrown by run().
+        template<typename F>
+        void _call(F&& f)
+        {
+            try
+            {
+                f();
+            }
+            catch (...)
+            {
+                {
+                    std::lock_guard<std::mutex> lock(_errorMutex);
+                    if (!_error) _error = std::current_exception();
+                }
+                cancel();
+            }
+        }
+
+        bool _pop(unsigned int w, _task& task)
+        {
+            _worker& worker = _workers[w];
+            std::lock_guard<std::mutex> lock(worker.mutex);
+            if (worker.tasks.empty()) return false;
+            task = std::move(worker.tasks.back());
+            worker.tasks.pop_back();
+
+            return true;
+        }
+
+        bool _steal(unsigned int w, std::minstd_rand& random, _task& task)
+        {
+            unsigned int start = static_cast<unsigned int>(random() % _threads);
+            for (unsigned int i = 0; i < _threads; ++i)
+            {
+                unsigned int victim = (start + i) % _threads;
+                if (victim == w) continue;
+                _worker& worker = _workers[victim];
+                std::lock_guard<std::mutex> lock(worker.mutex);
+                if (worker.tasks.empty()) continue;
+                task = std::move(worker.tasks.front());
+                worker.tasks.pop_front();
+
+                return true;
+            }
+
+            return false;
+        }
+
+        // Opens the next document, if fewer than the maximum are open, and queues its pages on this thread.
+        bool _open(unsigned int w, _task& task)
+        {
+            size_t open = _openDocuments.load();
+            do
+            {
+                if ((open >= _maxOpen) || _cancelled) return false;
+            } while (!_openDocuments.compare_exchange_weak(open, open + 1));
+
+            size_t i = _nextPath++;
+            if (i >= _paths->size())
+            {
+                --_openDocuments;
+                return false;
+            }
+
+            auto d = std::make_shared<_document>();
+            d->index = i;
+            d->path = (*_paths)[i];
+            std::vector<unsigned int> pages;
+            try
+            {
+                d->job = _jobFor(d->path);
+                d->doc = pdfDocument::open(d->path, d->job.ownerPassword, d->job.userPassword, d->job.backend);
+                d->pages = d->doc->numberOfPages();
+                pages = d->job.pages;
+                if (pages.empty())
+                {
+                    pages.resize(d->pages);
+                    for (unsigned int p = 0; p < d->pages; ++p) pages[p] = p + 1;
+                }
+            }
+            catch (...)
+            {
+                batchDocumentResult result;
+                result.document = d->index;
+                result.path = d->path;
+                result.error = std::current_exception();
+                if (_onDocument && !_cancelled) _call([&] { _onDocument(result); });
+                _closed();
+                return false;
+            }
+
+            if (pages.empty())
+            {
+                _finish(d);
+                return false;
+            }
+
+            // The thread works up from the first page at the back, thieves take the last pages from the front.
+            d->remaining = pages.size();
+            {
+                _worker& worker = _workers[w];
+                std::lock_guard<std::mutex> lock(worker.mutex);
+                for (auto p = pages.rbegin(); p != pages.rend(); ++p) worker.tasks.push_back({ d, *p });
+                task = std::move(worker.tasks.back());
+                worker.tasks.pop_back();
+            }
+            _idle.notify_all();
+
+            return true;
+        }
+
+        void _closed()
+        {
+            --_openDocuments;
+            _idle.notify_all();
+        }
+
+        void _finish(const std::shared_ptr<_document>& d)
+        {
+            batchDocumentResult result;
+            result.document = d->index;
+            result.path = d->path;
+            result.pages = d->pages;
+            result.failedPages = d->failed;
+            d->doc.reset();
+            if (_onDocument && !_cancelled) _call([&] { _onDocument(result); });
+            _closed();
+        }
+
+        void _run(_task& task)
+        {
+            _document& d = *task.document;
+            if (!_cancelled)
+            {
+                batchPageResult result;
+                result.document = d.index;
+                result.path = &d.path;
+                result.page = task.page;
+                size_t reserved = 0;
+                try
+                {
+                    if ((task.page == 0) || (task.page > d.pages)) throw std::invalid_argument("page out of range.");
+                    pdfPage page = d.doc->page(task.page);
+                    if (d.job.render)
+                    {
+                        reserved = page.rasterBytes(d.job.dpi);
+                        _budget->acquire(reserved);
+                        result.image = page.render(d.job.dpi, d.job.format, d.job.compress);
+                    }
+                    if (d.job.text) result.text = page.text(d.job.splitSentences, d.job.splitParagraphs);
+                }
+                catch (...)
+                {
+                    result.image.clear();
+                    result.text.reset();
+                    result.error = std::current_exception();
+                    ++d.failed;
+                }
+                if (_onPage && !_cancelled) _call([&] { _onPage(result); });
+                if (reserved) _budget->release(reserved);
+            }
+
+            if (--d.remaining == 0) _finish(task.document);
+        }
+
+        void _work(unsigned int w)
+        {
+            std::minstd_rand random(w + 1);
+            _task task;
+            while (true)
+            {
+                if (_pop(w, task) || _open(w, task) || _steal(w, random, task))
+                {
+                    _run(task);
+                    task = _task();
+                    continue;
+                }
+
+                if ((_cancelled || (_nextPath >= _paths->size())) && (_openDocuments == 0)) return;
+                std::unique_lock<std::mutex> lock(_idleMutex);
+                _idle.wait_for(lock, std::chrono::milliseconds(5));
+            }
+        }
+
+    public:
+        explicit batchProcessor(const batchOptions& options = batchOptions()) : _options(options)
+        {
+        }
+
+        batchProcessor(const batchProcessor&) = delete;
+        batchProcessor& operator=(const batchProcessor&) = delete;
+
+        // Called for every page processed, the image can be moved out of the result.
+        void onPage(pageCallback callback)
+        {
+            _onPage = std::move(callback);
+        }
+
+        void onDocument(documentCallback callback)
+        {
+            _onDocument = std::move(callback);
+        }
+
+        // Processes the documents, asking jobFor what to do with each as it is opened, and returns once every
+        // page has been delivered or the run has been cancelled. If a callback throws, the run is cancelled and
+        // the exception rethrown. Only one run at a time.
+        void run(const std::vector<std::filesystem::path>& paths, const std::function<batchJob(const std::filesystem::path&)>& jobFor)
+        {
+            if (!jobFor) throw std::invalid_argument("jobFor is empty.");
+
+            _paths = &paths;
+            _jobFor = jobFor;
+            _threads = _options.threads ? _options.threads : std::max(1u, std::thread::hardware_concurrency());
+            _maxOpen = _options.maxOpenDocuments ? _options.maxOpenDocuments : 2 * static_cast<size_t>(_threads);
+            _workers.reset(new _worker[_threads]);
+            _budget = std::make_unique<fsl::_private::_byteBudget>(_options.memoryBudget);
+            _nextPath = 0;
+            _openDocuments = 0;
+            _cancelled = false;
+            _error = nullptr;
+
+            std::vector<std::thread> pool;
+            try
+            {
+                for (unsigned int w = 1; w < _threads; ++w) pool.emplace_back(&batchProcessor::_work, this, w);
+            }
+            catch (...)
+            {
+                cancel();
+                for (auto& t : pool) t.join();
+                throw;
+            }
+            _work(0);
+            for (auto& t : pool) t.join();
+
+            _workers.reset();
+            _jobFor = nullptr;
+            _paths = nullptr;
+            if (_error) std::rethrow_exception(_error);
+        }
+
+        void run(const std::vector<std::filesystem::path>& paths, const batchJob& job)
+        {
+            run(paths, [&job](const std::filesystem::path&) { return job; });
+        }
+
+        // Stops a run, from a callback or another thread. Pages being processed finish, the rest are dropped
+        // without being delivered.
+        void cancel()
+        {
+            _cancelled = true;
+            _idle.notify_all();
+        }
+    };
+}
+
+#endif // _BATCH_PROCESSOR_HPP_
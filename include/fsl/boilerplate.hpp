@@ -0,0 +1,165 @@
+/**************************************************************************
+Detection of running headers, footers and other boilerplate across pages.
+
+Copyright (C) 2021 Chris Morrison (gnosticist@protonmail.com)
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <http://www.gnu.org/licenses/>.
+**************************************************************************/
+
+#ifndef _BOILERPLATE_HPP_
+#define _BOILERPLATE_HPP_
+
+#include <cmath>
+#include <cstdint>
+#include <algorithm>
+#include <string_view>
+#include <unordered_map>
+#include <vector>
+
+#include "hashUtils.hpp"
+#include "textCorpus.hpp"
+
+namespace fsl::_private
+{
+    // Hashes an item with runs of digits masked, runs of spaces folded and ASCII letters in lower case, so that
+    // "Page 9 of 120" and "page 10 of 120" hash the same. slot identifies the position of the item on its page.
+    inline uint64_t _boilerplate_hash(std::wstring_view text, int64_t slot)
+    {
+        uint64_t h = _fnv1a(static_cast<uint64_t>(slot));
+        bool digits = false;
+        bool space = false;
+        for (wchar_t c : text)
+        {
+            if ((c >= '0') && (c <= '9'))
+            {
+                if (digits) continue;
+                digits = true;
+                c = '#';
+            }
+            else
+            {
+                digits = false;
+                if (c == ' ')
+                {
+                    if (space) continue;
+                    space = true;
+                }
+                else
+                {
+                    space = false;
+                    if ((c >= 'A') && (c <= 'Z')) c |= 0x20;
+                }
+            }
+            uint32_t v = static_cast<uint32_t>(c);
+            h = _fnv1a(&v, sizeof(v), h);
+        }
+
+        return h;
+    }
+}
+
+namespace fsl::text
+{
+    // An item found to be boilerplate, page is the index of the page in the vector that was searched.
+    struct boilerplateItem
+    {
+        size_t page;
+        size_t item;
+    };
+
+    // Finds items that repeat, with their digits masked, at the same position on many pages. Only the first
+    // and last edgeItems non empty items of each page are considered, counted from the top and the bottom of
+    // the page respectively. An item is boilerplate when its text and position occur on at least minFraction
+    // of the pages that have text, and on at least two pages. Runs in time linear in the number of items.
+    inline std::vector<boilerplateItem> findBoilerplate(const std::vector<textCorpus>& pages, double minFraction = 0.4, size_t edgeItems = 3)
+    {
+        using namespace fsl::_private;
+
+        // Each candidate item is visited twice, once to count the pages it occurs on and once to report it.
+        const auto visit = [&](size_t p, auto&& f)
+        {
+            const textCorpus& tc = pages[p];
+            size_t n = 0;
+            for (size_t i = 0; (i < tc.size()) && (n < edgeItems); ++i)
+            {
+                auto text = tc.text(i);
+                if (!text.empty()) f(i, _boilerplate_hash(text, static_cast<int64_t>(n++)));
+            }
+            n = 0;
+            for (size_t i = tc.size(); (i > 0) && (n < edgeItems); --i)
+            {
+                auto text = tc.text(i - 1);
+                if (!text.empty()) f(i - 1, _boilerplate_hash(text, -1 - static_cast<int64_t>(n++)));
+            }
+        };
+
+        std::unordered_map<uint64_t, size_t> counts;
+        std::vector<uint64_t> seen;
+        size_t withText = 0;
+        for (size_t p = 0; p < pages.size(); ++p)
+        {
+            if (pages[p].empty()) continue;
+            ++withText;
+            // Count each hash once per page even if the page is short enough for the top and bottom to overlap.
+            seen.clear();
+            visit(p, [&](size_t, uint64_t h) { seen.push_back(h); });
+            std::sort(seen.begin(), seen.end());
+            seen.erase(std::unique(seen.begin(), seen.end()), seen.end());
+            for (auto h : seen) ++counts[h];
+        }
+
+        std::vector<boilerplateItem> found;
+        size_t threshold = std::max<size_t>(2, static_cast<size_t>(std::ceil(minFraction * static_cast<double>(withText))));
+        if (withText < threshold) return found;
+
+        for (size_t p = 0; p < pages.size(); ++p)
+        {
+            if (pages[p].empty()) continue;
+            size_t first = found.size();
+            visit(p, [&](size_t i, uint64_t h) { if (counts[h] >= threshold) found.push_back({ p, i }); });
+            std::sort(found.begin() + first, found.end(), [](const boilerplateItem& a, const boilerplateItem& b) { return a.item < b.item; });
+            found.erase(std::unique(found.begin() + first, found.end(), [](const boilerplateItem& a, const boilerplateItem& b) { return a.item == b.item; }), found.end());
+        }
+
+        return found;
+    }
+
+    // Removes the items found by findBoilerplate() from the pages. Returns the number of items removed.
+    inline size_t removeBoilerplate(std::vector<textCorpus>& pages, double minFraction = 0.4, size_t edgeItems = 3)
+    {
+        auto found = findBoilerplate(pages, minFraction, edgeItems);
+        size_t removed = 0;
+        size_t k = 0;
+        while (k < found.size())
+        {
+            size_t p = found[k].page;
+            size_t first = k;
+            while ((k < found.size()) && (found[k].page == p)) ++k;
+            size_t next = first;
+            removed += pages[p].removeItems([&](size_t i)
+                {
+                    if ((next < k) && (found[next].item == i))
+                    {
+                        ++next;
+                        return true;
+                    }
+                    return false;
+                });
+        }
+
+        return removed;
+    }
+}
+
+#endif // _BOILERPLATE_HPP_
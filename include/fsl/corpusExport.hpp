@@ -0,0 +1,306 @@
+/**************************************************************************
+Writes the items of text corpora to JSON Lines or plain text files.
+
+Copyright (C) 2021 Chris Morrison (gnosticist@protonmail.com)
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <http://www.gnu.org/licenses/>.
+**************************************************************************/
+
+#ifndef _CORPUS_EXPORT_HPP_
+#define _CORPUS_EXPORT_HPP_
+
+#include <algorithm>
+#include <cstdint>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <stdexcept>
+#include <string_view>
+#include <vector>
+
+#include "textCorpus.hpp"
+
+namespace fsl::_private
+{
+    // A file written through a buffer of its own, so that text can be encoded straight into the buffer.
+    class _bufferedSink
+    {
+    private:
+        std::ofstream _out;
+        std::vector<char> _buffer;
+        size_t _used;
+
+    public:
+        explicit _bufferedSink(const std::filesystem::path& file, size_t capacity = 1 << 20) : _buffer(std::max<size_t>(capacity, 4096))
+        {
+            _used = 0;
+            _out.open(file, std::ios::binary | std::ios::trunc);
+            if (!_out) throw std::runtime_error("The export file could not be created.");
+        }
+
+        _bufferedSink(const _bufferedSink&) = delete;
+        _bufferedSink& operator=(const _bufferedSink&) = delete;
+
+        ~_bufferedSink()
+        {
+            // Errors are only reported by close().
+            if (_out.is_open()) _out.write(_buffer.data(), static_cast<std::streamsize>(_used));
+        }
+
+        // Room for at least n bytes, flushing the buffer first if there is not. Write into it and hand the end of
+        // what was written to commit(). n must not be more than the capacity.
+        char* reserve(size_t n)
+        {
+            if (_buffer.size() - _used < n) flush();
+
+            return _buffer.data() + _used;
+        }
+
+        void commit(const char* end) noexcept
+        {
+            _used = static_cast<size_t>(end - _buffer.data());
+        }
+
+        void append(const char* data, size_t length)
+        {
+            while (length > 0)
+            {
+                size_t n = std::min(length, _buffer.size());
+                std::memcpy(reserve(n), data, n);
+                _used += n;
+                data += n;
+                length -= n;
+            }
+        }
+
+        void flush()
+        {
+            _out.write(_buffer.data(), static_cast<std::streamsize>(_used));
+            _used = 0;
+            if (!_out) throw std::runtime_error("The export file could not be written.");
+        }
+
+        void close()
+        {
+            flush();
+            _out.close();
+            if (!_out) throw std::runtime_error("The export file could not be written.");
+        }
+    };
+
+    // Encodes text as UTF-8 straight into a sink, escaped for a JSON string if Json is set. The text is taken a
+    // block at a time: a block of ASCII that needs no escaping, the common case, is found with a branch free
+    // test the compiler vectorises and narrowed in one go, anything else is encoded a character at a time.
+    // UTF-16 surrogate pairs are combined and unpaired surrogates become U+FFFD.
+    template <bool Json>
+    inline void _writeUtf8(_bufferedSink& sink, std::wstring_view text)
+    {
+        constexpr size_t block = 32;
+        constexpr size_t worst = Json ? 6 : 4;     // Bytes for one character, "\u001f" or a 4 byte sequence.
+        static const char hex[] = "0123456789abcdef";
+
+        size_t i = 0;
+        while (i < text.size())
+        {
+            size_t n = std::min(block, text.size() - i);
+            char* out = sink.reserve(n * worst);
+            const wchar_t* p = text.data() + i;
+
+            uint32_t special = 0;
+            for (size_t k = 0; k < n; ++k)
+            {
+                uint32_t c = static_cast<uint32_t>(p[k]);
+                special |= static_cast<uint32_t>(c >= 0x80);
+                if (Json) special |= static_cast<uint32_t>(c < 0x20) | static_cast<uint32_t>(c == '"') | static_cast<uint32_t>(c == '\\');
+            }
+            if (!special)
+            {
+                for (size_t k = 0; k < n; ++k) out[k] = static_cast<char>(p[k]);
+                sink.commit(out + n);
+                i += n;
+                continue;
+            }
+
+            // A surrogate pair may take the character after the block with it, its 4 bytes fit in the room
+            // reserved for the two.
+            size_t stop = i + n;
+            while (i < stop)
+            {
+                uint32_t c = static_cast<uint32_t>(text[i++]);
+                if (c < 0x80)
+                {
+                    if (Json && ((c < 0x20) || (c == '"') || (c == '\\')))
+                    {
+                        *out++ = '\\';
+                        switch (c)
+                        {
+                        case '"': *out++ = '"'; break;
+                        case '\\': *out++ = '\\'; break;
+                        case '\n': *out++ = 'n'; break;
+                        case '\r': *out++ = 'r'; break;
+                        case '\t': *out++ = 't'; break;
+                        case '\b': *out++ = 'b'; break;
+                        case '\f': *out++ = 'f'; break;
+                        default:
+                            *out++ = 'u';
+                            *out++ = '0';
+                            *out++ = '0';
+                            *out++ = hex[c >> 4];
+                            *out++ = hex[c & 0xF];
+                            break;
+                        }
+                    }
+                    else
+                    {
+                        *out++ = static_cast<char>(c);
+                    }
+                    continue;
+                }
+
+                if ((c >= 0xD800) && (c <= 0xDBFF) && (i < text.size()))
+                {
+                    uint32_t low = static_cast<uint32_t>(text[i]);
+                    if ((low >= 0xDC00) && (low <= 0xDFFF))
+                    {
+                        c = 0x10000 + ((c - 0xD800) << 10) + (low - 0xDC00);
+                        ++i;
+                    }
+                }
+                if (((c >= 0xD800) && (c <= 0xDFFF)) || (c > 0x10FFFF)) c = 0xFFFD;
+
+                if (c < 0x800)
+                {
+                    *out++ = static_cast<char>(0xC0 | (c >> 6));
+                }
+                else if (c < 0x10000)
+                {
+                    *out++ = static_cast<char>(0xE0 | (c >> 12));
+                    *out++ = static_cast<char>(0x80 | ((c >> 6) & 0x3F));
+                }
+                else
+                {
+                    *out++ = static_cast<char>(0xF0 | (c >> 18));
+                    *out++ = static_cast<char>(0x80 | ((c >> 12) & 0x3F));
+                    *out++ = static_cast<char>(0x80 | ((c >> 6) & 0x3F));
+                }
+                *out++ = static_cast<char>(0x80 | (c & 0x3F));
+            }
+            sink.commit(out);
+        }
+    }
+
+    // Appends an unsigned number to a sink.
+    inline void _writeNumber(_bufferedSink& sink, uint64_t value)
+    {
+        char digits[20];
+        size_t n = 0;
+        do
+        {
+            digits[n++] = static_cast<char>('0' + (value % 10));
+            value /= 10;
+        } while (value != 0);
+        char* out = sink.reserve(n);
+        while (n > 0) *out++ = digits[--n];
+        sink.commit(out);
+    }
+}
+
+namespace fsl::text
+{
+    enum class exportFormat
+    {
+        jsonl,          // One JSON object per item, see corpusExporter.
+        plainText       // One item per line.
+    };
+
+    // Writes the items of the pages of a document to a UTF-8 file as they are handed to it, with no allocation
+    // per item. In JSON Lines each item is written as
+    //
+    //     {"page":1,"item":0,"type":"sentence","text":"..."}
+    //
+    // where page is numbered from one, item is the index of the item in the corpus of the page and type is one
+    // of title, sentence, paragraph or listItem. As plain text each item is written on a line of its own, the
+    // empty items that end paragraphs giving blank lines, and each page is ended by a form feed.
+    class corpusExporter
+    {
+    private:
+        fsl::_private::_bufferedSink _sink;
+        exportFormat _format;
+
+        static std::string_view _typeName(textCorpusItem::itemType type)
+        {
+            switch (type)
+            {
+            case textCorpusItem::itemType::title: return "title";
+            case textCorpusItem::itemType::sentence: return "sentence";
+            case textCorpusItem::itemType::listItem: return "listItem";
+            default: return "paragraph";
+            }
+        }
+
+        void _write(std::string_view text)
+        {
+            _sink.append(text.data(), text.size());
+        }
+
+    public:
+        corpusExporter(const std::filesystem::path& file, exportFormat format) : _sink(file), _format(format)
+        {
+        }
+
+        // Writes the items of a page, numbered from one.
+        void write(unsigned int page, const textCorpus& tc)
+        {
+            for (size_t i = 0; i < tc.size(); ++i)
+            {
+                if (_format == exportFormat::jsonl)
+                {
+                    _write("{\"page\":");
+                    fsl::_private::_writeNumber(_sink, page);
+                    _write(",\"item\":");
+                    fsl::_private::_writeNumber(_sink, i);
+                    _write(",\"type\":\"");
+                    _write(_typeName(tc.type(i)));
+                    _write("\",\"text\":\"");
+                    fsl::_private::_writeUtf8<true>(_sink, tc.text(i));
+                    _write("\"}\n");
+                }
+                else
+                {
+                    fsl::_private::_writeUtf8<false>(_sink, tc.text(i));
+                    _write("\n");
+                }
+            }
+            if (_format == exportFormat::plainText) _write("\f");
+        }
+
+        // Writes what is left in the buffer and closes the file. Errors writing the file are only reported here
+        // and by write().
+        void close()
+        {
+            _sink.close();
+        }
+    };
+
+    // Writes the items of a document's pages to a file, see corpusExporter. Pages are numbered from one by
+    // their position in pages.
+    inline void exportCorpus(const std::filesystem::path& file, const std::vector<textCorpus>& pages, exportFormat format)
+    {
+        corpusExporter exporter(file, format);
+        for (size_t p = 0; p < pages.size(); ++p) exporter.write(static_cast<unsigned int>(p + 1), pages[p]);
+        exporter.close();
+    }
+}
+
+#endif // _CORPUS_EXPORT_HPP_
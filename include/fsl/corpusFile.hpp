@@ -0,0 +1,263 @@
+/**************************************************************************
+A binary, memory mappable file format for the extracted text of a document.
+
+Copyright (C) 2021 Chris Morrison (gnosticist@protonmail.com)
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <http://www.gnu.org/licenses/>.
+**************************************************************************/
+
+#ifndef _CORPUS_FILE_HPP_
+#define _CORPUS_FILE_HPP_
+
+#include <cstdint>
+#include <cstring>
+#include <fstream>
+#include <memory>
+#include <stdexcept>
+#include <vector>
+#include <filesystem>
+
+#include "hashUtils.hpp"
+#include "fileMapping.hpp"
+#include "textCorpus.hpp"
+
+namespace fsl::_private
+{
+    // The file is laid out as:-
+    //
+    // _corpusFileHeader
+    // _corpusFilePage[pageCount]
+    // _corpusFileItem[itemCount]
+    // wchar_t[textLength]
+    //
+    // All the sections are a multiple of 8 bytes long so every section is naturally aligned in a mapping. The
+    // checksum covers everything after the header. Integers and characters are stored in the native byte order
+    // and character size, a file written on a platform with a different wchar_t is rejected.
+    //
+    // Version 2 added the source hash of each page, a hash of whatever the text of the page was extracted from,
+    // so that the pages of a modified document that did not change can be reused.
+    constexpr char _corpus_file_magic[8] = { 'F', 'S', 'L', 'C', 'O', 'R', 'P', 0 };
+    constexpr uint32_t _corpus_file_version = 2;
+    constexpr uint32_t _corpus_file_bom = 0x01020304;
+
+    enum _corpusPageFlags : uint32_t
+    {
+        _page_present = 1,
+        _page_split_sentences = 2,
+        _page_split_paragraphs = 4,
+    };
+
+    struct _corpusFileHeader
+    {
+        char magic[8];
+        uint32_t version;
+        uint32_t bom;
+        uint32_t charSize;
+        uint32_t reserved;
+        uint64_t documentHash;
+        uint64_t pageCount;
+        uint64_t itemCount;
+        uint64_t textLength;    // In characters.
+        uint64_t checksum;
+    };
+
+    struct _corpusFilePage
+    {
+        uint64_t firstItem;
+        uint32_t itemCount;
+        uint32_t flags;
+        uint64_t textOffset;    // In characters, item offsets are relative to this.
+        uint64_t textLength;
+        uint64_t sourceHash;    // Zero if not known.
+    };
+
+    struct _corpusFileItem
+    {
+        uint64_t offset;
+        uint32_t length;
+        uint32_t type;
+    };
+
+    static_assert(sizeof(_corpusFileHeader) == 64, "unexpected header layout");
+    static_assert(sizeof(_corpusFilePage) == 40, "unexpected page layout");
+    static_assert(sizeof(_corpusFileItem) == 16, "unexpected item layout");
+}
+
+namespace fsl::text
+{
+    // Writes the given pages to a corpus file. The file is written next to its destination and then renamed so
+    // that a reader never sees a partial file. sourceHashes, if given, holds a hash of the source of each page.
+    // Throws if a page has more than 2^32 - 1 items or an item more than 2^32 - 1 characters.
+    inline void saveCorpusFile(const std::filesystem::path& file, const std::vector<textCorpus>& pages, uint64_t documentHash, const std::vector<uint64_t>* sourceHashes = nullptr)
+    {
+        using namespace fsl::_private;
+
+        std::vector<_corpusFilePage> pageTable(pages.size());
+        std::vector<_corpusFileItem> items;
+        std::wstring text;
+        for (size_t p = 0; p < pages.size(); ++p)
+        {
+            const textCorpus& tc = pages[p];
+            auto& entry = pageTable[p];
+            // Item counts and lengths are stored in 32 bits.
+            if (tc.size() > UINT32_MAX) throw std::runtime_error("A page has too many items for a corpus file.");
+            entry.firstItem = items.size();
+            entry.itemCount = static_cast<uint32_t>(tc.size());
+            entry.flags = (tc.empty() ? 0u : static_cast<uint32_t>(_page_present)) | (tc.splitSentences() ? static_cast<uint32_t>(_page_split_sentences) : 0u) | (tc.splitParagraphs() ? static_cast<uint32_t>(_page_split_paragraphs) : 0u);
+            entry.textOffset = text.size();
+            for (size_t i = 0; i < tc.size(); ++i)
+            {
+                auto view = tc.text(i);
+                if (view.size() > UINT32_MAX) throw std::runtime_error("An item is too long for a corpus file.");
+                items.push_back({ text.size() - entry.textOffset, static_cast<uint32_t>(view.size()), static_cast<uint32_t>(tc.type(i)) });
+                text.append(view);
+            }
+            entry.textLength = text.size() - entry.textOffset;
+            entry.sourceHash = (sourceHashes && (p < sourceHashes->size())) ? (*sourceHashes)[p] : 0;
+        }
+        // Pad the text to a multiple of 8 bytes.
+        while ((text.size() * sizeof(wchar_t)) % 8) text.push_back(0);
+
+        _corpusFileHeader header;
+        std::memset(&header, 0, sizeof(header));
+        std::memcpy(header.magic, _corpus_file_magic, sizeof(header.magic));
+        header.version = _corpus_file_version;
+        header.bom = _corpus_file_bom;
+        header.charSize = sizeof(wchar_t);
+        header.documentHash = documentHash;
+        header.pageCount = pageTable.size();
+        header.itemCount = items.size();
+        header.textLength = text.size();
+        header.checksum = _fnv1a(pageTable.data(), pageTable.size() * sizeof(_corpusFilePage));
+        header.checksum = _fnv1a(items.data(), items.size() * sizeof(_corpusFileItem), header.checksum);
+        header.checksum = _fnv1a(text.data(), text.size() * sizeof(wchar_t), header.checksum);
+
+        auto temp = file;
+        temp += ".tmp";
+        {
+            std::ofstream out(temp, std::ios::binary | std::ios::trunc);
+            if (!out) throw std::runtime_error("The corpus file could not be created.");
+            out.write(reinterpret_cast<const char*>(&header), sizeof(header));
+            out.write(reinterpret_cast<const char*>(pageTable.data()), pageTable.size() * sizeof(_corpusFilePage));
+            out.write(reinterpret_cast<const char*>(items.data()), items.size() * sizeof(_corpusFileItem));
+            out.write(reinterpret_cast<const char*>(text.data()), text.size() * sizeof(wchar_t));
+            if (!out) throw std::runtime_error("The corpus file could not be written.");
+        }
+        std::filesystem::rename(temp, file);
+    }
+
+    // Loads a corpus file written by saveCorpusFile() whatever document it was written for. pages is resized to
+    // the number of pages in the file and each page is loaded into the corpus already there, keeping its memory
+    // resource and storage mode. The text of a page in compact mode is served straight from the memory mapped
+    // file, which stays open for as long as any of the pages refer to it; the text of any other page is copied
+    // into its items. On success documentHash and sourceHashes receive the hashes the file was written with.
+    // Returns false, leaving the outputs untouched, if the file does not exist or cannot be mapped, was written
+    // for a different platform, or is damaged. The layout of the file is always checked, with verify set the
+    // checksum of the whole file is checked too, which reads every byte of it.
+    inline bool loadCorpusFile(const std::filesystem::path& file, std::vector<textCorpus>& pages, uint64_t& documentHash, std::vector<uint64_t>& sourceHashes, bool verify = false)
+    {
+        using namespace fsl::_private;
+
+        if (!std::filesystem::exists(file)) return false;
+        std::shared_ptr<_fileMapping> mapping;
+        try
+        {
+            mapping = std::make_shared<_fileMapping>(file);
+        }
+        catch (const std::runtime_error&)
+        {
+            return false;
+        }
+        const uint8_t* base = mapping->data();
+        size_t size = mapping->size();
+
+        if (size < sizeof(_corpusFileHeader)) return false;
+        auto header = reinterpret_cast<const _corpusFileHeader*>(base);
+        if (std::memcmp(header->magic, _corpus_file_magic, sizeof(header->magic)) != 0) return false;
+        if ((header->version != _corpus_file_version) || (header->bom != _corpus_file_bom) || (header->charSize != sizeof(wchar_t))) return false;
+
+        uint64_t body = size - sizeof(_corpusFileHeader);
+        if ((header->pageCount > body / sizeof(_corpusFilePage)) || (header->itemCount > body / sizeof(_corpusFileItem))) return false;
+        uint64_t expected = header->pageCount * sizeof(_corpusFilePage) + header->itemCount * sizeof(_corpusFileItem);
+        if ((expected > body) || (header->textLength != (body - expected) / sizeof(wchar_t))) return false;
+
+        auto pageTable = reinterpret_cast<const _corpusFilePage*>(base + sizeof(_corpusFileHeader));
+        auto items = reinterpret_cast<const _corpusFileItem*>(pageTable + header->pageCount);
+        auto text = reinterpret_cast<const wchar_t*>(items + header->itemCount);
+        if (verify && (_fnv1a(pageTable, body) != header->checksum)) return false;
+
+        // Every page is checked before any is loaded so that a damaged file changes nothing.
+        for (size_t p = 0; p < header->pageCount; ++p)
+        {
+            const auto& entry = pageTable[p];
+            if ((entry.firstItem > header->itemCount) || (entry.itemCount > header->itemCount - entry.firstItem)) return false;
+            if ((entry.textOffset > header->textLength) || (entry.textLength > header->textLength - entry.textOffset)) return false;
+            if (!(entry.flags & _page_present)) continue;
+            for (size_t i = entry.firstItem; i < entry.firstItem + entry.itemCount; ++i)
+            {
+                if ((items[i].offset > entry.textLength) || (items[i].length > entry.textLength - items[i].offset)) return false;
+                if (items[i].type > static_cast<uint32_t>(textCorpusItem::itemType::listItem)) return false;
+            }
+        }
+
+        std::vector<uint64_t> hashes(header->pageCount);
+        pages.resize(header->pageCount);
+        for (size_t p = 0; p < header->pageCount; ++p)
+        {
+            const auto& entry = pageTable[p];
+            textCorpus& tc = pages[p];
+            hashes[p] = entry.sourceHash;
+            bool compact = tc.compactStorage();
+            tc.clear();
+            tc.setSplitSentences(entry.flags & _page_split_sentences);
+            tc.setSplitParagraphs(entry.flags & _page_split_paragraphs);
+            if (!(entry.flags & _page_present)) continue;
+
+            std::pmr::vector<textCorpus::itemRecord> records(tc.resource());
+            records.reserve(entry.itemCount);
+            for (size_t i = entry.firstItem; i < entry.firstItem + entry.itemCount; ++i)
+            {
+                records.push_back({ static_cast<size_t>(items[i].offset), items[i].length, static_cast<textCorpusItem::itemType>(items[i].type) });
+            }
+            tc.attach(mapping, std::wstring_view(text + entry.textOffset, entry.textLength), std::move(records));
+            if (!compact) tc.setCompactStorage(false);
+        }
+
+        sourceHashes = std::move(hashes);
+        documentHash = header->documentHash;
+        return true;
+    }
+
+    // Loads a corpus file written by saveCorpusFile() for the document with the given hash, as the overload
+    // above does. Returns false, leaving pages untouched, if the file was written for a different document or
+    // cannot be loaded.
+    inline bool loadCorpusFile(const std::filesystem::path& file, uint64_t documentHash, std::vector<textCorpus>& pages, bool verify = false)
+    {
+        std::vector<textCorpus> loaded;
+        loaded.reserve(pages.size());
+        for (const auto& tc : pages)
+        {
+            loaded.emplace_back(tc.resource());
+            loaded.back().setCompactStorage(tc.compactStorage());
+        }
+        std::vector<uint64_t> sourceHashes;
+        uint64_t hash = 0;
+        if (!loadCorpusFile(file, loaded, hash, sourceHashes, verify) || (hash != documentHash)) return false;
+        pages = std::move(loaded);
+
+        return true;
+    }
+}
+
+#endif // _CORPUS_FILE_HPP_
@@ -22,6 +22,9 @@ along with this program.  If not, see <http://www.gnu.org/licenses/>.
 
 #include <string>
 #include <vector>
+#include <memory>
+#include <memory_resource>
+#include <algorithm>
 #include <filesystem>
 #include <poppler/cpp/poppler-document.h>
 #include <poppler/cpp/poppler-page.h>
@@ -31,47 +34,27 @@ along with this program.  If not, see <http://www.gnu.org/licenses/>.
 #include <cmath>
 #include <sstream>
 #include <cstring>
+#include <mutex>
 #include <podofo/podofo.h>
 
 #include "imageUtils.hpp"
 #include "textCorpus.hpp"
+#include "corpusFile.hpp"
+#include "corpusExport.hpp"
+#include "textIndex.hpp"
+#include "boilerplate.hpp"
+#include "pdfTextExtractor.hpp"
+#include "pdfDocument.hpp"
+#include "pagePrefetcher.hpp"
+#include "asyncOperation.hpp"
+#include "odtReader.hpp"
+#include "docxReader.hpp"
+#include "textFile.hpp"
 
 using namespace fsl::_private;
 
-#ifdef _MSC_VER
-//#include <windows.h>
-//#include <atlbase.h>
-//#include <comdef.h>
-//#include <comutil.h>
-//#include <strsafe.h>
-#ifdef DEBUG
-#pragma comment(lib, "libpng16d.lib")
-#pragma comment(lib, "jpegd.lib")
-#pragma comment(lib, "tiffd.lib")
-#pragma comment(lib, "tiffxxd.lib")
-#pragma comment(lib, "poppler.lib")
-#pragma comment(lib, "poppler-cpp.lib")
-#pragma comment(lib, "podofo.lib")
-#else
-#pragma comment(lib, "libpng16.lib")
-#pragma comment(lib, "jpeg62.lib")
-#pragma comment(lib, "tiff.lib")
-#pragma comment(lib, "tiffxx.lib")
-#pragma comment(lib, "poppler.lib")
-#pragma comment(lib, "poppler-cpp.lib")
-#pragma comment(lib, "podofo.lib")
-#endif
-#endif
-
 namespace fsl::text
 {
-	enum class imageFormat
-	{
-		png,
-		tiff,
-		jpeg,
-	};
-
 	enum class _documentType
 	{
 		_none,
@@ -82,19 +65,78 @@ namespace fsl::text
 		_text
 	};
 
+	// Works on one page of a document at a time through a cursor and is not thread safe. See pdfDocument for a
+	// document that can be shared between threads.
 	class documentFractionator
 	{
 	private:
 		poppler::document* _pdfDoc;
 		PoDoFo::PdfMemDocument _pdf;
+		_pdfTextExtractor _extractor{ _pdf };
 		std::vector<uint8_t> _data;
 		std::vector<textCorpus> _text;
+		std::unique_ptr<_textFile> _plainText;	// A text file, decoded a page at a time.
+		std::vector<bool> _plainTextParsed;		// Per page of a text file, a page of white space parses to nothing.
+		std::pmr::memory_resource* _resource;	// Of the text of the pages, see setMemoryResource().
 		bool _valid;
 		unsigned int _dpiX;
 		unsigned int _dpiY;
 		unsigned int _numberOfPages;
 		unsigned int _currentPage;
 		_documentType _docType;
+		textBackend _backend;
+		std::filesystem::path _path;
+		uint64_t _contentHash;
+		std::vector<uint64_t> _sourceHashes;	// Per page, zero until computed.
+		textIndex* _index;
+
+		// Prefetching, see setPrefetch().
+		static constexpr unsigned int _sequentialTurnsToPrefetch = 2;
+		unsigned int _prefetchPages;
+		size_t _prefetchMemoryCap;
+		unsigned int _sequentialTurns;
+		_prefetchRequest _lastAccess;		// The last render and text calls, repeated for the pages ahead.
+		std::string _ownerPassword;
+		std::string _userPassword;
+		std::mutex _podofoMutex;			// Guards _pdf and _extractor against the prefetch thread.
+		std::unique_ptr<poppler::document> _prefetchDoc;	// Only used on the prefetch thread.
+		std::unique_ptr<_pagePrefetcher> _prefetcher;
+
+		cancellationToken _cancel;		// Of the asynchronous operation running, checked part way through a page.
+
+		// Makes an asynchronous operation's token visible to the work it runs.
+		class _cancelScope
+		{
+		private:
+			documentFractionator& _owner;
+		public:
+			_cancelScope(documentFractionator& owner, const cancellationToken& token) : _owner(owner)
+			{
+				_owner._cancel = token;
+			}
+
+			~_cancelScope()
+			{
+				_owner._cancel = cancellationToken();
+			}
+		};
+
+		void _indexPages()
+		{
+			if (!_index) return;
+			for (unsigned int p = 0; p < _text.size(); ++p)
+			{
+				if (!_text[p].empty()) _index->addPage(p + 1, _text[p]);
+			}
+		}
+
+		// An empty corpus per page, allocating from _resource.
+		void _resetText()
+		{
+			_text.clear();
+			_text.reserve(_numberOfPages);
+			for (unsigned int p = 0; p < _numberOfPages; ++p) _text.emplace_back(_resource);
+		}
 	public:
 		documentFractionator() = delete;
 
@@ -107,11 +149,18 @@ namespace fsl::text
 			_dpiY = dpiY;
 			_currentPage = 1;
 			_docType = _documentType::_none;
+			_backend = textBackend::podofo;
+			_contentHash = 0;
+			_index = nullptr;
+			_resource = std::pmr::get_default_resource();
+			_prefetchPages = 0;
+			_prefetchMemoryCap = 0;
+			_sequentialTurns = 0;
 		}
 
 		~documentFractionator()
 		{
-
+			_stopPrefetch();
 		}
 
 		[[nodiscard]] bool valid() const
@@ -119,6 +168,11 @@ namespace fsl::text
 			return _valid;
 		}
 
+		[[nodiscard]] textBackend backend() const
+		{
+			return _backend;
+		}
+
 		[[nodiscard]] int numberOfPages() const
 		{
 			return _numberOfPages;
@@ -132,7 +186,36 @@ namespace fsl::text
 		void setCurrentPage(unsigned int newPage)
 		{
 			if ((newPage == 0) || (newPage > _numberOfPages)) throw std::invalid_argument("newPage out of range.");
+			unsigned int previous = _currentPage;
 			_currentPage = newPage;
+			if (_prefetchPages > 0) _prefetchAfterTurn(previous);
+		}
+
+		// Opts in to prefetching. Once the reader has moved forward one page at a time with setCurrentPage()
+		// twice in a row, the next pages are rendered and extracted on a background thread, repeating the last
+		// renderPage() or renderPageFitted() call and the last getText() call, and are served from there when
+		// asked for. Prefetching stops as soon as the reader moves anywhere else, and holds back once about
+		// memoryCap bytes of images and text are waiting. Zero pages turns prefetching off.
+		void setPrefetch(unsigned int pages, size_t memoryCap = 256 * 1024 * 1024)
+		{
+			if (pages == 0) _stopPrefetch();
+			else _prefetcher.reset();
+			_prefetchPages = pages;
+			_prefetchMemoryCap = memoryCap;
+		}
+
+		// The memory resource the text of the pages is allocated from by the next load, e.g. a monotonic arena
+		// released in one go once the document is closed. The resource must outlive the text and is only used
+		// on the calling thread; pages prefetched in the background are copied into it when they are taken.
+		void setMemoryResource(std::pmr::memory_resource* resource)
+		{
+			if (!resource) throw std::invalid_argument("resource is null.");
+			_resource = resource;
+		}
+
+		[[nodiscard]] std::pmr::memory_resource* memoryResource() const
+		{
+			return _resource;
 		}
 
 		explicit operator bool() const
@@ -140,10 +223,14 @@ namespace fsl::text
 			return _valid;
 		}
 
-		void loadPdfFile(const std::filesystem::path& pdfFile, const std::string& owner_password = std::string(), const std::string& user_password = std::string())
+		// With the poppler text backend the document is not loaded into PoDoFo at all.
+		void loadPdfFile(const std::filesystem::path& pdfFile, const std::string& owner_password = std::string(), const std::string& user_password = std::string(), textBackend backend = textBackend::podofo)
 		{
 			if (!std::filesystem::exists(pdfFile)) throw std::runtime_error("pdfFile does not exist.");
 
+			FSL_INSTRUMENT_PAGE(this, 0);
+			FSL_INSTRUMENT_PHASE(load);
+			_stopPrefetch();
 			_valid = false;
 			_numberOfPages = 0;
 
@@ -158,74 +245,281 @@ namespace fsl::text
 				throw std::runtime_error("The given PDF file could not be opened, it may be damaged or invalid.");
 			}
 
-			if (!owner_password.empty()) _pdf.SetPassword(owner_password);
-			if (!user_password.empty()) _pdf.SetPassword(user_password);
-			_pdf.Load(pdfFile.wstring().c_str());
+			_backend = backend;
+			_extractor.clear();
+			_plainText.reset();
+			if (_backend == textBackend::podofo)
+			{
+				if (!owner_password.empty()) _pdf.SetPassword(owner_password);
+				if (!user_password.empty()) _pdf.SetPassword(user_password);
+				_pdf.Load(pdfFile.wstring().c_str());
+			}
 
 			_valid = true;
 			_docType = _documentType::_pdf;
-			_text.clear();
-			_text.resize(_numberOfPages);
+			_path = pdfFile;
+			_ownerPassword = owner_password;
+			_userPassword = user_password;
+			_contentHash = 0;
+			_sourceHashes.assign(_numberOfPages, 0);
+			_resetText();
+		}
+
+		// A hash of the bytes of the loaded file, computed on first use.
+		[[nodiscard]] uint64_t contentHash()
+		{
+			if (!_valid) throw std::runtime_error("Invalid object state!");
+			if (_contentHash == 0)
+			{
+				fsl::_private::_fileMapping mapping(_path);
+				_contentHash = fsl::_private::_fnv1a(mapping.data(), mapping.size());
+			}
+
+			return _contentHash;
+		}
+
+		// Pages are added to the given index as their text is extracted or loaded from a text cache. The index is
+		// not owned and must outlive this object, or be reset with nullptr. Page numbers in the index are 1 based.
+		void setTextIndex(textIndex* index)
+		{
+			_index = index;
+			_indexPages();
+		}
+
+		// Writes the text extracted so far to a corpus file in the given directory. The file is named after the
+		// permanent identifier of the PDF, which survives incremental updates, or contentHash() if it has none.
+		// With the PoDoFo text backend a hash of the source of each page is stored with its text.
+		void saveTextCache(const std::filesystem::path& directory)
+		{
+			for (unsigned int p = 0; p < _text.size(); ++p)
+			{
+				if (!_text[p].empty()) _sourceHash(p + 1);
+			}
+			saveCorpusFile(_textCacheFile(directory), _text, contentHash(), &_sourceHashes);
+		}
+
+		// Populates the text of the pages from a corpus file in the given directory written by saveTextCache().
+		// The text is copied out of the memory mapped file into the pages, allocating from the memory resource
+		// they were created with, see setMemoryResource(). If the file has changed since, e.g. by an incremental
+		// update, only the pages whose content streams and resources hash the same are taken from the cache,
+		// which needs the PoDoFo text backend. Pages not taken are extracted as usual. Returns false if no pages
+		// were taken. With verify set the checksum of the whole cache file is checked, see loadCorpusFile().
+		bool loadTextCache(const std::filesystem::path& directory, bool verify = false)
+		{
+			// Loaded into corpora on the same resource as the pages, so that moving them into place moves their
+			// storage too.
+			std::vector<textCorpus> pages;
+			pages.reserve(_text.size());
+			for (const auto& tc : _text) pages.emplace_back(tc.resource());
+			std::vector<uint64_t> hashes;
+			uint64_t documentHash = 0;
+			if (!loadCorpusFile(_textCacheFile(directory), pages, documentHash, hashes, verify)) return false;
+
+			if (documentHash == contentHash())
+			{
+				if (pages.size() != _numberOfPages) return false;
+				for (unsigned int p = 0; p < _numberOfPages; ++p) _text[p] = std::move(pages[p]);
+				_sourceHashes = std::move(hashes);
+				_indexPages();
+
+				return true;
+			}
+
+			if ((_docType != _documentType::_pdf) || (_backend != textBackend::podofo)) return false;
+			size_t reused = 0;
+			for (unsigned int p = 0; p < std::min<size_t>(pages.size(), _numberOfPages); ++p)
+			{
+				if (!_text[p].empty() || pages[p].empty() || (hashes[p] == 0)) continue;
+				if (hashes[p] != _sourceHash(p + 1)) continue;
+				_text[p] = std::move(pages[p]);
+				++reused;
+			}
+			_indexPages();
+
+			return reused > 0;
+		}
+
+		// Writes the text of every page to a UTF-8 file as JSON Lines or plain text, see corpusExporter. Pages
+		// not extracted yet are extracted with the given split options, one at a time into a corpus that is
+		// reused for the next page, and are not kept: only the pages getText() was called for stay in memory.
+		// The current page and prefetching are left as they were.
+		void exportText(const std::filesystem::path& file, exportFormat format, bool splitSentences = true, bool splitParagraphs = true)
+		{
+			if (!_valid) throw std::runtime_error("Invalid object state!");
+
+			corpusExporter exporter(file, format);
+			textCorpus scratch(_resource);
+			for (unsigned int p = 1; p <= _numberOfPages; ++p)
+			{
+				const textCorpus& cached = _text[p - 1];
+				bool parsed = !cached.empty() || (_docType == _documentType::_odt) || (_docType == _documentType::_docx) || ((_docType == _documentType::_text) && _plainTextParsed[p - 1]);
+				if (parsed)
+				{
+					exporter.write(p, cached);
+					continue;
+				}
+				FSL_INSTRUMENT_PAGE(this, p);
+				if (_docType == _documentType::_pdf) _extractPdfText(p, scratch, splitSentences, splitParagraphs);
+				else _extractPlainText(p, scratch, splitSentences, splitParagraphs);
+				exporter.write(p, scratch);
+			}
+			exporter.close();
+		}
+
+		// Finds running headers, footers and other boilerplate in the pages extracted so far, see
+		// fsl::text::findBoilerplate(). The page of each item is a page number, as used by setCurrentPage().
+		[[nodiscard]] std::vector<boilerplateItem> findBoilerplate(double minFraction = 0.4, size_t edgeItems = 3) const
+		{
+			auto found = fsl::text::findBoilerplate(_text, minFraction, edgeItems);
+			for (auto& b : found) ++b.page;
+
+			return found;
+		}
+
+		// Removes running headers, footers and other boilerplate from the pages extracted so far. An attached
+		// text index is rebuilt as the item numbers change. Returns the number of items removed.
+		size_t removeBoilerplate(double minFraction = 0.4, size_t edgeItems = 3)
+		{
+			size_t removed = fsl::text::removeBoilerplate(_text, minFraction, edgeItems);
+			if (removed && _index)
+			{
+				_index->clear();
+				_indexPages();
+			}
+
+			return removed;
 		}
 
-		void loadWordFile(const std::filesystem::path& wordFile, const std::string& documentPassword = std::string(), const std::string& templatePassword = std::string(), const std::string& documentWritePassword = std::string(), const std::string& templateWritePassword = std::string())
+		// Reads a DOCX file. The pages are split where the document breaks the page and where the producer last
+		// laid it out, see _readDocxBody(). The text of every page is built with the given split options as the
+		// document is read, getText() returns it whatever options it is called with. Encrypted and Word 97-2003
+		// files are not supported, the passwords are kept for when they are.
+		void loadWordFile(const std::filesystem::path& wordFile, const std::string& documentPassword = std::string(), const std::string& templatePassword = std::string(), const std::string& documentWritePassword = std::string(), const std::string& templateWritePassword = std::string(), bool splitSentences = true, bool splitParagraphs = true)
 		{
 			if (!std::filesystem::exists(wordFile)) throw std::runtime_error("wordFile does not exist.");
 
+			FSL_INSTRUMENT_PAGE(this, 0);
+			FSL_INSTRUMENT_PHASE(load);
+			_stopPrefetch();
 			_valid = false;
 			_numberOfPages = 0;
-
+			delete _pdfDoc;
+			_pdfDoc = nullptr;
+			_plainText.reset();
+			_text.clear();
+			_structuredDocument document(_resource, splitSentences, splitParagraphs);
+			_readDocx(wordFile, document);
+			_text = document.release();
+			_numberOfPages = static_cast<unsigned int>(_text.size());
+			_currentPage = 1;
 
 			_valid = true;
-			_docType = _documentType::_pdf;
-			_text.clear();
-			_text.resize(_numberOfPages);
+			_docType = _documentType::_docx;
+			_path = wordFile;
+			_contentHash = 0;
+			_sourceHashes.assign(_numberOfPages, 0);
+			_indexPages();
 		}
 
-		void loadOdtFile(const std::filesystem::path& odtFile, const std::string& documentPassword = std::string())
+		// The pages are those the producer recorded when it last laid the document out, see _readOdtBody(). The
+		// headings, paragraphs and list items are read as content.xml is inflated and go straight into the text
+		// of their page, built with the given split options; getText() returns it whatever options it is called
+		// with. Encrypted files are not supported, documentPassword is kept for when they are.
+		void loadOdtFile(const std::filesystem::path& odtFile, const std::string& documentPassword = std::string(), bool splitSentences = true, bool splitParagraphs = true)
 		{
 			if (!std::filesystem::exists(odtFile)) throw std::runtime_error("odtFile does not exist.");
 
+			FSL_INSTRUMENT_PAGE(this, 0);
+			FSL_INSTRUMENT_PHASE(load);
+			_stopPrefetch();
 			_valid = false;
 			_numberOfPages = 0;
+			delete _pdfDoc;
+			_pdfDoc = nullptr;
+			_plainText.reset();
+			_text.clear();
+			_structuredDocument document(_resource, splitSentences, splitParagraphs);
+			_readOdt(odtFile, document);
+			_text = document.release();
+			_numberOfPages = static_cast<unsigned int>(_text.size());
+			_currentPage = 1;
+
+			_valid = true;
+			_docType = _documentType::_odt;
+			_path = odtFile;
+			_contentHash = 0;
+			_sourceHashes.assign(_numberOfPages, 0);
+			_indexPages();
+		}
+
+		// Reads a UTF-8 or UTF-16 text file as pages of about pageSize bytes that end at a paragraph break where
+		// there is one near enough, see _textFile. The file is mapped rather than read, so loading takes the same
+		// time whatever its size, and the text of a page is only decoded and parsed when it is asked for.
+		void loadTextFile(const std::filesystem::path& textFile, size_t pageSize = 64 * 1024)
+		{
+			if (!std::filesystem::exists(textFile)) throw std::runtime_error("textFile does not exist.");
 
+			FSL_INSTRUMENT_PAGE(this, 0);
+			FSL_INSTRUMENT_PHASE(load);
+			_stopPrefetch();
+			_valid = false;
+			_numberOfPages = 0;
+			delete _pdfDoc;
+			_pdfDoc = nullptr;
+			_plainText = std::make_unique<_textFile>(textFile, pageSize);
+			_numberOfPages = _plainText->pages();
+			_plainTextParsed.assign(_numberOfPages, false);
+			_currentPage = 1;
 
 			_valid = true;
-			_docType = _documentType::_pdf;
-			_text.clear();
-			_text.resize(_numberOfPages);
+			_docType = _documentType::_text;
+			_path = textFile;
+			_contentHash = 0;
+			_sourceHashes.assign(_numberOfPages, 0);
+			_resetText();
 		}
 
 		const textCorpus& getText(bool splitSentences = true, bool splitParagraphs = true)
 		{
 			if ((_currentPage == 0) || (_currentPage > _numberOfPages)) throw std::invalid_argument("page out of range.");
 
+			FSL_INSTRUMENT_PAGE(this, _currentPage);
+			_lastAccess.text = true;
+			_lastAccess.splitSentences = splitSentences;
+			_lastAccess.splitParagraphs = splitParagraphs;
 			if (_valid && (_docType == _documentType::_pdf)) return _getPdfText(splitSentences, splitParagraphs);
+			if (_valid && ((_docType == _documentType::_odt) || (_docType == _documentType::_docx))) return _text[_currentPage - 1];
+			if (_valid && (_docType == _documentType::_text)) return _getPlainText(splitSentences, splitParagraphs);
 
 			throw std::runtime_error("Invalid object state!");
 		}
 
 	private:
-		std::wstring _adjustTextCursor(double old_tx, double old_ty, double tx, double ty, double tr, double sw)
+		std::filesystem::path _textCacheFile(const std::filesystem::path& directory)
 		{
-			std::wstringstream wss;
-			// If the old coordinates are zero we have just entered the document and there is nothing to compare with.
+			std::string permanentId;
+			uint64_t key = 0;
+			if (_pdfDoc && _pdfDoc->get_pdf_id(&permanentId, nullptr) && !permanentId.empty()) key = _fnv1a(permanentId.data(), permanentId.size());
+			else key = contentHash();
+
+			char name[32];
+			std::snprintf(name, sizeof(name), "%016llx.fsltc", static_cast<unsigned long long>(key));
+			return directory / name;
+		}
 
-			// Check if a space is required.
-			if ((old_tx != 0) && (sw > 0))
-			{
-				auto diff = fabs(old_tx - tx);
-				if (diff >= sw) wss << L' ';
-			}
-			
-			// See if a newline is required.
-			if ((old_ty != 0) && (tr == 0))
+		// The hash of the source of a page, computed on first use. Zero if it cannot be computed with the current
+		// text backend.
+		uint64_t _sourceHash(unsigned int page)
+		{
+			if ((_docType != _documentType::_pdf) || (_backend != textBackend::podofo) || (page == 0) || (page > _sourceHashes.size())) return 0;
+			uint64_t& hash = _sourceHashes[page - 1];
+			if (hash == 0)
 			{
-				auto diff = fabs(old_ty - ty);
-				if (diff > 5.00) wss << L'\n';
+				std::lock_guard<std::mutex> lock(_podofoMutex);
+				hash = _extractor.sourceHash(_pdf.GetPage(page - 1));
 			}
 
-			return wss.str();
+			return hash;
 		}
 
 		const textCorpus& _getPdfText(bool splitSentences, bool splitParagraphs)
@@ -233,193 +527,163 @@ namespace fsl::text
 			textCorpus& tcref = _text[_currentPage - 1];
 			if (!tcref.empty()) return tcref;
 
-			tcref.setSplitSentences(splitSentences);
-			tcref.setSplitParagraphs(splitParagraphs);
-			std::wstring rawstring;
-			std::stack<PoDoFo::PdfVariant> stack;
-			PoDoFo::PdfFont* pCurFont = nullptr;
-			double old_tx = 0;
-			double old_ty = 0;
-			double tx = 0;
-			double ty = 0;
-			double textRise = 0;
-			double spaceWidth = 0;
-
-			PoDoFo::PdfPage* page = _pdf.GetPage(_currentPage - 1);
-			PoDoFo::PdfContentsTokenizer tok(page);
-			const char* token = nullptr;
-			PoDoFo::PdfVariant var;
-			PoDoFo::EPdfContentsType type;
-			bool inTextObject = false;
-			while (tok.ReadNext(type, token, var))
+			if (_prefetcher && _prefetcher->takeText(_currentPage, splitSentences, splitParagraphs, tcref))
 			{
-				// BT*, ET*, Td*, TD*, Ts, T, Tm*, Tf*, ", ', Tj and TJ
-				switch (type)
+				if (_index) _index->addPage(_currentPage, tcref);
+				return tcref;
+			}
+
+			_extractPdfText(_currentPage, tcref, splitSentences, splitParagraphs);
+			if (_index) _index->addPage(_currentPage, tcref);
+
+			return tcref;
+		}
+
+		// Extracts the text of a page, numbered from one, into tc.
+		void _extractPdfText(unsigned int page, textCorpus& tc, bool splitSentences, bool splitParagraphs)
+		{
+			_buildPageText(tc, splitSentences, splitParagraphs, [&](const _pdfTextExtractor::sink& out)
 				{
-				case PoDoFo::ePdfContentsType_Keyword:
-					std::cout << token << "\n";
-					if (!token) throw std::runtime_error("Error parsing PDF file!"); // Should not happen, but always check.
-					if (std::strcmp(token, "BT") == 0) inTextObject = true;
-					if (std::strcmp(token, "ET") == 0) inTextObject = false;
-					if (std::strcmp(token, "Tc") == 0)
-					{
-						if (!inTextObject || (stack.size() != 1)) throw std::runtime_error("Error parsing PDF file!");
-					}
-					if (std::strcmp(token, "Tw") == 0)
+					_pdfTextExtractor::sink checked = [&](const std::wstring& text, const textLayout::box* box)
 					{
-						if (!inTextObject || (stack.size() != 1)) throw std::runtime_error("Error parsing PDF file!");
-					}
-					if (std::strcmp(token, "Ts") == 0)
-					{
-						// Changes the text rise should not trigger a newline.
-						if (!inTextObject || (stack.size() != 1)) throw std::runtime_error("Error parsing PDF file!");
-						textRise = stack.top().GetReal();
-					}
-					if (std::strcmp(token, "Tf") == 0)
-					{
-						if (!inTextObject) throw std::runtime_error("Error parsing PDF file!");
-						stack.pop();
-						PoDoFo::PdfName fontName = stack.top().GetName();
-						PoDoFo::PdfObject* pFont = page->GetFromResources(PoDoFo::PdfName("Font"), fontName);
-						pCurFont = _pdf.GetFont(pFont);
-						if (pCurFont)
-						{
-							spaceWidth = pCurFont->GetFontMetrics()->GetWordSpace();
-							if (spaceWidth == 0) spaceWidth = pCurFont->GetFontMetrics()->UnicodeCharWidth(' ');
-							if (spaceWidth == 0) spaceWidth = pCurFont->GetFontMetrics()->UnicodeCharWidth('W'); // Last resort.
-						}
-					}
-					if (std::strcmp(token, "TD") == 0)
+						_cancel.throwIfCancelled();
+						out(text, box);
+					};
+					if (_backend == textBackend::poppler)
 					{
-						if (!inTextObject || (stack.size() != 2)) throw std::runtime_error("Error parsing PDF file!");
-						old_tx = tx;
-						old_ty = ty;
-						ty = stack.top().GetReal();
-						stack.pop();
-						tx = stack.top().GetReal();
-						rawstring.append(_adjustTextCursor(old_tx, old_ty, tx, ty, textRise, spaceWidth));
+						std::unique_ptr<poppler::page> pageRef(_pdfDoc->create_page(page - 1));
+						if (!pageRef) throw std::runtime_error("Error parsing PDF file!");
+						_popplerPageText(*pageRef, checked);
 					}
-					if (std::strcmp(token, "Tm") == 0)
-					{
-						if (!inTextObject || (stack.size() != 6)) throw std::runtime_error("Error parsing PDF file!");
-						old_tx = tx;
-						old_ty = ty;
-						ty = stack.top().GetReal();
-						stack.pop();
-						tx = stack.top().GetReal();
-						rawstring.append(_adjustTextCursor(old_tx, old_ty, tx, ty, textRise, spaceWidth));
-					}
-					if (std::strcmp(token, "Td") == 0)
-					{
-						if (!inTextObject || (stack.size() != 2)) throw std::runtime_error("Error parsing PDF file!");
-						old_tx = tx;
-						old_ty = ty;
-						ty = stack.top().GetReal();
-						stack.pop();
-						tx = stack.top().GetReal();
-						rawstring.append(_adjustTextCursor(old_tx, old_ty, tx, ty, textRise, spaceWidth));
-					}
-					if (std::strcmp(token, "T*") == 0)
+					else
 					{
-						if (!inTextObject) throw std::runtime_error("Error parsing PDF file!");
-						rawstring.push_back('\n');
+						std::lock_guard<std::mutex> lock(_podofoMutex);
+						_extractor.extractPage(_pdf.GetPage(page - 1), checked);
 					}
+				});
+		}
 
-					if (std::strcmp(token, "'") == 0)
-					{
-						if (!inTextObject) throw std::runtime_error("Error parsing PDF file!");
-						rawstring.push_back('\n');
-						if (!stack.top().IsString()) throw std::runtime_error("Error parsing PDF file!");
-						if (pCurFont)
-						{
-							PoDoFo::PdfString unicode = pCurFont->GetEncoding()->ConvertToUnicode(stack.top().GetString(), pCurFont);
-							rawstring.append(unicode.GetStringW());
-							tx = tx + pCurFont->GetFontMetrics()->StringWidth(unicode);
-						}
-						else
-						{
-							rawstring.append(stack.top().GetString().GetStringW());
-						}
-						//_cwprintf(L"Append: %c x = %f y = %f space = %f\n", rawstring.end(), tx, ty, spaceWidth);
-					}
-					if (std::strcmp(token, "\"") == 0)
+		const textCorpus& _getPlainText(bool splitSentences, bool splitParagraphs)
+		{
+			textCorpus& tcref = _text[_currentPage - 1];
+			if (!tcref.empty() || _plainTextParsed[_currentPage - 1]) return tcref;
+
+			_extractPlainText(_currentPage, tcref, splitSentences, splitParagraphs);
+			_plainTextParsed[_currentPage - 1] = true;
+			if (_index) _index->addPage(_currentPage, tcref);
+
+			return tcref;
+		}
+
+		// Decodes and parses a page of a text file, numbered from one, into tc.
+		void _extractPlainText(unsigned int page, textCorpus& tc, bool splitSentences, bool splitParagraphs)
+		{
+			tc.setSplitSentences(splitSentences);
+			tc.setSplitParagraphs(splitParagraphs);
+			textCorpus::parser parser(tc, false);
+			try
+			{
+				_plainText->read(page, [&](std::wstring_view text)
 					{
-						if (!inTextObject) throw std::runtime_error("Error parsing PDF file!");
-						rawstring.push_back('\n');
-						if (!stack.top().IsString()) throw std::runtime_error("Error parsing PDF file!");
-						auto str = stack.top().GetString().GetStringW();
-						if (pCurFont)
-						{
-							PoDoFo::PdfString unicode = pCurFont->GetEncoding()->ConvertToUnicode(stack.top().GetString(), pCurFont);
-							rawstring.append(unicode.GetStringW());
-							tx = tx + pCurFont->GetFontMetrics()->StringWidth(unicode);
-						}
-						else
-						{
-							rawstring.append(stack.top().GetString().GetStringW());
-						}
-						//_cwprintf(L"Append: %c x = %f y = %f space = %f\n", rawstring.end(), tx, ty, spaceWidth);
-					}
-					if (std::strcmp(token, "Tj") == 0)
+						_cancel.throwIfCancelled();
+						parser.feed(text);
+					});
+				parser.finish();
+			}
+			catch (...)
+			{
+				tc.clear();
+				throw;
+			}
+		}
+
+		// Renders into _data, checking for cancellation between rasterizing and encoding.
+		void _render(const poppler::page& page, double dpi, poppler::image::format_enum pixels, imageFormat format, bool compress)
+		{
+			_cancel.throwIfCancelled();
+			auto raster = _rasterizePopplerPage(page, dpi, pixels);
+			_cancel.throwIfCancelled();
+			_encodePopplerImage(raster, format, compress, _data);
+		}
+
+		void _stopPrefetch()
+		{
+			// Joins the prefetch thread before anything it uses changes.
+			_prefetcher.reset();
+			_prefetchDoc.reset();
+			_sequentialTurns = 0;
+			_lastAccess = _prefetchRequest();
+		}
+
+		void _prefetchAfterTurn(unsigned int previous)
+		{
+			_sequentialTurns = (_currentPage == previous + 1) ? _sequentialTurns + 1 : 0;
+			if (_sequentialTurns < _sequentialTurnsToPrefetch)
+			{
+				// The pattern is broken, keep only what was prepared for the page now current.
+				if (_prefetcher)
+				{
+					_prefetcher->cancel();
+					_prefetcher->discardOutside(_currentPage, _currentPage);
+				}
+				return;
+			}
+			if (!_valid || (_docType != _documentType::_pdf)) return;
+			if (!_lastAccess.render.valid && !_lastAccess.text) return;
+
+			if (!_prefetcher) _prefetcher = std::make_unique<_pagePrefetcher>([this](unsigned int page, const _prefetchRequest& request, std::vector<uint8_t>* image, textCorpus* text) { _prefetchPage(page, request, image, text); }, _prefetchMemoryCap);
+
+			unsigned int last = std::min(_numberOfPages, _currentPage + _prefetchPages);
+			std::vector<unsigned int> pages;
+			for (unsigned int p = _currentPage + 1; p <= last; ++p)
+			{
+				if (!_lastAccess.render.valid && !_text[p - 1].empty()) continue;
+				pages.push_back(p);
+			}
+			_prefetcher->discardOutside(_currentPage, last);
+			_prefetcher->request(pages, _lastAccess);
+		}
+
+		// Runs on the prefetch thread, with its own poppler document. PoDoFo is shared with the caller's thread.
+		void _prefetchPage(unsigned int page, const _prefetchRequest& request, std::vector<uint8_t>* image, textCorpus* text)
+		{
+			FSL_INSTRUMENT_PAGE(this, page);
+			if (!_prefetchDoc)
+			{
+				_prefetchDoc.reset(poppler::document::load_from_file(_path.string(), _ownerPassword, _userPassword));
+				if (!_prefetchDoc) throw std::runtime_error("The given PDF file could not be opened, it may be damaged or invalid.");
+			}
+			std::unique_ptr<poppler::page> pageRef(_prefetchDoc->create_page(page - 1));
+			if (!pageRef) throw std::runtime_error("Error parsing PDF file!");
+
+			if (image)
+			{
+				if (request.render.fitted)
+				{
+					double dpi = _fittedDpi(*pageRef, request.render.viewportWidth, request.render.viewportHeight);
+					if (dpi > 0) _renderPopplerPage(*pageRef, dpi, poppler::image::format_argb32, request.render.format, request.render.compress, *image);
+				}
+				else
+				{
+					_renderPopplerPage(*pageRef, request.render.dpi, poppler::image::format_rgb24, request.render.format, request.render.compress, *image);
+				}
+			}
+
+			if (text)
+			{
+				_buildPageText(*text, request.splitSentences, request.splitParagraphs, [&](const _pdfTextExtractor::sink& out)
 					{
-						if (!inTextObject) throw std::runtime_error("Error parsing PDF file!");
-						if (!stack.top().IsString()) throw std::runtime_error("Error parsing PDF file!");
-						auto str = stack.top().GetString().GetStringW();
-						if (pCurFont)
+						if (_backend == textBackend::poppler)
 						{
-							PoDoFo::PdfString unicode = pCurFont->GetEncoding()->ConvertToUnicode(stack.top().GetString(), pCurFont);
-							rawstring.append(unicode.GetStringW());
-							tx = tx + pCurFont->GetFontMetrics()->StringWidth(unicode);
+							_popplerPageText(*pageRef, out);
 						}
 						else
 						{
-							rawstring.append(stack.top().GetString().GetStringW());
-						}
-						//_cwprintf(L"Append: %c x = %f y = %f space = %f\n", rawstring.end(), tx, ty, spaceWidth);
-					}
-					if (std::strcmp(token, "TJ") == 0)
-					{
-						if (!inTextObject) throw std::runtime_error("Error parsing PDF file!");
-						// Get the array.
-						if (!stack.top().IsArray()) throw std::runtime_error("Error parsing PDF file!");
-						PoDoFo::PdfArray& a = stack.top().GetArray();
-						for (size_t i = 0; i < a.GetSize(); ++i)
-						{
-							if (a[i].IsString() || a[i].IsHexString())
-							{
-								if (pCurFont)
-								{
-									PoDoFo::PdfString unicode = pCurFont->GetEncoding()->ConvertToUnicode(a[i].GetString(), pCurFont);
-									rawstring.append(unicode.GetStringW());
-									tx = tx + pCurFont->GetFontMetrics()->StringWidth(unicode);
-								}
-								else
-								{
-									rawstring.append(stack.top().GetString().GetStringW());
-								}
-							}
-							//_cwprintf(L"Append: %c x = %f y = %f space = %f\n", rawstring.back(), tx, ty, spaceWidth);
+							std::lock_guard<std::mutex> lock(_podofoMutex);
+							_extractor.extractPage(_pdf.GetPage(page - 1), out);
 						}
-					}
-
-					// Make sure the stack has been purged, even if we did not process the command.
-					while (!stack.empty())
-					{
-						stack.pop();
-					}
-					break;
-				case PoDoFo::ePdfContentsType_Variant:
-					stack.push(var);
-					break;
-				default:
-					throw std::runtime_error("Error parsing PDF file!");
-					// Should not happen!
-					break;
-				}
+					});
 			}
-
-			tcref.parseString(rawstring, true);
-			return tcref;
 		}
 
 	public:
@@ -431,31 +695,12 @@ namespace fsl::text
 
 			if (_valid && (_docType == _documentType::_pdf) && _pdfDoc)
 			{
-				auto pageRef = _pdfDoc->create_page(_currentPage - 1);
-				if (pageRef)
-				{
-					poppler::page_renderer pageRenderer;
-					pageRenderer.set_image_format(poppler::image::format_rgb24);
-					pageRenderer.set_render_hint(poppler::page_renderer::render_hint::antialiasing);
-					pageRenderer.set_render_hint(poppler::page_renderer::render_hint::text_antialiasing);
-					pageRenderer.set_render_hint(poppler::page_renderer::render_hint::text_hinting);
-					auto data = pageRenderer.render_page(pageRef, dpi, dpi);
-					if (data.is_valid())
-					{
-						if (format == imageFormat::png)
-						{
-							_make_png(reinterpret_cast<const uint8_t*>(data.const_data()), _data, data.width(), data.height(), compress);
-						}
-						else if (format == imageFormat::tiff)
-						{
-							_make_tiff(reinterpret_cast<const uint8_t*>(data.const_data()), _data, data.width(), data.height(), compress);
-						}
-						else if (format == imageFormat::jpeg)
-						{
-							_make_jpeg(reinterpret_cast<const uint8_t*>(data.const_data()), _data, data.width(), data.height(), compress);
-						}
-					}
-				}
+				FSL_INSTRUMENT_PAGE(this, _currentPage);
+				_lastAccess.render = { true, false, dpi, 0, 0, format, compress };
+				if (_prefetcher && _prefetcher->takeImage(_currentPage, _lastAccess.render, _data)) return _data;
+
+				std::unique_ptr<poppler::page> pageRef(_pdfDoc->create_page(_currentPage - 1));
+				if (pageRef) _render(*pageRef, dpi, poppler::image::format_rgb24, format, compress);
 				return _data;
 			}
 
@@ -469,56 +714,64 @@ namespace fsl::text
 
 			if ((_docType == _documentType::_pdf) && _pdfDoc)
 			{
-				auto pageRef = _pdfDoc->create_page(_currentPage - 1);
+				FSL_INSTRUMENT_PAGE(this, _currentPage);
+				_lastAccess.render = { true, true, 0, viewportWidth, viewportHeight, format, compress };
+				if (_prefetcher && _prefetcher->takeImage(_currentPage, _lastAccess.render, _data)) return _data;
+
+				std::unique_ptr<poppler::page> pageRef(_pdfDoc->create_page(_currentPage - 1));
 				if (pageRef)
 				{
-					poppler::page_renderer pageRenderer;
-					pageRenderer.set_image_format(poppler::image::format_argb32);
-					pageRenderer.set_render_hint(poppler::page_renderer::render_hint::antialiasing);
-					pageRenderer.set_render_hint(poppler::page_renderer::render_hint::text_antialiasing);
-					pageRenderer.set_render_hint(poppler::page_renderer::render_hint::text_hinting);
 					// Fit image to given viewport.
-					auto w = pageRef->page_rect(poppler::page_box_enum::media_box).width();
-					auto h = pageRef->page_rect(poppler::page_box_enum::media_box).height();
-					double widthInches = w / 72.00;
-					double heightInches = h / 72.00;
-					double dpi = 0;
-
-					if (pageRef->orientation() == poppler::page::landscape)
-					{
-						dpi = static_cast<double>(viewportWidth) / widthInches;
-					}
-					else if (pageRef->orientation() == poppler::page::portrait)
-					{
-						dpi = static_cast<double>(viewportHeight) / heightInches;
-					}
-					else
-					{
-						return _data;
-					}
-
-					auto data = pageRenderer.render_page(pageRef, dpi, dpi);
-					if (data.is_valid())
-					{
-						if (format == imageFormat::png)
-						{
-							_make_png(reinterpret_cast<const uint8_t*>(data.const_data()), _data, data.width(), data.height(), compress);
-						}
-						else if (format == imageFormat::tiff)
-						{
-							_make_tiff(reinterpret_cast<const uint8_t*>(data.const_data()), _data, data.width(), data.height(), compress);
-						}
-						else if (format == imageFormat::jpeg)
-						{
-							_make_jpeg(reinterpret_cast<const uint8_t*>(data.const_data()), _data, data.width(), data.height(), compress);
-						}
-					}
+					double dpi = _fittedDpi(*pageRef, viewportWidth, viewportHeight);
+					if (dpi > 0) _render(*pageRef, dpi, poppler::image::format_argb32, format, compress);
 				}
 				return _data;
 			}
 			
 			throw std::runtime_error("Invalid object state!");
 		}
+
+#ifdef FSL_HAS_COROUTINES
+		// Awaitable versions of loadPdfFile(), renderPage(), renderPageFitted() and getText(), which run on the
+		// executor of the context and resume the caller as it says. The object must not be used until the
+		// operation has completed. Cancelling the token of the context throws operationCancelled from the
+		// operation before it starts, between rasterizing and encoding a page, or part way through extracting
+		// its text, in which case nothing is cached for the page.
+		asyncOperation<void> loadAsync(std::filesystem::path pdfFile, std::string owner_password = std::string(), std::string user_password = std::string(), textBackend backend = textBackend::podofo, asyncContext context = asyncContext())
+		{
+			return asyncOperation<void>([this, pdfFile, owner_password, user_password, backend] { loadPdfFile(pdfFile, owner_password, user_password, backend); }, std::move(context));
+		}
+
+		asyncOperation<const std::vector<uint8_t>&> renderPageAsync(double dpi, imageFormat format, bool compress = true, asyncContext context = asyncContext())
+		{
+			cancellationToken token = context.cancel;
+			return asyncOperation<const std::vector<uint8_t>&>([this, dpi, format, compress, token]() -> const std::vector<uint8_t>&
+				{
+					_cancelScope scope(*this, token);
+					return renderPage(dpi, format, compress);
+				}, std::move(context));
+		}
+
+		asyncOperation<const std::vector<uint8_t>&> renderPageFittedAsync(unsigned int viewportWidth, unsigned int viewportHeight, imageFormat format, bool compress = true, asyncContext context = asyncContext())
+		{
+			cancellationToken token = context.cancel;
+			return asyncOperation<const std::vector<uint8_t>&>([this, viewportWidth, viewportHeight, format, compress, token]() -> const std::vector<uint8_t>&
+				{
+					_cancelScope scope(*this, token);
+					return renderPageFitted(viewportWidth, viewportHeight, format, compress);
+				}, std::move(context));
+		}
+
+		asyncOperation<const textCorpus&> textAsync(bool splitSentences = true, bool splitParagraphs = true, asyncContext context = asyncContext())
+		{
+			cancellationToken token = context.cancel;
+			return asyncOperation<const textCorpus&>([this, splitSentences, splitParagraphs, token]() -> const textCorpus&
+				{
+					_cancelScope scope(*this, token);
+					return getText(splitSentences, splitParagraphs);
+				}, std::move(context));
+		}
+#endif
 	};
 }
 
@@ -0,0 +1,389 @@
+/**************************************************************************
+Reads the text of an Office Open XML word processing (DOCX) file.
+
+Copyright (C) 2021 Chris Morrison (gnosticist@protonmail.com)
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <http://www.gnu.org/licenses/>.
+**************************************************************************/
+
+#ifndef _DOCX_READER_HPP_
+#define _DOCX_READER_HPP_
+
+#include <cstdlib>
+#include <filesystem>
+#include <fstream>
+#include <map>
+#include <stdexcept>
+#include <string>
+#include <string_view>
+#include <vector>
+
+#include "zipArchive.hpp"
+#include "xmlPullParser.hpp"
+#include "structuredDocument.hpp"
+
+namespace fsl::_private
+{
+    // What the paragraph styles of a DOCX file say about the text that uses them.
+    struct _docxStyle
+    {
+        std::string basedOn;
+        bool title = false;
+        bool list = false;
+        bool breakBefore = false;
+    };
+
+    using _docxStyles = std::map<std::string, _docxStyle, std::less<>>;
+
+    // True unless an on/off property such as w:pageBreakBefore is switched off by its w:val.
+    inline bool _docxOn(const _xmlPullParser& xml)
+    {
+        const std::string* value = xml.attribute("w:val");
+
+        return !value || ((*value != "0") && (*value != "false") && (*value != "off"));
+    }
+
+    // True if the element has a w:val outline level of a heading, 0 to 8.
+    inline bool _docxOutline(const _xmlPullParser& xml)
+    {
+        const std::string* value = xml.attribute("w:val");
+        if (!value) return false;
+        long level = std::strtol(value->c_str(), nullptr, 10);
+
+        return (level >= 0) && (level < 9);
+    }
+
+    // Reads the paragraph styles of word/styles.xml. A style is a heading if it is named "heading N", "Title"
+    // or "Subtitle" or if it has an outline level, and a list if it has numbering.
+    inline void _readDocxStyles(_xmlPullParser& xml, _docxStyles& styles)
+    {
+        _docxStyle* current = nullptr;
+        while (true)
+        {
+            auto e = xml.next();
+            if (e == _xmlPullParser::event::end) return;
+            if (e == _xmlPullParser::event::endElement)
+            {
+                if (xml.name() == "w:style") current = nullptr;
+                continue;
+            }
+            if (e != _xmlPullParser::event::startElement) continue;
+
+            std::string_view name(xml.name());
+            if (name == "w:style")
+            {
+                const std::string* id = xml.attribute("w:styleId");
+                const std::string* type = xml.attribute("w:type");
+                if (!id || (type && (*type != "paragraph")))
+                {
+                    current = nullptr;
+                    xml.skipElement();
+                    continue;
+                }
+                current = &styles[*id];
+                *current = _docxStyle();
+            }
+            else if (!current)
+            {
+                continue;
+            }
+            else if ((name == "w:rPr") || (name == "w:tblPr") || (name == "w:tblStylePr"))
+            {
+                xml.skipElement();
+            }
+            else if (name == "w:name")
+            {
+                const std::string* value = xml.attribute("w:val");
+                if (!value) continue;
+                std::string lower(*value);
+                for (char& c : lower) c = static_cast<char>(((c >= 'A') && (c <= 'Z')) ? c + ('a' - 'A') : c);
+                if ((lower.compare(0, 8, "heading ") == 0) || (lower == "title") || (lower == "subtitle")) current->title = true;
+            }
+            else if (name == "w:basedOn")
+            {
+                if (const std::string* value = xml.attribute("w:val")) current->basedOn = *value;
+            }
+            else if (name == "w:outlineLvl")
+            {
+                if (_docxOutline(xml)) current->title = true;
+            }
+            else if (name == "w:numId")
+            {
+                const std::string* value = xml.attribute("w:val");
+                current->list = value && (*value != "0");
+            }
+            else if (name == "w:pageBreakBefore")
+            {
+                current->breakBefore = _docxOn(xml);
+            }
+        }
+    }
+
+    // The style with the given ID with what it inherits from the styles it is based on.
+    inline _docxStyle _resolveDocxStyle(const _docxStyles& styles, const std::string& id)
+    {
+        _docxStyle resolved;
+        const std::string* name = id.empty() ? nullptr : &id;
+        for (int depth = 0; name && (depth < 8); ++depth)
+        {
+            auto found = styles.find(*name);
+            if (found == styles.end()) break;
+            resolved.title = resolved.title || found->second.title;
+            resolved.list = resolved.list || found->second.list;
+            resolved.breakBefore = resolved.breakBefore || found->second.breakBefore;
+            name = found->second.basedOn.empty() ? nullptr : &found->second.basedOn;
+        }
+
+        return resolved;
+    }
+
+    // Adds the headings, paragraphs and list items of w:body to doc in one pass over word/document.xml. Each
+    // w:p is a block: a title if its style is a heading or it has an outline level, a list item if it or its
+    // style is numbered. Only the text of w:t runs is kept, so field codes are left out, as are tracked
+    // deletions and the fallback copies of drawings. Pages are split at hard page breaks, at paragraphs that
+    // break the page before them, at section breaks that start a new page and at the last rendered page breaks
+    // the producer recorded where it laid the pages out.
+    inline void _readDocxBody(_xmlPullParser& xml, const _docxStyles& styles, _structuredDocument& doc)
+    {
+        struct block
+        {
+            std::wstring text;
+            std::string style;
+            bool title = false;
+            bool numbered = false;
+            bool unnumbered = false;    // Numbering of the style switched off with a w:numId of 0.
+            bool breakBefore = false;
+            bool breakAfter = false;
+            bool emitted = false;       // Part of the block was added before a hard page break.
+            fsl::text::textCorpusItem::itemType type = fsl::text::textCorpusItem::itemType::paragraph;
+        };
+
+        // Blocks open at once, e.g. a paragraph in a text box anchored in another paragraph.
+        std::vector<block> open;
+        block spare;                    // The last block closed, its buffers are reused by the next one.
+        bool inProperties = false;      // In the w:pPr of the innermost block.
+        bool inText = false;            // In a w:t.
+        bool softBreak = false;         // A rendered page break inside a paragraph, taken once it ends.
+
+        auto flush = [&](block& b)
+        {
+            doc.block(b.text, b.type);
+            if (!b.text.empty()) b.emitted = true;
+            b.text.clear();
+        };
+
+        while (true)
+        {
+            auto e = xml.next();
+            if (e == _xmlPullParser::event::end) return;
+            std::string_view name(xml.name());
+
+            if (e == _xmlPullParser::event::text)
+            {
+                if (inText && !open.empty()) open.back().text.append(xml.text());
+                continue;
+            }
+
+            if (e == _xmlPullParser::event::endElement)
+            {
+                if (name == "w:t")
+                {
+                    inText = false;
+                }
+                else if ((name == "w:pPr") && inProperties && !open.empty())
+                {
+                    // The properties come before the runs, so the type is known before any text is added.
+                    inProperties = false;
+                    block& b = open.back();
+                    _docxStyle style = _resolveDocxStyle(styles, b.style);
+                    if (b.breakBefore || style.breakBefore) doc.pageBreak();
+                    if (b.title || style.title) b.type = fsl::text::textCorpusItem::itemType::title;
+                    else if (b.numbered || (style.list && !b.unnumbered)) b.type = fsl::text::textCorpusItem::itemType::listItem;
+                }
+                else if ((name == "w:p") && !open.empty())
+                {
+                    spare = std::move(open.back());
+                    open.pop_back();
+                    inProperties = false;
+                    flush(spare);
+                    if (spare.breakAfter) doc.pageBreak();
+                    if (softBreak && open.empty())
+                    {
+                        doc.pageBreak();
+                        softBreak = false;
+                    }
+                }
+                continue;
+            }
+
+            if (name == "w:p")
+            {
+                open.push_back(std::move(spare));
+                block& b = open.back();
+                b.text.clear();
+                b.style.clear();
+                b.title = b.numbered = b.unnumbered = b.breakBefore = b.breakAfter = b.emitted = false;
+                b.type = fsl::text::textCorpusItem::itemType::paragraph;
+                inProperties = false;
+                continue;
+            }
+            if (open.empty()) continue;
+            block& b = open.back();
+
+            if (name == "w:t")
+            {
+                inText = true;
+            }
+            else if (inProperties)
+            {
+                if (name == "w:pStyle")
+                {
+                    if (const std::string* value = xml.attribute("w:val")) b.style = *value;
+                }
+                else if (name == "w:numId")
+                {
+                    const std::string* value = xml.attribute("w:val");
+                    b.numbered = value && (*value != "0");
+                    b.unnumbered = !b.numbered;
+                }
+                else if (name == "w:outlineLvl")
+                {
+                    b.title = _docxOutline(xml);
+                }
+                else if (name == "w:pageBreakBefore")
+                {
+                    b.breakBefore = _docxOn(xml);
+                }
+                else if (name == "w:sectPr")
+                {
+                    // The paragraph ends a section, the next one starts a new page unless it is continuous.
+                    b.breakAfter = true;
+                }
+                else if (name == "w:type")
+                {
+                    const std::string* value = xml.attribute("w:val");
+                    if (value && (*value == "continuous")) b.breakAfter = false;
+                }
+                else if ((name == "w:rPr") || (name == "w:pPrChange") || (name == "w:sectPrChange") || (name == "w:tabs"))
+                {
+                    xml.skipElement();
+                }
+            }
+            else if (name == "w:pPr")
+            {
+                inProperties = true;
+            }
+            else if (name == "w:tab")
+            {
+                b.text.push_back(L'\t');
+            }
+            else if (name == "w:br")
+            {
+                const std::string* type = xml.attribute("w:type");
+                if (!type || (*type == "textWrapping"))
+                {
+                    b.text.push_back(L'\n');
+                }
+                else if (*type == "page")
+                {
+                    flush(b);
+                    doc.pageBreak();
+                }
+            }
+            else if (name == "w:cr")
+            {
+                b.text.push_back(L'\n');
+            }
+            else if (name == "w:noBreakHyphen")
+            {
+                b.text.push_back(L'-');
+            }
+            else if (name == "w:lastRenderedPageBreak")
+            {
+                // A paragraph that starts a page is put on it, one that runs over onto the next is kept whole.
+                if (b.text.empty() && !b.emitted && (open.size() == 1)) doc.pageBreak();
+                else softBreak = true;
+            }
+            else if ((name == "w:del") || (name == "w:moveFrom") || (name == "w:rPr") || (name == "mc:Fallback") ||
+                     (name == "w:footnoteReference") || (name == "w:endnoteReference") || (name == "w:commentReference"))
+            {
+                xml.skipElement();
+            }
+        }
+    }
+
+    // The target of the first relationship of a type in a relationships part, resolved against the folder of
+    // the part it belongs to. Empty if there is none.
+    inline std::string _docxRelationship(const _zipArchive& zip, const std::string& part, std::string_view type)
+    {
+        size_t slash = part.rfind('/');
+        std::string folder = (slash == std::string::npos) ? std::string() : part.substr(0, slash + 1);
+        std::string relationships = folder + "_rels/" + part.substr(folder.size()) + ".rels";
+        const auto* entry = zip.find(relationships);
+        if (!entry) return std::string();
+
+        auto reader = zip.open(*entry);
+        _xmlPullParser xml([&](char* buffer, size_t size) { return reader->read(buffer, size); });
+        while (true)
+        {
+            auto e = xml.next();
+            if (e == _xmlPullParser::event::end) return std::string();
+            if ((e != _xmlPullParser::event::startElement) || (xml.name() != "Relationship")) continue;
+            const std::string* t = xml.attribute("Type");
+            const std::string* target = xml.attribute("Target");
+            if (!t || !target || target->empty() || (t->size() < type.size()) || (t->compare(t->size() - type.size(), type.size(), type) != 0)) continue;
+            if (target->front() == '/') return target->substr(1);
+
+            return folder + *target;
+        }
+    }
+
+    // Reads a DOCX file into doc. The main document part is found through the package relationships and is
+    // parsed as it is inflated, so the memory used while reading does not grow with the document.
+    inline void _readDocx(const std::filesystem::path& file, _structuredDocument& doc)
+    {
+        {
+            // Word 97-2003 documents and encrypted DOCX files are OLE compound files, not zip archives.
+            std::ifstream in(file, std::ios::binary);
+            unsigned char signature[4] = { 0, 0, 0, 0 };
+            in.read(reinterpret_cast<char*>(signature), sizeof(signature));
+            if ((signature[0] == 0xD0) && (signature[1] == 0xCF) && (signature[2] == 0x11) && (signature[3] == 0xE0))
+            {
+                throw std::runtime_error("Word 97-2003 and encrypted Word documents are not supported.");
+            }
+        }
+
+        _zipArchive zip(file);
+        std::string main = _docxRelationship(zip, std::string(), "/officeDocument");
+        if (main.empty()) main = "word/document.xml";
+        const auto* content = zip.find(main);
+        if (!content) throw std::runtime_error("The file is not a Word document.");
+
+        _docxStyles styles;
+        std::string stylesPart = _docxRelationship(zip, main, "/styles");
+        if (stylesPart.empty()) stylesPart = "word/styles.xml";
+        if (const auto* entry = zip.find(stylesPart))
+        {
+            auto reader = zip.open(*entry);
+            _xmlPullParser xml([&](char* buffer, size_t size) { return reader->read(buffer, size); });
+            _readDocxStyles(xml, styles);
+        }
+
+        auto reader = zip.open(*content);
+        _xmlPullParser xml([&](char* buffer, size_t size) { return reader->read(buffer, size); });
+        _readDocxBody(xml, styles, doc);
+    }
+}
+
+#endif // _DOCX_READER_HPP_
@@ -0,0 +1,124 @@
+/**************************************************************************
+A read only memory mapping of a file.
+
+Copyright (C) 2021 Chris Morrison (gnosticist@protonmail.com)
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <http://www.gnu.org/licenses/>.
+**************************************************************************/
+
+#ifndef _FILE_MAPPING_HPP_
+#define _FILE_MAPPING_HPP_
+
+#include <cstdint>
+#include <cstddef>
+#include <filesystem>
+#include <stdexcept>
+
+#ifdef _MSC_VER
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+namespace fsl::_private
+{
+    class _fileMapping
+    {
+    private:
+        const uint8_t* _data;
+        size_t _size;
+#ifdef _MSC_VER
+        HANDLE _file;
+        HANDLE _map;
+#else
+        int _fd;
+#endif
+
+    public:
+        explicit _fileMapping(const std::filesystem::path& file)
+        {
+            _data = nullptr;
+            _size = 0;
+#ifdef _MSC_VER
+            _map = nullptr;
+            _file = CreateFileW(file.wstring().c_str(), GENERIC_READ, FILE_SHARE_READ, nullptr, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, nullptr);
+            if (_file == INVALID_HANDLE_VALUE) throw std::runtime_error("The file could not be opened.");
+            LARGE_INTEGER size;
+            if (!GetFileSizeEx(_file, &size))
+            {
+                CloseHandle(_file);
+                throw std::runtime_error("The file could not be opened.");
+            }
+            _size = static_cast<size_t>(size.QuadPart);
+            if (_size == 0) return;
+            _map = CreateFileMappingW(_file, nullptr, PAGE_READONLY, 0, 0, nullptr);
+            if (_map) _data = static_cast<const uint8_t*>(MapViewOfFile(_map, FILE_MAP_READ, 0, 0, 0));
+            if (!_data)
+            {
+                if (_map) CloseHandle(_map);
+                CloseHandle(_file);
+                throw std::runtime_error("The file could not be mapped into memory.");
+            }
+#else
+            _fd = ::open(file.c_str(), O_RDONLY);
+            if (_fd < 0) throw std::runtime_error("The file could not be opened.");
+            struct stat st;
+            if (::fstat(_fd, &st) != 0)
+            {
+                ::close(_fd);
+                throw std::runtime_error("The file could not be opened.");
+            }
+            _size = static_cast<size_t>(st.st_size);
+            if (_size == 0) return;
+            void* p = ::mmap(nullptr, _size, PROT_READ, MAP_SHARED, _fd, 0);
+            if (p == MAP_FAILED)
+            {
+                ::close(_fd);
+                throw std::runtime_error("The file could not be mapped into memory.");
+            }
+            _data = static_cast<const uint8_t*>(p);
+#endif
+        }
+
+        _fileMapping(const _fileMapping&) = delete;
+        _fileMapping& operator=(const _fileMapping&) = delete;
+
+        ~_fileMapping()
+        {
+#ifdef _MSC_VER
+            if (_data) UnmapViewOfFile(_data);
+            if (_map) CloseHandle(_map);
+            CloseHandle(_file);
+#else
+            if (_data) ::munmap(const_cast<uint8_t*>(_data), _size);
+            ::close(_fd);
+#endif
+        }
+
+        [[nodiscard]] const uint8_t* data() const noexcept
+        {
+            return _data;
+        }
+
+        [[nodiscard]] size_t size() const noexcept
+        {
+            return _size;
+        }
+    };
+}
+
+#endif // _FILE_MAPPING_HPP_
@@ -0,0 +1,51 @@
+/**************************************************************************
+Non-cryptographic hashing helpers.
+
+Copyright (C) 2021 Chris Morrison (gnosticist@protonmail.com)
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <http://www.gnu.org/licenses/>.
+**************************************************************************/
+
+#ifndef _HASH_UTILS_HPP_
+#define _HASH_UTILS_HPP_
+
+#include <cstdint>
+#include <cstddef>
+
+namespace fsl::_private
+{
+    constexpr uint64_t _fnv_offset = 14695981039346656037ULL;
+    constexpr uint64_t _fnv_prime = 1099511628211ULL;
+
+    // 64 bit FNV-1a, pass the previous result as seed to hash data in pieces.
+    inline uint64_t _fnv1a(const void* data, size_t length, uint64_t seed = _fnv_offset)
+    {
+        auto p = static_cast<const uint8_t*>(data);
+        uint64_t h = seed;
+        for (size_t i = 0; i < length; ++i)
+        {
+            h ^= p[i];
+            h *= _fnv_prime;
+        }
+
+        return h;
+    }
+
+    inline uint64_t _fnv1a(uint64_t value, uint64_t seed = _fnv_offset)
+    {
+        return _fnv1a(&value, sizeof(value), seed);
+    }
+}
+
+#endif // _HASH_UTILS_HPP_
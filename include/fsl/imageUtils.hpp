@@ -17,6 +17,12 @@ You should have received a copy of the GNU General Public License
 along with this program.  If not, see <http://www.gnu.org/licenses/>.
 **************************************************************************/
 
+#ifndef _IMAGE_UTILS_HPP_
+#define _IMAGE_UTILS_HPP_
+
+#include <cstdint>
+#include <memory>
+#include <vector>
 #include <tiffio.h>
 #include <tiffio.hxx>
 #include <sstream>
@@ -43,11 +49,14 @@ along with this program.  If not, see <http://www.gnu.org/licenses/>.
 #endif
 #endif
 
+// The encoders write into any vector of bytes, e.g. a std::pmr::vector<uint8_t> allocated from an arena of the
+// caller's, and take their scratch memory from the allocator of the output.
 namespace fsl::_private
 {
+    template <typename Buffer>
     inline void _pngWriteCallback(png_structp  png_ptr, png_bytep data, png_size_t length)
     {
-        std::vector<uint8_t>* p = (std::vector<uint8_t>*)png_get_io_ptr(png_ptr);
+        Buffer* p = (Buffer*)png_get_io_ptr(png_ptr);
         p->insert(p->end(), data, data + length);
     }
 
@@ -78,7 +87,8 @@ namespace fsl::_private
         }
     };
 
-    inline std::vector<uint8_t>& _make_jpeg(const uint8_t* input, std::vector<uint8_t>& output, unsigned int width, unsigned int height, bool compress = true)
+    template <typename Buffer>
+    inline Buffer& _make_jpeg(const uint8_t* input, Buffer& output, unsigned int width, unsigned int height, bool compress = true)
     {
         struct jpeg_compress_struct cinfo;
         struct jpeg_error_mgr jerr;
@@ -131,7 +141,8 @@ namespace fsl::_private
         return output;
     }
 
-    inline std::vector<uint8_t>& _make_png(const uint8_t* input, std::vector<uint8_t>& output, unsigned int width, unsigned int height, bool compress = true)
+    template <typename Buffer>
+    inline Buffer& _make_png(const uint8_t* input, Buffer& output, unsigned int width, unsigned int height, bool compress = true)
     {
         png_structp png_ptr = nullptr;
         png_infop info_ptr = nullptr;
@@ -159,19 +170,21 @@ namespace fsl::_private
             png_set_compression_level(png_ptr, 0);
         }
 
-        std::vector<uint8_t*> rows(height);
+        using rowAllocator = typename std::allocator_traits<typename Buffer::allocator_type>::template rebind_alloc<uint8_t*>;
+        std::vector<uint8_t*, rowAllocator> rows(height, rowAllocator(output.get_allocator()));
         for (size_t y = 0; y < height; ++y)
         {
             rows[y] = (uint8_t*)input + y * width * 4;
         }
         png_set_rows(png_ptr, info_ptr, &rows[0]);
-        png_set_write_fn(png_ptr, &output, _pngWriteCallback, nullptr);
+        png_set_write_fn(png_ptr, &output, _pngWriteCallback<Buffer>, nullptr);
         png_write_png(png_ptr, info_ptr, PNG_TRANSFORM_IDENTITY, nullptr);
 
         return output;
     }
 
-    inline std::vector<uint8_t>& _make_tiff(const uint8_t* input, std::vector<uint8_t>& output, unsigned int width, unsigned int height, bool compress = true)
+    template <typename Buffer>
+    inline Buffer& _make_tiff(const uint8_t* input, Buffer& output, unsigned int width, unsigned int height, bool compress = true)
     {
         std::ostringstream output_TIFF_stream;
         TIFF* out = TIFFStreamOpen("MemTIFF", &output_TIFF_stream);
@@ -227,3 +240,5 @@ namespace fsl::_private
         return output;
     }
 }
+
+#endif // _IMAGE_UTILS_HPP_
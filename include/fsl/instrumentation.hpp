@@ -0,0 +1,363 @@
+/**************************************************************************
+Per page timers and counters for the hot paths, with Chrome trace export.
+
+Copyright (C) 2021 Chris Morrison (gnosticist@protonmail.com)
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <http://www.gnu.org/licenses/>.
+**************************************************************************/
+
+#ifndef _INSTRUMENTATION_HPP_
+#define _INSTRUMENTATION_HPP_
+
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <map>
+#include <mutex>
+#include <ostream>
+#include <string>
+#include <utility>
+#include <vector>
+
+// The hooks in the library are compiled in only when FSL_ENABLE_INSTRUMENTATION is defined. Without it the
+// macros below expand to nothing and instrumentation::pages() is always empty.
+
+namespace fsl::text
+{
+    enum class instrumentPhase
+    {
+        load,           // Opening a document.
+        rasterize,      // Poppler rendering a page to pixels.
+        encode,         // Compressing pixels to PNG, TIFF or JPEG.
+        tokenize,       // Interpreting content stream operators, or poppler laying out the words of a page.
+        fontLookup,     // Loading the fonts and metrics selected with Tf.
+        parse,          // HTML stripping, normalisation and the sentence and paragraph splits.
+    };
+
+    enum class instrumentCounter
+    {
+        bytesEncoded,
+        operatorsProcessed,
+        itemsProduced,
+        allocations,    // Heap allocations made for results: items, and growth of the text arena and image buffers.
+    };
+
+    constexpr size_t instrumentPhaseCount = 6;
+    constexpr size_t instrumentCounterCount = 4;
+
+    // What was measured for one page of one document, page 0 is the document itself. The time of a phase
+    // excludes the time of phases nested in it, e.g. the parsing driven by tokenizing.
+    struct pageInstrumentation
+    {
+        const void* document = nullptr;
+        unsigned int page = 0;
+        std::array<uint64_t, instrumentPhaseCount> nanoseconds{};
+        std::array<uint64_t, instrumentPhaseCount> calls{};
+        std::array<uint64_t, instrumentCounterCount> counters{};
+
+        [[nodiscard]] uint64_t time(instrumentPhase phase) const
+        {
+            return nanoseconds[static_cast<size_t>(phase)];
+        }
+
+        [[nodiscard]] uint64_t count(instrumentCounter counter) const
+        {
+            return counters[static_cast<size_t>(counter)];
+        }
+    };
+
+    // The process wide store of measurements. Measurements are taken per page on the thread doing the work and
+    // merged in here when the work on the page is done.
+    class instrumentation
+    {
+    public:
+        struct traceEvent
+        {
+            std::string name;
+            uint64_t start;         // Nanoseconds since the store was created.
+            uint64_t duration;
+            unsigned int thread;
+            const void* document;
+            unsigned int page;
+        };
+
+    private:
+        mutable std::mutex _mutex;
+        std::map<std::pair<const void*, unsigned int>, pageInstrumentation> _pages;
+        std::vector<traceEvent> _events;
+        std::atomic<bool> _trace{ false };
+        std::atomic<uint64_t> _traceThreshold{ 50000 };
+        std::chrono::steady_clock::time_point _epoch = std::chrono::steady_clock::now();
+
+        static void _escape(std::ostream& out, const std::string& s)
+        {
+            for (char c : s)
+            {
+                if ((c == '"') || (c == '\\')) out << '\\';
+                out << c;
+            }
+        }
+
+    public:
+        static instrumentation& instance()
+        {
+            static instrumentation store;
+            return store;
+        }
+
+        static const char* name(instrumentPhase phase)
+        {
+            static const char* names[] = { "load", "rasterize", "encode", "tokenize", "fontLookup", "parse" };
+            return names[static_cast<size_t>(phase)];
+        }
+
+        static const char* name(instrumentCounter counter)
+        {
+            static const char* names[] = { "bytesEncoded", "operatorsProcessed", "itemsProduced", "allocations" };
+            return names[static_cast<size_t>(counter)];
+        }
+
+        [[nodiscard]] uint64_t now() const
+        {
+            return static_cast<uint64_t>(std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - _epoch).count());
+        }
+
+        // Records trace events from now on. Besides one event per page, a phase gets its own event when it runs
+        // for at least minNanoseconds, so the many short calls of the inner loops do not swamp the trace.
+        void setTrace(bool enabled, uint64_t minNanoseconds = 50000)
+        {
+            _traceThreshold = minNanoseconds;
+            _trace = enabled;
+        }
+
+        [[nodiscard]] bool tracing() const
+        {
+            return _trace.load(std::memory_order_relaxed);
+        }
+
+        [[nodiscard]] uint64_t traceThreshold() const
+        {
+            return _traceThreshold.load(std::memory_order_relaxed);
+        }
+
+        void reset()
+        {
+            std::lock_guard<std::mutex> lock(_mutex);
+            _pages.clear();
+            _events.clear();
+        }
+
+        // Sorted by document and page.
+        [[nodiscard]] std::vector<pageInstrumentation> pages() const
+        {
+            std::lock_guard<std::mutex> lock(_mutex);
+            std::vector<pageInstrumentation> result;
+            result.reserve(_pages.size());
+            for (const auto& p : _pages) result.push_back(p.second);
+
+            return result;
+        }
+
+        // The measurements of one page, summed over every time it was worked on.
+        [[nodiscard]] pageInstrumentation page(const void* document, unsigned int page) const
+        {
+            std::lock_guard<std::mutex> lock(_mutex);
+            auto it = _pages.find({ document, page });
+            if (it != _pages.end()) return it->second;
+            pageInstrumentation empty;
+            empty.document = document;
+            empty.page = page;
+
+            return empty;
+        }
+
+        void merge(const pageInstrumentation& stats, std::vector<traceEvent>& events)
+        {
+            std::lock_guard<std::mutex> lock(_mutex);
+            auto& p = _pages[{ stats.document, stats.page }];
+            p.document = stats.document;
+            p.page = stats.page;
+            for (size_t i = 0; i < instrumentPhaseCount; ++i)
+            {
+                p.nanoseconds[i] += stats.nanoseconds[i];
+                p.calls[i] += stats.calls[i];
+            }
+            for (size_t i = 0; i < instrumentCounterCount; ++i) p.counters[i] += stats.counters[i];
+            for (auto& e : events) _events.push_back(std::move(e));
+        }
+
+        // Writes the trace events recorded so far in the Chrome trace event format, for chrome://tracing or
+        // Perfetto. Each document is shown as a process and each thread as a thread.
+        void writeChromeTrace(std::ostream& out) const
+        {
+            std::lock_guard<std::mutex> lock(_mutex);
+            std::map<const void*, size_t> documents;
+            out << "{\"traceEvents\":[";
+            bool first = true;
+            for (const auto& e : _events)
+            {
+                size_t pid = documents.emplace(e.document, documents.size() + 1).first->second;
+                if (!first) out << ',';
+                first = false;
+                out << "\n{\"name\":\"";
+                _escape(out, e.name);
+                out << "\",\"cat\":\"fsl\",\"ph\":\"X\",\"ts\":" << (e.start / 1000) << '.' << (e.start % 1000 / 100)
+                    << ",\"dur\":" << (e.duration / 1000) << '.' << (e.duration % 1000 / 100)
+                    << ",\"pid\":" << pid << ",\"tid\":" << e.thread << ",\"args\":{\"page\":" << e.page;
+                if (e.name.compare(0, 5, "page ") == 0)
+                {
+                    auto it = _pages.find({ e.document, e.page });
+                    if (it != _pages.end())
+                    {
+                        for (size_t i = 0; i < instrumentCounterCount; ++i) out << ",\"" << name(static_cast<instrumentCounter>(i)) << "\":" << it->second.counters[i];
+                    }
+                }
+                out << "}}";
+            }
+            out << "\n],\"displayTimeUnit\":\"ms\"}\n";
+        }
+    };
+}
+
+namespace fsl::_private
+{
+    inline unsigned int _instrumentThread()
+    {
+        static std::atomic<unsigned int> next{ 1 };
+        thread_local unsigned int id = next++;
+        return id;
+    }
+
+    class _phaseTimer;
+
+    // Collects the measurements of the page being worked on by this thread.
+    class _pageCollector
+    {
+        friend class _phaseTimer;
+
+    private:
+        fsl::text::pageInstrumentation _stats;
+        std::vector<fsl::text::instrumentation::traceEvent> _events;
+        _pageCollector* _previous;
+        _phaseTimer* _outerTimer;
+        uint64_t _start;
+
+        static _pageCollector*& _current()
+        {
+            thread_local _pageCollector* current = nullptr;
+            return current;
+        }
+
+    public:
+        _pageCollector(const void* document, unsigned int page);
+        ~_pageCollector();
+
+        _pageCollector(const _pageCollector&) = delete;
+        _pageCollector& operator=(const _pageCollector&) = delete;
+
+        static void count(fsl::text::instrumentCounter counter, uint64_t n)
+        {
+            if (auto c = _current()) c->_stats.counters[static_cast<size_t>(counter)] += n;
+        }
+    };
+
+    // Times a phase on this thread, excluding the phases nested in it. Does nothing outside a page.
+    class _phaseTimer
+    {
+        friend class _pageCollector;
+
+    private:
+        _pageCollector* _collector;
+        _phaseTimer* _parent;
+        fsl::text::instrumentPhase _phase;
+        uint64_t _start;
+        uint64_t _nested = 0;
+
+        static _phaseTimer*& _current()
+        {
+            thread_local _phaseTimer* current = nullptr;
+            return current;
+        }
+
+    public:
+        explicit _phaseTimer(fsl::text::instrumentPhase phase) : _collector(_pageCollector::_current()), _phase(phase)
+        {
+            if (!_collector) return;
+            _parent = _current();
+            _current() = this;
+            _start = fsl::text::instrumentation::instance().now();
+        }
+
+        ~_phaseTimer()
+        {
+            if (!_collector) return;
+            auto& store = fsl::text::instrumentation::instance();
+            uint64_t elapsed = store.now() - _start;
+            size_t i = static_cast<size_t>(_phase);
+            _collector->_stats.nanoseconds[i] += elapsed - std::min(elapsed, _nested);
+            ++_collector->_stats.calls[i];
+            if (_parent) _parent->_nested += elapsed;
+            _current() = _parent;
+            if (store.tracing() && (elapsed >= store.traceThreshold()))
+            {
+                _collector->_events.push_back({ fsl::text::instrumentation::name(_phase), _start, elapsed, _instrumentThread(), _collector->_stats.document, _collector->_stats.page });
+            }
+        }
+
+        _phaseTimer(const _phaseTimer&) = delete;
+        _phaseTimer& operator=(const _phaseTimer&) = delete;
+    };
+
+    inline _pageCollector::_pageCollector(const void* document, unsigned int page)
+    {
+        _stats.document = document;
+        _stats.page = page;
+        _previous = _current();
+        _current() = this;
+        // Timers of an enclosing page do not see the phases of this one.
+        _outerTimer = _phaseTimer::_current();
+        _phaseTimer::_current() = nullptr;
+        _start = fsl::text::instrumentation::instance().now();
+    }
+
+    inline _pageCollector::~_pageCollector()
+    {
+        auto& store = fsl::text::instrumentation::instance();
+        if (store.tracing())
+        {
+            _events.push_back({ "page " + std::to_string(_stats.page), _start, store.now() - _start, _instrumentThread(), _stats.document, _stats.page });
+        }
+        store.merge(_stats, _events);
+        _phaseTimer::_current() = _outerTimer;
+        _current() = _previous;
+    }
+}
+
+#ifdef FSL_ENABLE_INSTRUMENTATION
+#define FSL_INSTRUMENT_CONCAT2(a, b) a##b
+#define FSL_INSTRUMENT_CONCAT(a, b) FSL_INSTRUMENT_CONCAT2(a, b)
+// Attributes what this thread does until the end of the scope to a page of a document.
+#define FSL_INSTRUMENT_PAGE(document, page) fsl::_private::_pageCollector FSL_INSTRUMENT_CONCAT(_fslPage, __LINE__)(document, page)
+// Times the rest of the scope as a phase.
+#define FSL_INSTRUMENT_PHASE(phase) fsl::_private::_phaseTimer FSL_INSTRUMENT_CONCAT(_fslPhase, __LINE__)(fsl::text::instrumentPhase::phase)
+#define FSL_INSTRUMENT_COUNT(counter, n) fsl::_private::_pageCollector::count(fsl::text::instrumentCounter::counter, static_cast<uint64_t>(n))
+#else
+#define FSL_INSTRUMENT_PAGE(document, page) ((void)0)
+#define FSL_INSTRUMENT_PHASE(phase) ((void)0)
+#define FSL_INSTRUMENT_COUNT(counter, n) ((void)0)
+#endif
+
+#endif // _INSTRUMENTATION_HPP_
@@ -0,0 +1,245 @@
+/**************************************************************************
+Reads the text of an OpenDocument text (ODT) file.
+
+Copyright (C) 2021 Chris Morrison (gnosticist@protonmail.com)
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <http://www.gnu.org/licenses/>.
+**************************************************************************/
+
+#ifndef _ODT_READER_HPP_
+#define _ODT_READER_HPP_
+
+#include <algorithm>
+#include <cstdlib>
+#include <filesystem>
+#include <map>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+#include "zipArchive.hpp"
+#include "xmlPullParser.hpp"
+#include "structuredDocument.hpp"
+
+namespace fsl::_private
+{
+    // What the paragraph styles of an ODT file say about the text that uses them.
+    struct _odtStyle
+    {
+        std::string parent;
+        bool title = false;
+        bool breakBefore = false;
+        bool breakAfter = false;
+    };
+
+    using _odtStyles = std::map<std::string, _odtStyle, std::less<>>;
+
+    // Reads the paragraph styles of office:styles or office:automatic-styles from a styles.xml or content.xml
+    // stream, stopping at the body.
+    inline void _readOdtStyles(_xmlPullParser& xml, _odtStyles& styles)
+    {
+        _odtStyle* current = nullptr;
+        while (true)
+        {
+            auto e = xml.next();
+            if (e == _xmlPullParser::event::end) return;
+            if (e == _xmlPullParser::event::endElement)
+            {
+                if (xml.name() == "style:style") current = nullptr;
+                continue;
+            }
+            if (e != _xmlPullParser::event::startElement) continue;
+
+            const std::string& name = xml.name();
+            if (name == "office:body") return;
+            if (name == "style:style")
+            {
+                const std::string* styleName = xml.attribute("style:name");
+                const std::string* family = xml.attribute("style:family");
+                if (!styleName || !family || (*family != "paragraph"))
+                {
+                    current = nullptr;
+                    continue;
+                }
+                // An automatic style of content.xml replaces one of the same name in styles.xml.
+                current = &styles[*styleName];
+                *current = _odtStyle();
+                if (const std::string* parent = xml.attribute("style:parent-style-name")) current->parent = *parent;
+                // A paragraph that switches to another master page starts a new page.
+                const std::string* master = xml.attribute("style:master-page-name");
+                if (master && !master->empty()) current->breakBefore = true;
+                current->title = (*styleName == "Title") || (*styleName == "Subtitle");
+            }
+            else if (current && (name == "style:paragraph-properties"))
+            {
+                const std::string* before = xml.attribute("fo:break-before");
+                const std::string* after = xml.attribute("fo:break-after");
+                if (before && (*before == "page")) current->breakBefore = true;
+                if (after && (*after == "page")) current->breakAfter = true;
+            }
+        }
+    }
+
+    // The style with the given name with what it inherits from its parents.
+    inline _odtStyle _resolveOdtStyle(const _odtStyles& styles, const std::string* name)
+    {
+        _odtStyle resolved;
+        for (int depth = 0; name && (depth < 8); ++depth)
+        {
+            if ((*name == "Title") || (*name == "Subtitle")) resolved.title = true;
+            auto found = styles.find(*name);
+            if (found == styles.end()) break;
+            resolved.title = resolved.title || found->second.title;
+            resolved.breakBefore = resolved.breakBefore || found->second.breakBefore;
+            resolved.breakAfter = resolved.breakAfter || found->second.breakAfter;
+            name = found->second.parent.empty() ? nullptr : &found->second.parent;
+        }
+
+        return resolved;
+    }
+
+    // Adds the headings, paragraphs and list items of office:text to doc as its parser streams through the
+    // rest of content.xml. Headings are titles, as are paragraphs in the Title and Subtitle styles, and the
+    // paragraphs of list items are list items. Pages are split at the soft page breaks the producer recorded
+    // where it laid the pages out and at paragraphs whose style breaks the page. Notes, annotations, tracked
+    // deletions and index templates are left out.
+    inline void _readOdtBody(_xmlPullParser& xml, const _odtStyles& styles, _structuredDocument& doc)
+    {
+        struct block
+        {
+            std::wstring text;
+            fsl::text::textCorpusItem::itemType type;
+            bool breakAfter;
+        };
+
+        // Blocks open at once, e.g. a paragraph in a text box anchored in another paragraph.
+        std::vector<block> open;
+        size_t listItems = 0;
+        bool inText = false;
+        bool softBreak = false;     // A soft page break inside a paragraph, taken once it ends.
+
+        while (true)
+        {
+            auto e = xml.next();
+            if (e == _xmlPullParser::event::end) return;
+            const std::string& name = xml.name();
+
+            if (e == _xmlPullParser::event::text)
+            {
+                if (!open.empty()) open.back().text.append(xml.text());
+                continue;
+            }
+
+            if (e == _xmlPullParser::event::endElement)
+            {
+                if (name == "office:text")
+                {
+                    inText = false;
+                }
+                else if (name == "text:list-item")
+                {
+                    if (listItems > 0) --listItems;
+                }
+                else if (((name == "text:p") || (name == "text:h")) && !open.empty())
+                {
+                    block b = std::move(open.back());
+                    open.pop_back();
+                    doc.block(b.text, b.type);
+                    if (b.breakAfter) doc.pageBreak();
+                    if (softBreak && open.empty())
+                    {
+                        doc.pageBreak();
+                        softBreak = false;
+                    }
+                }
+                continue;
+            }
+
+            if (name == "office:text")
+            {
+                inText = true;
+                continue;
+            }
+            if (!inText) continue;
+
+            if ((name == "text:p") || (name == "text:h"))
+            {
+                _odtStyle style = _resolveOdtStyle(styles, xml.attribute("text:style-name"));
+                if (style.breakBefore) doc.pageBreak();
+                auto type = fsl::text::textCorpusItem::itemType::paragraph;
+                if ((name == "text:h") || style.title) type = fsl::text::textCorpusItem::itemType::title;
+                else if (listItems > 0) type = fsl::text::textCorpusItem::itemType::listItem;
+                open.push_back({ std::wstring(), type, style.breakAfter });
+            }
+            else if (name == "text:list-item")
+            {
+                ++listItems;
+            }
+            else if (name == "text:soft-page-break")
+            {
+                if (open.empty()) doc.pageBreak();
+                else softBreak = true;
+            }
+            else if (name == "text:s")
+            {
+                const std::string* count = xml.attribute("text:c");
+                long n = count ? std::strtol(count->c_str(), nullptr, 10) : 1;
+                if (!open.empty()) open.back().text.append(static_cast<size_t>(std::max(1L, std::min(n, 1024L))), L' ');
+            }
+            else if (name == "text:tab")
+            {
+                if (!open.empty()) open.back().text.push_back(L'\t');
+            }
+            else if (name == "text:line-break")
+            {
+                if (!open.empty()) open.back().text.push_back(L'\n');
+            }
+            else if ((name == "text:note") || (name == "office:annotation") || (name == "text:tracked-changes") ||
+                     (name == "svg:title") || (name == "svg:desc") || (name == "office:forms") ||
+                     ((name.size() > 7) && (name.compare(name.size() - 7, 7, "-source") == 0)))
+            {
+                xml.skipElement();
+            }
+        }
+    }
+
+    // Reads an ODT file into doc. Only the central directory and the style and content streams are read, the
+    // content is parsed as it is inflated so the memory used while reading does not grow with the document.
+    inline void _readOdt(const std::filesystem::path& file, _structuredDocument& doc)
+    {
+        _zipArchive zip(file);
+        const auto* content = zip.find("content.xml");
+        if (!content) throw std::runtime_error("The file is not an OpenDocument text document.");
+
+        if (const auto* manifest = zip.find("META-INF/manifest.xml"))
+        {
+            if (zip.readAll(*manifest).find("encryption-data") != std::string::npos) throw std::runtime_error("Encrypted OpenDocument files are not supported.");
+        }
+
+        _odtStyles styles;
+        if (const auto* common = zip.find("styles.xml"))
+        {
+            auto reader = zip.open(*common);
+            _xmlPullParser xml([&](char* buffer, size_t size) { return reader->read(buffer, size); });
+            _readOdtStyles(xml, styles);
+        }
+
+        auto reader = zip.open(*content);
+        _xmlPullParser xml([&](char* buffer, size_t size) { return reader->read(buffer, size); });
+        _readOdtStyles(xml, styles);
+        _readOdtBody(xml, styles, doc);
+    }
+}
+
+#endif // _ODT_READER_HPP_
@@ -0,0 +1,408 @@
+/**************************************************************************
+Renders and extracts a range of pages through a pipeline of parallel stages.
+
+Copyright (C) 2021 Chris Morrison (gnosticist@protonmail.com)
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <http://www.gnu.org/licenses/>.
+**************************************************************************/
+
+#ifndef _PAGE_PIPELINE_HPP_
+#define _PAGE_PIPELINE_HPP_
+
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <deque>
+#include <exception>
+#include <functional>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <stdexcept>
+#include <thread>
+#include <vector>
+
+#include "textCorpus.hpp"
+#include "pdfDocument.hpp"
+
+namespace fsl::_private
+{
+    // A queue between two pipeline stages. Pushing blocks while the queue is full and popping while it is empty.
+    // The depth is sampled on every push.
+    template<typename T>
+    class _boundedQueue
+    {
+    private:
+        std::mutex _mutex;
+        std::condition_variable _notFull;
+        std::condition_variable _notEmpty;
+        std::deque<T> _items;
+        size_t _capacity;
+        bool _closed = false;
+        size_t _maxDepth = 0;
+        size_t _depthSum = 0;
+        size_t _pushes = 0;
+
+    public:
+        explicit _boundedQueue(size_t capacity) : _capacity(std::max<size_t>(1, capacity))
+        {
+        }
+
+        // Returns false, dropping the item, if the queue has been closed.
+        bool push(T item)
+        {
+            std::unique_lock<std::mutex> lock(_mutex);
+            _notFull.wait(lock, [this] { return _closed || (_items.size() < _capacity); });
+            if (_closed) return false;
+            _items.push_back(std::move(item));
+            _maxDepth = std::max(_maxDepth, _items.size());
+            _depthSum += _items.size();
+            ++_pushes;
+            lock.unlock();
+            _notEmpty.notify_one();
+
+            return true;
+        }
+
+        // Returns false once the queue has been closed and emptied.
+        bool pop(T& item)
+        {
+            std::unique_lock<std::mutex> lock(_mutex);
+            _notEmpty.wait(lock, [this] { return _closed || !_items.empty(); });
+            if (_items.empty()) return false;
+            item = std::move(_items.front());
+            _items.pop_front();
+            lock.unlock();
+            _notFull.notify_one();
+
+            return true;
+        }
+
+        // No more items will be pushed, the consumers finish with the items left.
+        void close()
+        {
+            {
+                std::lock_guard<std::mutex> lock(_mutex);
+                _closed = true;
+            }
+            _notFull.notify_all();
+            _notEmpty.notify_all();
+        }
+
+        // Closes the queue and drops the items left.
+        void abort()
+        {
+            {
+                std::lock_guard<std::mutex> lock(_mutex);
+                _closed = true;
+                _items.clear();
+            }
+            _notFull.notify_all();
+            _notEmpty.notify_all();
+        }
+
+        size_t maxDepth()
+        {
+            std::lock_guard<std::mutex> lock(_mutex);
+            return _maxDepth;
+        }
+
+        double meanDepth()
+        {
+            std::lock_guard<std::mutex> lock(_mutex);
+            return _pushes ? static_cast<double>(_depthSum) / static_cast<double>(_pushes) : 0.0;
+        }
+    };
+}
+
+namespace fsl::text
+{
+    enum class pipelineStage
+    {
+        rasterize,      // Poppler renders the page to pixels.
+        encode,         // The pixels are compressed into the image format.
+        tokenize,       // The text operators of the page are interpreted into pieces of text.
+        parse,          // The pieces are parsed into the items of a textCorpus.
+    };
+
+    struct pipelineOptions
+    {
+        // Rendering, at dpi, or to fill the viewport along its long side if it is not zero.
+        bool render = true;
+        double dpi = 96;
+        unsigned int viewportWidth = 0;
+        unsigned int viewportHeight = 0;
+        imageFormat format = imageFormat::png;
+        bool compress = true;
+
+        // Text extraction. The text is shared with the page cache of the document.
+        bool text = true;
+        bool splitSentences = true;
+        bool splitParagraphs = true;
+
+        // The threads running each stage, indexed by pipelineStage, and the capacity of the queue in front of each
+        // stage and of the results waiting to be delivered.
+        std::array<unsigned int, 4> threads{ 1, 1, 1, 1 };
+        size_t queueCapacity = 4;
+    };
+
+    // The result for one page. If a stage failed, error holds its exception and the later stages were skipped.
+    struct pipelinePage
+    {
+        unsigned int number = 0;
+        std::vector<uint8_t> image;
+        std::shared_ptr<const textCorpus> text;
+        std::exception_ptr error;
+    };
+
+    struct pipelineStageStats
+    {
+        size_t pages = 0;
+        double busySeconds = 0;         // Summed over the threads of the stage.
+        double pagesPerSecond = 0;      // Pages over the time the stage was busy, per thread.
+        size_t maxQueueDepth = 0;       // Of the queue in front of the stage.
+        double meanQueueDepth = 0;
+    };
+
+    struct pipelineStats
+    {
+        std::array<pipelineStageStats, 4> stages;   // Indexed by pipelineStage.
+        size_t pages = 0;
+        double seconds = 0;
+    };
+
+    // Renders and extracts the text of a range of pages of a pdfDocument in four stages joined by bounded
+    // queues, see pipelineStage. Each stage runs on its own threads, so a page can be encoded while the next is
+    // rasterized. The results are delivered in page order; at most a window of pages, set by the queue capacity
+    // and the number of threads, is in flight at once.
+    class pagePipeline
+    {
+    private:
+        struct _item
+        {
+            unsigned int page;
+            poppler::image raster;
+            std::vector<uint8_t> image;
+            std::vector<fsl::_private::_pdfTextPiece> pieces;
+            std::shared_ptr<const textCorpus> text;
+            std::exception_ptr error;
+        };
+
+        std::shared_ptr<const pdfDocument> _doc;
+        pipelineOptions _options;
+
+        void _process(pipelineStage stage, _item& it) const
+        {
+            FSL_INSTRUMENT_PAGE(_doc.get(), it.page);
+            switch (stage)
+            {
+            case pipelineStage::rasterize:
+                if (_options.render)
+                {
+                    pdfDocument::_lease doc(*_doc);
+                    std::unique_ptr<poppler::page> pageRef(doc->create_page(static_cast<int>(it.page - 1)));
+                    if (!pageRef) break;
+                    if (_options.viewportWidth || _options.viewportHeight)
+                    {
+                        double dpi = fsl::_private::_fittedDpi(*pageRef, _options.viewportWidth, _options.viewportHeight);
+                        if (dpi > 0) it.raster = fsl::_private::_rasterizePopplerPage(*pageRef, dpi, poppler::image::format_argb32);
+                    }
+                    else
+                    {
+                        it.raster = fsl::_private::_rasterizePopplerPage(*pageRef, _options.dpi, poppler::image::format_rgb24);
+                    }
+                }
+                break;
+            case pipelineStage::encode:
+                fsl::_private::_encodePopplerImage(it.raster, _options.format, _options.compress, it.image);
+                it.raster = poppler::image();
+                break;
+            case pipelineStage::tokenize:
+                if (_options.text)
+                {
+                    it.text = _doc->_cachedText(it.page, _options.splitSentences, _options.splitParagraphs);
+                    if (it.text) break;
+                    _doc->_extractText(it.page, [&](const std::wstring& text, const textLayout::box* box)
+                        {
+                            it.pieces.push_back({ text, box != nullptr, box ? *box : textLayout::box() });
+                        });
+                }
+                break;
+            case pipelineStage::parse:
+                if (_options.text && !it.text)
+                {
+                    auto tc = std::make_shared<textCorpus>();
+                    fsl::_private::_parsePageText(*tc, _options.splitSentences, _options.splitParagraphs, it.pieces);
+                    it.pieces = std::vector<fsl::_private::_pdfTextPiece>();
+                    it.text = _doc->_cacheText(it.page, _options.splitSentences, _options.splitParagraphs, std::move(tc));
+                }
+                break;
+            }
+        }
+
+    public:
+        explicit pagePipeline(std::shared_ptr<const pdfDocument> doc, const pipelineOptions& options = pipelineOptions()) : _doc(std::move(doc)), _options(options)
+        {
+            if (!_doc) throw std::invalid_argument("doc is null.");
+            for (auto n : _options.threads)
+            {
+                if (n == 0) throw std::invalid_argument("Every stage needs at least one thread.");
+            }
+        }
+
+        [[nodiscard]] const pipelineOptions& options() const noexcept
+        {
+            return _options;
+        }
+
+        // Runs pages first to last, numbered from 1, through the pipeline and passes each result to sink on the
+        // calling thread, in page order. If sink throws, the pipeline is stopped and the exception rethrown.
+        pipelineStats run(unsigned int first, unsigned int last, const std::function<void(pipelinePage&)>& sink)
+        {
+            if ((first == 0) || (last > _doc->numberOfPages()) || (first > last)) throw std::invalid_argument("page range out of range.");
+
+            using clock = std::chrono::steady_clock;
+            using item = std::unique_ptr<_item>;
+            constexpr size_t stages = 4;
+
+            auto start = clock::now();
+            std::unique_ptr<fsl::_private::_boundedQueue<item>> queues[stages + 1];
+            for (auto& q : queues) q = std::make_unique<fsl::_private::_boundedQueue<item>>(_options.queueCapacity);
+
+            std::atomic<size_t> processed[stages] = {};
+            std::atomic<int64_t> busy[stages] = {};
+            std::atomic<unsigned int> running[stages] = {};
+
+            // Pages are admitted no further than window pages ahead of the next to be delivered, so a slow page
+            // cannot make the results behind it pile up.
+            size_t window = _options.queueCapacity * (stages + 1);
+            for (auto n : _options.threads) window += n;
+            std::mutex windowMutex;
+            std::condition_variable windowChanged;
+            unsigned int next = first;
+            bool stop = false;
+
+            std::vector<std::thread> threads;
+            const auto stopAll = [&]
+            {
+                {
+                    std::lock_guard<std::mutex> lock(windowMutex);
+                    stop = true;
+                }
+                windowChanged.notify_all();
+                for (auto& q : queues) q->abort();
+            };
+
+            std::exception_ptr error;
+            try
+            {
+                threads.emplace_back([&]
+                    {
+                        for (unsigned int p = first; p <= last; ++p)
+                        {
+                            {
+                                std::unique_lock<std::mutex> lock(windowMutex);
+                                windowChanged.wait(lock, [&] { return stop || (p < next + window); });
+                                if (stop) break;
+                            }
+                            auto it = std::make_unique<_item>();
+                            it->page = p;
+                            if (!queues[0]->push(std::move(it))) break;
+                        }
+                        queues[0]->close();
+                    });
+
+                for (size_t s = 0; s < stages; ++s)
+                {
+                    running[s] = _options.threads[s];
+                    for (unsigned int t = 0; t < _options.threads[s]; ++t)
+                    {
+                        threads.emplace_back([&, s]
+                            {
+                                item it;
+                                while (queues[s]->pop(it))
+                                {
+                                    if (!it->error)
+                                    {
+                                        auto t0 = clock::now();
+                                        try
+                                        {
+                                            _process(static_cast<pipelineStage>(s), *it);
+                                        }
+                                        catch (...)
+                                        {
+                                            it->error = std::current_exception();
+                                        }
+                                        busy[s] += std::chrono::duration_cast<std::chrono::nanoseconds>(clock::now() - t0).count();
+                                    }
+                                    ++processed[s];
+                                    if (!queues[s + 1]->push(std::move(it))) break;
+                                }
+                                if (--running[s] == 0) queues[s + 1]->close();
+                            });
+                    }
+                }
+
+                // Results arrive out of order when a stage has more than one thread.
+                std::map<unsigned int, item> waiting;
+                item it;
+                while (queues[stages]->pop(it))
+                {
+                    unsigned int page = it->page;
+                    waiting.emplace(page, std::move(it));
+                    for (auto w = waiting.begin(); (w != waiting.end()) && (w->first == next); w = waiting.begin())
+                    {
+                        pipelinePage result;
+                        result.number = w->first;
+                        result.image = std::move(w->second->image);
+                        result.text = std::move(w->second->text);
+                        result.error = w->second->error;
+                        waiting.erase(w);
+                        sink(result);
+                        {
+                            std::lock_guard<std::mutex> lock(windowMutex);
+                            ++next;
+                        }
+                        windowChanged.notify_all();
+                    }
+                }
+            }
+            catch (...)
+            {
+                error = std::current_exception();
+                stopAll();
+            }
+            for (auto& t : threads) t.join();
+            if (error) std::rethrow_exception(error);
+
+            pipelineStats stats;
+            stats.pages = next - first;
+            stats.seconds = std::chrono::duration<double>(clock::now() - start).count();
+            for (size_t s = 0; s < stages; ++s)
+            {
+                auto& st = stats.stages[s];
+                st.pages = processed[s];
+                st.busySeconds = static_cast<double>(busy[s]) / 1e9;
+                st.pagesPerSecond = (st.busySeconds > 0) ? static_cast<double>(st.pages) / st.busySeconds : 0.0;
+                st.maxQueueDepth = queues[s]->maxDepth();
+                st.meanQueueDepth = queues[s]->meanDepth();
+            }
+
+            return stats;
+        }
+    };
+}
+
+#endif // _PAGE_PIPELINE_HPP_
@@ -0,0 +1,237 @@
+/**************************************************************************
+Renders and extracts the pages ahead of a sequential reader in the background.
+
+Copyright (C) 2021 Chris Morrison (gnosticist@protonmail.com)
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <http://www.gnu.org/licenses/>.
+**************************************************************************/
+
+#ifndef _PAGE_PREFETCHER_HPP_
+#define _PAGE_PREFETCHER_HPP_
+
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <map>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+#include "textCorpus.hpp"
+#include "pdfDocument.hpp"
+
+namespace fsl::_private
+{
+    // The parameters of a render call, so a prefetched image is only used for an identical call.
+    struct _renderRequest
+    {
+        bool valid = false;
+        bool fitted = false;
+        double dpi = 0;
+        unsigned int viewportWidth = 0;
+        unsigned int viewportHeight = 0;
+        fsl::text::imageFormat format = fsl::text::imageFormat::png;
+        bool compress = true;
+
+        bool operator==(const _renderRequest& other) const
+        {
+            return (valid == other.valid) && (fitted == other.fitted) && (dpi == other.dpi) && (viewportWidth == other.viewportWidth) &&
+                   (viewportHeight == other.viewportHeight) && (format == other.format) && (compress == other.compress);
+        }
+    };
+
+    // What to prepare for each page ahead.
+    struct _prefetchRequest
+    {
+        _renderRequest render;
+        bool text = false;
+        bool splitSentences = true;
+        bool splitParagraphs = true;
+    };
+
+    // A worker thread that prepares pages with a caller supplied function and holds the results until they are
+    // taken. Requests replace any pages still queued. Once the results held reach the memory cap nothing more
+    // is prepared until some are taken or discarded.
+    class _pagePrefetcher
+    {
+    public:
+        // Prepares a page, image and text are null if they are not wanted. Runs on the worker thread.
+        using work = std::function<void(unsigned int page, const _prefetchRequest& request, std::vector<uint8_t>* image, fsl::text::textCorpus* text)>;
+
+    private:
+        struct _entry
+        {
+            _prefetchRequest request;
+            bool hasImage = false;
+            bool hasText = false;
+            std::vector<uint8_t> image;
+            fsl::text::textCorpus text;
+            size_t bytes = 0;
+        };
+
+        work _work;
+        size_t _memoryCap;
+        std::mutex _mutex;
+        std::condition_variable _wake;
+        std::deque<unsigned int> _queue;
+        _prefetchRequest _request;
+        std::map<unsigned int, _entry> _ready;
+        size_t _bytes = 0;
+        bool _stop = false;
+        std::thread _thread;
+
+        static size_t _size(const fsl::text::textCorpus& tc)
+        {
+            size_t bytes = 0;
+            for (size_t i = 0; i < tc.size(); ++i) bytes += tc.text(i).size() * sizeof(wchar_t) + sizeof(fsl::text::textCorpusItem);
+
+            return bytes;
+        }
+
+        void _run()
+        {
+            std::unique_lock<std::mutex> lock(_mutex);
+            while (true)
+            {
+                _wake.wait(lock, [this] { return _stop || (!_queue.empty() && (_bytes < _memoryCap)); });
+                if (_stop) return;
+
+                unsigned int page = _queue.front();
+                _queue.pop_front();
+                if (_ready.count(page)) continue;
+                _prefetchRequest request = _request;
+                lock.unlock();
+
+                _entry entry;
+                entry.request = request;
+                entry.hasImage = request.render.valid;
+                entry.hasText = request.text;
+                try
+                {
+                    _work(page, request, entry.hasImage ? &entry.image : nullptr, entry.hasText ? &entry.text : nullptr);
+                    entry.bytes = entry.image.size() + _size(entry.text);
+                }
+                catch (...)
+                {
+                    // Leave the page to be prepared when it is asked for, where the error is reported.
+                    entry.hasImage = entry.hasText = false;
+                }
+
+                lock.lock();
+                if ((entry.hasImage || entry.hasText) && !_ready.count(page))
+                {
+                    _bytes += entry.bytes;
+                    _ready.emplace(page, std::move(entry));
+                }
+            }
+        }
+
+    public:
+        _pagePrefetcher(work w, size_t memoryCap) : _work(std::move(w)), _memoryCap(memoryCap)
+        {
+            _thread = std::thread(&_pagePrefetcher::_run, this);
+        }
+
+        ~_pagePrefetcher()
+        {
+            {
+                std::lock_guard<std::mutex> lock(_mutex);
+                _stop = true;
+            }
+            _wake.notify_all();
+            _thread.join();
+        }
+
+        _pagePrefetcher(const _pagePrefetcher&) = delete;
+        _pagePrefetcher& operator=(const _pagePrefetcher&) = delete;
+
+        // Queues pages to prepare in order, replacing any still queued.
+        void request(const std::vector<unsigned int>& pages, const _prefetchRequest& request)
+        {
+            {
+                std::lock_guard<std::mutex> lock(_mutex);
+                _queue.assign(pages.begin(), pages.end());
+                _request = request;
+            }
+            _wake.notify_one();
+        }
+
+        // Drops the queued pages, a page being prepared is still kept.
+        void cancel()
+        {
+            std::lock_guard<std::mutex> lock(_mutex);
+            _queue.clear();
+        }
+
+        // Frees the results for pages outside [first, last].
+        void discardOutside(unsigned int first, unsigned int last)
+        {
+            {
+                std::lock_guard<std::mutex> lock(_mutex);
+                for (auto it = _ready.begin(); it != _ready.end();)
+                {
+                    if ((it->first >= first) && (it->first <= last))
+                    {
+                        ++it;
+                        continue;
+                    }
+                    _bytes -= it->second.bytes;
+                    it = _ready.erase(it);
+                }
+            }
+            _wake.notify_one();
+        }
+
+        // Moves a prepared image for an identical render call into out.
+        bool takeImage(unsigned int page, const _renderRequest& render, std::vector<uint8_t>& out)
+        {
+            std::lock_guard<std::mutex> lock(_mutex);
+            auto it = _ready.find(page);
+            if ((it == _ready.end()) || !it->second.hasImage || !(it->second.request.render == render)) return false;
+            out = std::move(it->second.image);
+            it->second.hasImage = false;
+            _release(it);
+
+            return true;
+        }
+
+        // Moves prepared text with the given split options into out.
+        bool takeText(unsigned int page, bool splitSentences, bool splitParagraphs, fsl::text::textCorpus& out)
+        {
+            std::lock_guard<std::mutex> lock(_mutex);
+            auto it = _ready.find(page);
+            if ((it == _ready.end()) || !it->second.hasText) return false;
+            if ((it->second.request.splitSentences != splitSentences) || (it->second.request.splitParagraphs != splitParagraphs)) return false;
+            out = std::move(it->second.text);
+            it->second.hasText = false;
+            _release(it);
+
+            return true;
+        }
+
+    private:
+        // Recounts an entry after part of it has been taken, and drops it once it is empty. The lock is held.
+        void _release(std::map<unsigned int, _entry>::iterator it)
+        {
+            _entry& entry = it->second;
+            _bytes -= entry.bytes;
+            entry.bytes = (entry.hasImage ? entry.image.size() : 0) + (entry.hasText ? _size(entry.text) : 0);
+            _bytes += entry.bytes;
+            if (!entry.hasImage && !entry.hasText) _ready.erase(it);
+            _wake.notify_one();
+        }
+    };
+}
+
+#endif // _PAGE_PREFETCHER_HPP_
@@ -0,0 +1,539 @@
+/**************************************************************************
+A PDF document that can be shared between threads, and handles to its pages.
+
+Copyright (C) 2021 Chris Morrison (gnosticist@protonmail.com)
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <http://www.gnu.org/licenses/>.
+**************************************************************************/
+
+#ifndef _PDF_DOCUMENT_HPP_
+#define _PDF_DOCUMENT_HPP_
+
+#include <algorithm>
+#include <climits>
+#include <cmath>
+#include <filesystem>
+#include <functional>
+#include <memory>
+#include <memory_resource>
+#include <mutex>
+#include <stdexcept>
+#include <string>
+#include <thread>
+#include <vector>
+#include <poppler/cpp/poppler-document.h>
+#include <poppler/cpp/poppler-page.h>
+#include <poppler/cpp/poppler-page-renderer.h>
+#include <poppler/cpp/poppler-image.h>
+#include <podofo/podofo.h>
+
+#include "fileMapping.hpp"
+#include "imageUtils.hpp"
+#include "textCorpus.hpp"
+#include "pdfTextExtractor.hpp"
+#include "instrumentation.hpp"
+
+#ifdef _MSC_VER
+//#include <windows.h>
+//#include <atlbase.h>
+//#include <comdef.h>
+//#include <comutil.h>
+//#include <strsafe.h>
+#ifdef DEBUG
+#pragma comment(lib, "libpng16d.lib")
+#pragma comment(lib, "jpegd.lib")
+#pragma comment(lib, "tiffd.lib")
+#pragma comment(lib, "tiffxxd.lib")
+#pragma comment(lib, "poppler.lib")
+#pragma comment(lib, "poppler-cpp.lib")
+#pragma comment(lib, "podofo.lib")
+#else
+#pragma comment(lib, "libpng16.lib")
+#pragma comment(lib, "jpeg62.lib")
+#pragma comment(lib, "tiff.lib")
+#pragma comment(lib, "tiffxx.lib")
+#pragma comment(lib, "poppler.lib")
+#pragma comment(lib, "poppler-cpp.lib")
+#pragma comment(lib, "podofo.lib")
+#endif
+#endif
+
+namespace fsl::text
+{
+    enum class imageFormat
+    {
+        png,
+        tiff,
+        jpeg,
+    };
+
+    // The engine used to extract the text of a PDF. Poppler is always used for rendering, extracting the text
+    // with it as well avoids parsing the document a second time with PoDoFo.
+    enum class textBackend
+    {
+        podofo,
+        poppler,
+    };
+}
+
+namespace fsl::_private
+{
+    // Rasterizes a poppler page, the image is not valid if the page could not be rendered.
+    inline poppler::image _rasterizePopplerPage(const poppler::page& page, double dpi, poppler::image::format_enum pixels)
+    {
+        FSL_INSTRUMENT_PHASE(rasterize);
+        poppler::page_renderer pageRenderer;
+        pageRenderer.set_image_format(pixels);
+        pageRenderer.set_render_hint(poppler::page_renderer::render_hint::antialiasing);
+        pageRenderer.set_render_hint(poppler::page_renderer::render_hint::text_antialiasing);
+        pageRenderer.set_render_hint(poppler::page_renderer::render_hint::text_hinting);
+
+        return pageRenderer.render_page(&page, dpi, dpi);
+    }
+
+    // Encodes a rasterized page into the given image format.
+    template <typename Buffer>
+    inline void _encodePopplerImage(const poppler::image& data, fsl::text::imageFormat format, bool compress, Buffer& out)
+    {
+        FSL_INSTRUMENT_PHASE(encode);
+#ifdef FSL_ENABLE_INSTRUMENTATION
+        size_t size = out.size();
+        size_t capacity = out.capacity();
+#endif
+        if (data.is_valid())
+        {
+            if (format == fsl::text::imageFormat::png)
+            {
+                _make_png(reinterpret_cast<const uint8_t*>(data.const_data()), out, data.width(), data.height(), compress);
+            }
+            else if (format == fsl::text::imageFormat::tiff)
+            {
+                _make_tiff(reinterpret_cast<const uint8_t*>(data.const_data()), out, data.width(), data.height(), compress);
+            }
+            else if (format == fsl::text::imageFormat::jpeg)
+            {
+                _make_jpeg(reinterpret_cast<const uint8_t*>(data.const_data()), out, data.width(), data.height(), compress);
+            }
+        }
+        FSL_INSTRUMENT_COUNT(bytesEncoded, out.size() - std::min(size, out.size()));
+        FSL_INSTRUMENT_COUNT(allocations, out.capacity() != capacity);
+    }
+
+    // Renders a poppler page into the given image format.
+    template <typename Buffer>
+    inline void _renderPopplerPage(const poppler::page& page, double dpi, poppler::image::format_enum pixels, fsl::text::imageFormat format, bool compress, Buffer& out)
+    {
+        _encodePopplerImage(_rasterizePopplerPage(page, dpi, pixels), format, compress, out);
+    }
+
+    // The resolution at which a page fills a viewport, along its long side. Zero if the page is neither
+    // landscape nor portrait.
+    inline double _fittedDpi(const poppler::page& page, unsigned int viewportWidth, unsigned int viewportHeight)
+    {
+        auto w = page.page_rect(poppler::page_box_enum::media_box).width();
+        auto h = page.page_rect(poppler::page_box_enum::media_box).height();
+        double widthInches = w / 72.00;
+        double heightInches = h / 72.00;
+
+        if (page.orientation() == poppler::page::landscape) return static_cast<double>(viewportWidth) / widthInches;
+        if (page.orientation() == poppler::page::portrait) return static_cast<double>(viewportHeight) / heightInches;
+
+        return 0;
+    }
+
+    // Passes the words of a page, as laid out by poppler, to out with the spacing between them.
+    inline void _popplerPageText(const poppler::page& page, const _pdfTextExtractor::sink& out)
+    {
+        FSL_INSTRUMENT_PHASE(tokenize);
+        // Poppler measures down from the top of the page, the layout is in PDF user space.
+        double pageHeight = page.page_rect().height();
+        bool first = true;
+        bool spaceAfter = false;
+        double lastTop = 0;
+        double lastBottom = 0;
+        double lastHeight = 0;
+        std::wstring text;
+        for (const auto& word : page.text_list())
+        {
+            auto r = word.bbox();
+            if (!first)
+            {
+                // A word that does not share the vertical extent of the last starts a new line, a gap of more than
+                // a line starts a new paragraph.
+                double height = std::max(r.height(), lastHeight);
+                if (std::fabs(r.top() - lastTop) > height / 2)
+                {
+                    out((r.top() - lastBottom > height) ? L"\n\n" : L"\n", nullptr);
+                }
+                else if (spaceAfter)
+                {
+                    out(L" ", nullptr);
+                }
+            }
+            first = false;
+            spaceAfter = word.has_space_after();
+            lastTop = r.top();
+            lastBottom = r.bottom();
+            lastHeight = r.height();
+
+            auto u = word.text();
+            text.clear();
+            _append_utf16(text, u.data(), u.size());
+            fsl::text::textLayout::box box = { static_cast<float>(r.left()), static_cast<float>(pageHeight - r.bottom()), static_cast<float>(r.right()), static_cast<float>(pageHeight - r.top()) };
+            out(text, &box);
+        }
+    }
+
+    // Builds the items and layout of a page from the text extract passes to its sink. The text is fed to the
+    // parser as it is decoded instead of being collected for the whole page first. On error the corpus is left
+    // empty.
+    inline void _buildPageText(fsl::text::textCorpus& tc, bool splitSentences, bool splitParagraphs, const std::function<void(const _pdfTextExtractor::sink&)>& extract)
+    {
+        tc.clear();
+        tc.setSplitSentences(splitSentences);
+        tc.setSplitParagraphs(splitParagraphs);
+        fsl::text::textLayout& layout = tc.layout();
+
+        fsl::text::textCorpus::parser parser(tc, true);
+        try
+        {
+            extract([&](const std::wstring& text, const fsl::text::textLayout::box* box)
+                {
+                    parser.feed(text);
+                    if (box) layout.addRun(text, *box);
+                });
+            parser.finish();
+            layout.index(tc);
+        }
+        catch (...)
+        {
+            tc.clear();
+            throw;
+        }
+    }
+
+    // Builds the items and layout of a page from text collected earlier.
+    inline void _parsePageText(fsl::text::textCorpus& tc, bool splitSentences, bool splitParagraphs, const std::vector<_pdfTextPiece>& pieces)
+    {
+        _buildPageText(tc, splitSentences, splitParagraphs, [&](const _pdfTextExtractor::sink& out)
+            {
+                for (const auto& piece : pieces) out(piece.text, piece.hasBox ? &piece.box : nullptr);
+            });
+    }
+}
+
+namespace fsl::text
+{
+    class pdfPage;
+    class pagePipeline;
+
+    // An open PDF that any number of threads can use at once through pdfPage handles. The document itself does
+    // not change after it has been opened; the text of each page is extracted once per set of split options
+    // and cached, guarded by a lock per page. Rendering uses a pool of poppler documents over one memory
+    // mapping of the file, so pages render in parallel. Text extraction with PoDoFo is serialised, with the
+    // poppler backend it runs in parallel too.
+    class pdfDocument : public std::enable_shared_from_this<pdfDocument>
+    {
+        friend class pdfPage;
+        friend class pagePipeline;
+
+    private:
+        struct _pageText
+        {
+            std::mutex mutex;
+            std::shared_ptr<const textCorpus> text[4];  // Indexed by the split options.
+        };
+
+        std::filesystem::path _path;
+        std::string _ownerPassword;
+        std::string _userPassword;
+        textBackend _backend;
+        unsigned int _numberOfPages = 0;
+        std::shared_ptr<fsl::_private::_fileMapping> _mapping;
+        std::unique_ptr<_pageText[]> _pages;
+
+        // Idle poppler documents, a poppler document must not be used by two threads at once.
+        mutable std::mutex _poolMutex;
+        mutable std::vector<std::unique_ptr<poppler::document>> _idle;
+        size_t _maxIdle;
+
+        mutable std::mutex _podofoMutex;
+        mutable PoDoFo::PdfMemDocument _pdf;
+        mutable fsl::_private::_pdfTextExtractor _extractor{ _pdf };
+
+        // Returns a poppler document to the pool when it goes out of scope.
+        class _lease
+        {
+        private:
+            const pdfDocument& _owner;
+            std::unique_ptr<poppler::document> _doc;
+        public:
+            explicit _lease(const pdfDocument& owner) : _owner(owner), _doc(owner._acquire())
+            {
+            }
+
+            ~_lease()
+            {
+                _owner._release(std::move(_doc));
+            }
+
+            _lease(const _lease&) = delete;
+            _lease& operator=(const _lease&) = delete;
+
+            poppler::document* operator->() const
+            {
+                return _doc.get();
+            }
+        };
+
+        std::unique_ptr<poppler::document> _load() const
+        {
+            poppler::document* doc = nullptr;
+            if (_mapping->size() <= static_cast<size_t>(INT_MAX))
+            {
+                doc = poppler::document::load_from_raw_data(reinterpret_cast<const char*>(_mapping->data()), static_cast<int>(_mapping->size()), _ownerPassword, _userPassword);
+            }
+            else
+            {
+                doc = poppler::document::load_from_file(_path.string(), _ownerPassword, _userPassword);
+            }
+            if (!doc) throw std::runtime_error("The given PDF file could not be opened, it may be damaged or invalid.");
+
+            return std::unique_ptr<poppler::document>(doc);
+        }
+
+        std::unique_ptr<poppler::document> _acquire() const
+        {
+            {
+                std::lock_guard<std::mutex> lock(_poolMutex);
+                if (!_idle.empty())
+                {
+                    auto doc = std::move(_idle.back());
+                    _idle.pop_back();
+                    return doc;
+                }
+            }
+
+            return _load();
+        }
+
+        void _release(std::unique_ptr<poppler::document> doc) const
+        {
+            if (!doc) return;
+            std::lock_guard<std::mutex> lock(_poolMutex);
+            if (_idle.size() < _maxIdle) _idle.push_back(std::move(doc));
+        }
+
+        // Passes the text of a page to the extract function of _buildPageText() with the text backend.
+        void _extractText(unsigned int page, const fsl::_private::_pdfTextExtractor::sink& out) const
+        {
+            if (_backend == textBackend::poppler)
+            {
+                _lease doc(*this);
+                std::unique_ptr<poppler::page> pageRef(doc->create_page(static_cast<int>(page - 1)));
+                if (!pageRef) throw std::runtime_error("Error parsing PDF file!");
+                fsl::_private::_popplerPageText(*pageRef, out);
+            }
+            else
+            {
+                std::lock_guard<std::mutex> lock(_podofoMutex);
+                _extractor.extractPage(_pdf.GetPage(static_cast<int>(page - 1)), out);
+            }
+        }
+
+        std::shared_ptr<const textCorpus> _extract(unsigned int page, bool splitSentences, bool splitParagraphs) const
+        {
+            auto tc = std::make_shared<textCorpus>();
+            fsl::_private::_buildPageText(*tc, splitSentences, splitParagraphs, [&](const fsl::_private::_pdfTextExtractor::sink& out) { _extractText(page, out); });
+
+            return tc;
+        }
+
+        // The cached text of a page for the split options, null if it has not been extracted.
+        std::shared_ptr<const textCorpus> _cachedText(unsigned int page, bool splitSentences, bool splitParagraphs) const
+        {
+            auto& slot = _pages[page - 1];
+            std::lock_guard<std::mutex> lock(slot.mutex);
+
+            return slot.text[(splitSentences ? 1 : 0) | (splitParagraphs ? 2 : 0)];
+        }
+
+        // Caches the text of a page extracted elsewhere, unless another thread got there first. Returns the text
+        // now cached.
+        std::shared_ptr<const textCorpus> _cacheText(unsigned int page, bool splitSentences, bool splitParagraphs, std::shared_ptr<const textCorpus> text) const
+        {
+            auto& slot = _pages[page - 1];
+            std::lock_guard<std::mutex> lock(slot.mutex);
+            auto& tc = slot.text[(splitSentences ? 1 : 0) | (splitParagraphs ? 2 : 0)];
+            if (!tc) tc = std::move(text);
+
+            return tc;
+        }
+
+        pdfDocument(const std::filesystem::path& pdfFile, const std::string& owner_password, const std::string& user_password, textBackend backend)
+            : _path(pdfFile), _ownerPassword(owner_password), _userPassword(user_password), _backend(backend)
+        {
+            FSL_INSTRUMENT_PAGE(this, 0);
+            FSL_INSTRUMENT_PHASE(load);
+            _maxIdle = std::max(1u, std::thread::hardware_concurrency());
+            _mapping = std::make_shared<fsl::_private::_fileMapping>(pdfFile);
+            auto doc = _load();
+            _numberOfPages = static_cast<unsigned int>(doc->pages());
+            _release(std::move(doc));
+            _pages.reset(new _pageText[_numberOfPages]);
+
+            if (_backend == textBackend::podofo)
+            {
+                if (!owner_password.empty()) _pdf.SetPassword(owner_password);
+                if (!user_password.empty()) _pdf.SetPassword(user_password);
+                _pdf.Load(pdfFile.wstring().c_str());
+            }
+        }
+
+    public:
+        pdfDocument(const pdfDocument&) = delete;
+        pdfDocument& operator=(const pdfDocument&) = delete;
+
+        // Opens a PDF, throws if it does not exist or cannot be opened. With the poppler text backend the
+        // document is not loaded into PoDoFo at all.
+        static std::shared_ptr<pdfDocument> open(const std::filesystem::path& pdfFile, const std::string& owner_password = std::string(), const std::string& user_password = std::string(), textBackend backend = textBackend::podofo)
+        {
+            if (!std::filesystem::exists(pdfFile)) throw std::runtime_error("pdfFile does not exist.");
+
+            return std::shared_ptr<pdfDocument>(new pdfDocument(pdfFile, owner_password, user_password, backend));
+        }
+
+        [[nodiscard]] const std::filesystem::path& path() const noexcept
+        {
+            return _path;
+        }
+
+        [[nodiscard]] textBackend backend() const noexcept
+        {
+            return _backend;
+        }
+
+        [[nodiscard]] unsigned int numberOfPages() const noexcept
+        {
+            return _numberOfPages;
+        }
+
+        // A handle to a page, numbered from 1. The handle keeps the document open.
+        [[nodiscard]] pdfPage page(unsigned int number) const;
+    };
+
+    // A lightweight handle to a page of a pdfDocument. Handles can be copied freely and used from any thread.
+    class pdfPage
+    {
+    private:
+        std::shared_ptr<const pdfDocument> _doc;
+        unsigned int _number;
+
+        template <typename Buffer>
+        void _render(double dpi, imageFormat format, bool compress, Buffer& out) const
+        {
+            FSL_INSTRUMENT_PAGE(_doc.get(), _number);
+            pdfDocument::_lease doc(*_doc);
+            std::unique_ptr<poppler::page> pageRef(doc->create_page(static_cast<int>(_number - 1)));
+            if (pageRef) fsl::_private::_renderPopplerPage(*pageRef, dpi, poppler::image::format_rgb24, format, compress, out);
+        }
+
+        template <typename Buffer>
+        void _renderFitted(unsigned int viewportWidth, unsigned int viewportHeight, imageFormat format, bool compress, Buffer& out) const
+        {
+            FSL_INSTRUMENT_PAGE(_doc.get(), _number);
+            pdfDocument::_lease doc(*_doc);
+            std::unique_ptr<poppler::page> pageRef(doc->create_page(static_cast<int>(_number - 1)));
+            if (!pageRef) return;
+            double dpi = fsl::_private::_fittedDpi(*pageRef, viewportWidth, viewportHeight);
+            if (dpi > 0) fsl::_private::_renderPopplerPage(*pageRef, dpi, poppler::image::format_argb32, format, compress, out);
+        }
+
+    public:
+        pdfPage(std::shared_ptr<const pdfDocument> doc, unsigned int number) : _doc(std::move(doc)), _number(number)
+        {
+            if (!_doc) throw std::invalid_argument("doc is null.");
+            if ((number == 0) || (number > _doc->numberOfPages())) throw std::invalid_argument("page out of range.");
+        }
+
+        [[nodiscard]] unsigned int number() const noexcept
+        {
+            return _number;
+        }
+
+        [[nodiscard]] const pdfDocument& document() const noexcept
+        {
+            return *_doc;
+        }
+
+        // The text of the page, extracted on first use with the given options and shared by all the handles to
+        // the page. Threads asking for the same page wait for one extraction.
+        [[nodiscard]] std::shared_ptr<const textCorpus> text(bool splitSentences = true, bool splitParagraphs = true) const
+        {
+            FSL_INSTRUMENT_PAGE(_doc.get(), _number);
+            auto& slot = _doc->_pages[_number - 1];
+            std::lock_guard<std::mutex> lock(slot.mutex);
+            auto& tc = slot.text[(splitSentences ? 1 : 0) | (splitParagraphs ? 2 : 0)];
+            if (!tc) tc = _doc->_extract(_number, splitSentences, splitParagraphs);
+
+            return tc;
+        }
+
+        [[nodiscard]] std::vector<uint8_t> render(double dpi, imageFormat format, bool compress = true) const
+        {
+            std::vector<uint8_t> data;
+            _render(dpi, format, compress, data);
+
+            return data;
+        }
+
+        // Renders into out, allocating from its memory resource.
+        void render(double dpi, imageFormat format, bool compress, std::pmr::vector<uint8_t>& out) const
+        {
+            _render(dpi, format, compress, out);
+        }
+
+        // An estimate of the memory the pixels of the page take when rendered at dpi, before encoding.
+        [[nodiscard]] size_t rasterBytes(double dpi) const
+        {
+            pdfDocument::_lease doc(*_doc);
+            std::unique_ptr<poppler::page> pageRef(doc->create_page(static_cast<int>(_number - 1)));
+            if (!pageRef) return 0;
+            auto r = pageRef->page_rect(poppler::page_box_enum::media_box);
+
+            return static_cast<size_t>(std::ceil(r.width() * dpi / 72.0)) * static_cast<size_t>(std::ceil(r.height() * dpi / 72.0)) * 4;
+        }
+
+        // Renders the page to fill a viewport along its long side.
+        [[nodiscard]] std::vector<uint8_t> renderFitted(unsigned int viewportWidth, unsigned int viewportHeight, imageFormat format, bool compress = true) const
+        {
+            std::vector<uint8_t> data;
+            _renderFitted(viewportWidth, viewportHeight, format, compress, data);
+
+            return data;
+        }
+
+        void renderFitted(unsigned int viewportWidth, unsigned int viewportHeight, imageFormat format, bool compress, std::pmr::vector<uint8_t>& out) const
+        {
+            _renderFitted(viewportWidth, viewportHeight, format, compress, out);
+        }
+    };
+
+    inline pdfPage pdfDocument::page(unsigned int number) const
+    {
+        return pdfPage(shared_from_this(), number);
+    }
+}
+
+#endif // _PDF_DOCUMENT_HPP_
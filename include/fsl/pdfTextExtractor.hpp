@@ -0,0 +1,504 @@
+/**************************************************************************
+Extracts the text, and its position, from the content streams of a PDF.
+
+Copyright (C) 2021 Chris Morrison (gnosticist@protonmail.com)
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <http://www.gnu.org/licenses/>.
+**************************************************************************/
+
+#ifndef _PDF_TEXT_EXTRACTOR_HPP_
+#define _PDF_TEXT_EXTRACTOR_HPP_
+
+#include <cmath>
+#include <cstring>
+#include <functional>
+#include <deque>
+#include <map>
+#include <memory>
+#include <memory_resource>
+#include <set>
+#include <stack>
+#include <string>
+#include <sstream>
+#include <stdexcept>
+#include <vector>
+#include <podofo/podofo.h>
+
+#include "hashUtils.hpp"
+#include "pdfTextState.hpp"
+#include "textLayout.hpp"
+#include "instrumentation.hpp"
+
+namespace fsl::_private
+{
+    // A piece of text in the order it was decoded. Pieces without a box are spacing inserted by the extractor.
+    struct _pdfTextPiece
+    {
+        std::wstring text;
+        bool hasBox;
+        fsl::text::textLayout::box box;
+    };
+
+    // Interprets the text operators of page content streams. Form XObjects drawn with Do are interpreted once
+    // per document, the pieces of text they produce are cached by object reference and replayed, under the
+    // transformation in effect where they are drawn, on every page that uses them. A form without resources of
+    // its own is interpreted with those of whatever draws it, so it is cached once per resource dictionary.
+    class _pdfTextExtractor
+    {
+    public:
+        // Receives each piece of text as it is decoded, box is null for spacing.
+        using sink = std::function<void(const std::wstring& text, const fsl::text::textLayout::box* box)>;
+
+    private:
+        static constexpr int _max_form_depth = 8;
+
+        // A form and the resources it borrows, null if it has its own.
+        using _formKey = std::pair<PoDoFo::PdfReference, const PoDoFo::PdfObject*>;
+
+        PoDoFo::PdfMemDocument& _pdf;
+        std::map<_formKey, std::vector<_pdfTextPiece>> _forms;
+        std::set<PoDoFo::PdfReference> _active;    // Forms being interpreted, to break cycles.
+
+        // The operand and graphics state stacks of every page come and go with the page, they are allocated from
+        // a pool that keeps its blocks for the next page. An extractor is only used by one thread at a time.
+        std::pmr::unsynchronized_pool_resource _pool;
+
+        static PoDoFo::PdfObject* _resource(PoDoFo::PdfObject* resources, const char* type, const PoDoFo::PdfName& name)
+        {
+            if (!resources || !resources->IsDictionary()) return nullptr;
+            PoDoFo::PdfObject* dict = resources->GetIndirectKey(PoDoFo::PdfName(type));
+            if (!dict || !dict->IsDictionary()) return nullptr;
+
+            return dict->GetIndirectKey(name);
+        }
+
+        static std::wstring _adjustTextCursor(double old_tx, double old_ty, double tx, double ty, double tr, double sw)
+        {
+            std::wstringstream wss;
+            // If the old coordinates are zero we have just entered the document and there is nothing to compare with.
+
+            // Check if a space is required.
+            if ((old_tx != 0) && (sw > 0))
+            {
+                auto diff = fabs(old_tx - tx);
+                if (diff >= sw) wss << L' ';
+            }
+
+            // See if a newline is required.
+            if ((old_ty != 0) && (tr == 0))
+            {
+                auto diff = fabs(old_ty - ty);
+                if (diff > 5.00) wss << L'\n';
+            }
+
+            return wss.str();
+        }
+
+        // The cached pieces of a form, interpreting it on first use. Returns null if the object is not a form or
+        // is already being interpreted further up.
+        const std::vector<_pdfTextPiece>* _form(const PoDoFo::PdfReference& ref, PoDoFo::PdfObject* pageResources, int depth)
+        {
+            PoDoFo::PdfObject* form = _pdf.GetObjects().GetObject(ref);
+            if (!form || !form->IsDictionary() || !form->HasStream()) return nullptr;
+
+            // Forms should have their own resources but many producers rely on those of the page.
+            PoDoFo::PdfObject* resources = form->GetIndirectKey(PoDoFo::PdfName("Resources"));
+            _formKey key(ref, resources ? nullptr : pageResources);
+            if (!resources) resources = pageResources;
+
+            auto cached = _forms.find(key);
+            if (cached != _forms.end()) return &cached->second;
+            if ((depth >= _max_form_depth) || _active.count(ref)) return nullptr;
+            PoDoFo::PdfObject* subtype = form->GetDictionary().GetKey(PoDoFo::PdfName("Subtype"));
+            if (!subtype || !subtype->IsName() || (subtype->GetName() != PoDoFo::PdfName("Form"))) return nullptr;
+
+            char* buffer = nullptr;
+            PoDoFo::pdf_long length = 0;
+            form->GetStream()->GetFilteredCopy(&buffer, &length);
+            std::unique_ptr<char, void(*)(void*)> owner(buffer, PoDoFo::podofo_free);
+
+            std::vector<_pdfTextPiece> pieces;
+            _active.insert(ref);
+            try
+            {
+                PoDoFo::PdfContentsTokenizer tok(buffer, length);
+                _interpret(tok, resources, [&](const std::wstring& text, const fsl::text::textLayout::box* box)
+                    {
+                        pieces.push_back({ text, box != nullptr, box ? *box : fsl::text::textLayout::box{ 0, 0, -1, -1 } });
+                    }, depth + 1);
+            }
+            catch (...)
+            {
+                _active.erase(ref);
+                throw;
+            }
+            _active.erase(ref);
+
+            return &_forms.emplace(key, std::move(pieces)).first->second;
+        }
+
+        static uint64_t _hashStream(PoDoFo::PdfObject* obj, uint64_t h)
+        {
+            if (!obj || !obj->HasStream()) return h;
+            char* buffer = nullptr;
+            PoDoFo::pdf_long length = 0;
+            obj->GetStream()->GetCopy(&buffer, &length);
+            std::unique_ptr<char, void(*)(void*)> owner(buffer, PoDoFo::podofo_free);
+
+            return _fnv1a(buffer, static_cast<size_t>(length), _fnv1a(static_cast<uint64_t>(length), h));
+        }
+
+        // Hashes a resource dictionary as written, which names the objects it uses by reference, and the content
+        // of the forms it uses, recursively.
+        uint64_t _hashResources(PoDoFo::PdfObject* resources, uint64_t h, std::set<PoDoFo::PdfReference>& visited, int depth)
+        {
+            if (!resources) return h;
+            std::string data;
+            resources->ToString(data);
+            h = _fnv1a(data.data(), data.size(), h);
+
+            PoDoFo::PdfObject* xobjects = resources->IsDictionary() ? resources->GetIndirectKey(PoDoFo::PdfName("XObject")) : nullptr;
+            if (!xobjects || !xobjects->IsDictionary() || (depth >= _max_form_depth)) return h;
+            for (const auto& [name, entry] : xobjects->GetDictionary().GetKeys())
+            {
+                if (!entry || !entry->IsReference() || !visited.insert(entry->GetReference()).second) continue;
+                PoDoFo::PdfObject* form = _pdf.GetObjects().GetObject(entry->GetReference());
+                PoDoFo::PdfObject* subtype = (form && form->IsDictionary()) ? form->GetDictionary().GetKey(PoDoFo::PdfName("Subtype")) : nullptr;
+                if (!subtype || !subtype->IsName() || (subtype->GetName() != PoDoFo::PdfName("Form"))) continue;
+                form->ToString(data);
+                h = _fnv1a(data.data(), data.size(), h);
+                h = _hashStream(form, h);
+                h = _hashResources(form->GetIndirectKey(PoDoFo::PdfName("Resources")), h, visited, depth + 1);
+            }
+
+            return h;
+        }
+
+        void _interpret(PoDoFo::PdfContentsTokenizer& tok, PoDoFo::PdfObject* resources, const sink& out, int depth)
+        {
+            std::stack<PoDoFo::PdfVariant, std::pmr::deque<PoDoFo::PdfVariant>> stack{ std::pmr::deque<PoDoFo::PdfVariant>(&_pool) };
+            PoDoFo::PdfFont* pCurFont = nullptr;
+            double old_tx = 0;
+            double old_ty = 0;
+            double tx = 0;
+            double ty = 0;
+            double spaceWidth = 0;
+            // Font metrics are shared by every page and form that uses the font and are left at whatever size
+            // they were created with, their widths are scaled from that size to the one set by Tf.
+            double fontScale = 0;
+
+            // The position of the text for the layout, tracked separately as tx/ty only drive the spacing above.
+            _pdfTextState state;
+            std::stack<_pdfMatrix, std::pmr::vector<_pdfMatrix>> saved{ std::pmr::vector<_pdfMatrix>(&_pool) };
+
+            const auto addRun = [&](const std::wstring& text, double width)
+            {
+                double ascent = state.fontSize;
+                double descent = 0;
+                if (pCurFont)
+                {
+                    ascent = pCurFont->GetFontMetrics()->GetAscent() * fontScale;
+                    descent = pCurFont->GetFontMetrics()->GetDescent() * fontScale;
+                }
+                auto box = state.run(width, ascent, descent);
+                out(text, &box);
+                state.advance(width);
+            };
+            const auto feed = [&](const std::wstring& text)
+            {
+                if (!text.empty()) out(text, nullptr);
+            };
+            const auto show = [&](const PoDoFo::PdfString& str)
+            {
+                if (pCurFont)
+                {
+                    PoDoFo::PdfString unicode = pCurFont->GetEncoding()->ConvertToUnicode(str, pCurFont);
+                    double width = pCurFont->GetFontMetrics()->StringWidth(unicode) * fontScale;
+                    addRun(unicode.GetStringW(), width);
+                    tx = tx + width;
+                }
+                else
+                {
+                    auto text = str.GetStringW();
+                    addRun(text, 0.5 * state.fontSize * text.size());
+                }
+            };
+
+            const char* token = nullptr;
+            PoDoFo::PdfVariant var;
+            PoDoFo::EPdfContentsType type;
+            bool inTextObject = false;
+
+            while (tok.ReadNext(type, token, var))
+            {
+                // BT*, ET*, Td*, TD*, Ts, Tz, T, Tm*, Tf*, ", ', Tj, TJ, q, Q, cm and Do
+                switch (type)
+                {
+                case PoDoFo::ePdfContentsType_Keyword:
+                    if (!token) throw std::runtime_error("Error parsing PDF file!"); // Should not happen, but always check.
+                    FSL_INSTRUMENT_COUNT(operatorsProcessed, 1);
+                    if (std::strcmp(token, "q") == 0) saved.push(state.ctm);
+                    if (std::strcmp(token, "Q") == 0)
+                    {
+                        if (!saved.empty())
+                        {
+                            state.ctm = saved.top();
+                            saved.pop();
+                        }
+                    }
+                    if (std::strcmp(token, "cm") == 0)
+                    {
+                        if (stack.size() != 6) throw std::runtime_error("Error parsing PDF file!");
+                        _pdfMatrix m;
+                        m.f = stack.top().GetReal(); stack.pop();
+                        m.e = stack.top().GetReal(); stack.pop();
+                        m.d = stack.top().GetReal(); stack.pop();
+                        m.c = stack.top().GetReal(); stack.pop();
+                        m.b = stack.top().GetReal(); stack.pop();
+                        m.a = stack.top().GetReal();
+                        state.ctm = m.then(state.ctm);
+                    }
+                    if (std::strcmp(token, "Do") == 0)
+                    {
+                        if ((stack.size() != 1) || !stack.top().IsName()) throw std::runtime_error("Error parsing PDF file!");
+                        PoDoFo::PdfObject* xobjects = (resources && resources->IsDictionary()) ? resources->GetIndirectKey(PoDoFo::PdfName("XObject")) : nullptr;
+                        PoDoFo::PdfObject* entry = (xobjects && xobjects->IsDictionary()) ? xobjects->GetDictionary().GetKey(stack.top().GetName()) : nullptr;
+                        const std::vector<_pdfTextPiece>* pieces = (entry && entry->IsReference()) ? _form(entry->GetReference(), resources, depth) : nullptr;
+                        if (pieces && !pieces->empty())
+                        {
+                            // Place the form under the current transformation, keeping its text apart from the page's.
+                            _pdfMatrix m = state.ctm;
+                            PoDoFo::PdfObject* matrix = _pdf.GetObjects().GetObject(entry->GetReference())->GetIndirectKey(PoDoFo::PdfName("Matrix"));
+                            if (matrix && matrix->IsArray() && (matrix->GetArray().GetSize() == 6))
+                            {
+                                const auto& arr = matrix->GetArray();
+                                m = _pdfMatrix{ arr[0].GetReal(), arr[1].GetReal(), arr[2].GetReal(), arr[3].GetReal(), arr[4].GetReal(), arr[5].GetReal() }.then(state.ctm);
+                            }
+                            feed(L"\n");
+                            for (const auto& piece : *pieces)
+                            {
+                                if (!piece.hasBox)
+                                {
+                                    out(piece.text, nullptr);
+                                    continue;
+                                }
+                                auto box = m.identity() ? piece.box : m.apply(piece.box);
+                                out(piece.text, &box);
+                            }
+                            feed(L"\n");
+                        }
+                    }
+                    if (std::strcmp(token, "BT") == 0)
+                    {
+                        inTextObject = true;
+                        state.beginText();
+                    }
+                    if (std::strcmp(token, "ET") == 0) inTextObject = false;
+                    if (std::strcmp(token, "Tc") == 0)
+                    {
+                        if (!inTextObject || (stack.size() != 1)) throw std::runtime_error("Error parsing PDF file!");
+                    }
+                    if (std::strcmp(token, "Tw") == 0)
+                    {
+                        if (!inTextObject || (stack.size() != 1)) throw std::runtime_error("Error parsing PDF file!");
+                    }
+                    if (std::strcmp(token, "Ts") == 0)
+                    {
+                        // Changes the text rise should not trigger a newline.
+                        if (!inTextObject || (stack.size() != 1)) throw std::runtime_error("Error parsing PDF file!");
+                        state.rise = stack.top().GetReal();
+                    }
+                    if (std::strcmp(token, "Tz") == 0)
+                    {
+                        // Text state, also allowed outside a text object.
+                        if (stack.size() != 1) throw std::runtime_error("Error parsing PDF file!");
+                        state.horizontalScale = stack.top().GetReal() / 100.0;
+                    }
+                    if (std::strcmp(token, "Tf") == 0)
+                    {
+                        if (!inTextObject) throw std::runtime_error("Error parsing PDF file!");
+                        state.fontSize = stack.top().GetReal();
+                        stack.pop();
+                        PoDoFo::PdfName fontName = stack.top().GetName();
+                        FSL_INSTRUMENT_PHASE(fontLookup);
+                        PoDoFo::PdfObject* pFont = _resource(resources, "Font", fontName);
+                        pCurFont = pFont ? _pdf.GetFont(pFont) : nullptr;
+                        if (pCurFont)
+                        {
+                            const PoDoFo::PdfFontMetrics* metrics = pCurFont->GetFontMetrics();
+                            fontScale = (metrics->GetFontSize() > 0) ? state.fontSize / metrics->GetFontSize() : 0;
+                            spaceWidth = metrics->GetWordSpace();
+                            if (spaceWidth == 0) spaceWidth = metrics->UnicodeCharWidth(' ');
+                            if (spaceWidth == 0) spaceWidth = metrics->UnicodeCharWidth('W'); // Last resort.
+                            spaceWidth *= fontScale;
+                        }
+                    }
+                    if (std::strcmp(token, "TD") == 0)
+                    {
+                        if (!inTextObject || (stack.size() != 2)) throw std::runtime_error("Error parsing PDF file!");
+                        old_tx = tx;
+                        old_ty = ty;
+                        ty = stack.top().GetReal();
+                        stack.pop();
+                        tx = stack.top().GetReal();
+                        feed(_adjustTextCursor(old_tx, old_ty, tx, ty, state.rise, spaceWidth));
+                        state.leading = -ty;
+                        state.moveLine(tx, ty);
+                    }
+                    if (std::strcmp(token, "Tm") == 0)
+                    {
+                        if (!inTextObject || (stack.size() != 6)) throw std::runtime_error("Error parsing PDF file!");
+                        old_tx = tx;
+                        old_ty = ty;
+                        _pdfMatrix m;
+                        m.f = ty = stack.top().GetReal(); stack.pop();
+                        m.e = tx = stack.top().GetReal(); stack.pop();
+                        m.d = stack.top().GetReal(); stack.pop();
+                        m.c = stack.top().GetReal(); stack.pop();
+                        m.b = stack.top().GetReal(); stack.pop();
+                        m.a = stack.top().GetReal();
+                        feed(_adjustTextCursor(old_tx, old_ty, tx, ty, state.rise, spaceWidth));
+                        state.setMatrix(m);
+                    }
+                    if (std::strcmp(token, "Td") == 0)
+                    {
+                        if (!inTextObject || (stack.size() != 2)) throw std::runtime_error("Error parsing PDF file!");
+                        old_tx = tx;
+                        old_ty = ty;
+                        ty = stack.top().GetReal();
+                        stack.pop();
+                        tx = stack.top().GetReal();
+                        feed(_adjustTextCursor(old_tx, old_ty, tx, ty, state.rise, spaceWidth));
+                        state.moveLine(tx, ty);
+                    }
+                    if (std::strcmp(token, "TL") == 0)
+                    {
+                        // Text state, also allowed outside a text object.
+                        if (stack.size() != 1) throw std::runtime_error("Error parsing PDF file!");
+                        state.leading = stack.top().GetReal();
+                    }
+                    if (std::strcmp(token, "T*") == 0)
+                    {
+                        if (!inTextObject) throw std::runtime_error("Error parsing PDF file!");
+                        feed(L"\n");
+                        state.nextLine();
+                    }
+
+                    if ((std::strcmp(token, "'") == 0) || (std::strcmp(token, "\"") == 0))
+                    {
+                        if (!inTextObject) throw std::runtime_error("Error parsing PDF file!");
+                        feed(L"\n");
+                        state.nextLine();
+                        if (!stack.top().IsString()) throw std::runtime_error("Error parsing PDF file!");
+                        show(stack.top().GetString());
+                    }
+                    if (std::strcmp(token, "Tj") == 0)
+                    {
+                        if (!inTextObject) throw std::runtime_error("Error parsing PDF file!");
+                        if (!stack.top().IsString()) throw std::runtime_error("Error parsing PDF file!");
+                        show(stack.top().GetString());
+                    }
+                    if (std::strcmp(token, "TJ") == 0)
+                    {
+                        if (!inTextObject) throw std::runtime_error("Error parsing PDF file!");
+                        // Get the array.
+                        if (!stack.top().IsArray()) throw std::runtime_error("Error parsing PDF file!");
+                        PoDoFo::PdfArray& a = stack.top().GetArray();
+                        for (size_t i = 0; i < a.GetSize(); ++i)
+                        {
+                            if (a[i].IsString() || a[i].IsHexString())
+                            {
+                                show(a[i].GetString());
+                            }
+                            else if (a[i].IsNumber() || a[i].IsReal())
+                            {
+                                state.adjust(a[i].GetReal());
+                            }
+                        }
+                    }
+
+                    // Make sure the stack has been purged, even if we did not process the command.
+                    while (!stack.empty())
+                    {
+                        stack.pop();
+                    }
+                    break;
+                case PoDoFo::ePdfContentsType_Variant:
+                    stack.push(var);
+                    break;
+                default:
+                    throw std::runtime_error("Error parsing PDF file!");
+                    // Should not happen!
+                    break;
+                }
+            }
+        }
+
+    public:
+        // The pool takes its blocks from upstream.
+        explicit _pdfTextExtractor(PoDoFo::PdfMemDocument& pdf, std::pmr::memory_resource* upstream = std::pmr::get_default_resource()) : _pdf(pdf), _pool(upstream)
+        {
+        }
+
+        _pdfTextExtractor(const _pdfTextExtractor&) = delete;
+        _pdfTextExtractor& operator=(const _pdfTextExtractor&) = delete;
+
+        // Forgets the cached forms, call when a different document is loaded.
+        void clear()
+        {
+            _forms.clear();
+            _active.clear();
+        }
+
+        [[nodiscard]] size_t cachedForms() const
+        {
+            return _forms.size();
+        }
+
+        // A hash of everything the text of a page is extracted from: its content streams, its resources and the
+        // forms they use. An incremental update that does not touch a page leaves its hash unchanged. Objects
+        // the resources refer to, such as fonts, are covered by their reference rather than their content.
+        uint64_t sourceHash(PoDoFo::PdfPage* page)
+        {
+            uint64_t h = _fnv_offset;
+            PoDoFo::PdfObject* contents = page->GetContents();
+            if (contents && contents->IsArray())
+            {
+                for (const auto& part : contents->GetArray())
+                {
+                    h = _hashStream(part.IsReference() ? _pdf.GetObjects().GetObject(part.GetReference()) : nullptr, h);
+                }
+            }
+            else
+            {
+                h = _hashStream(contents, h);
+            }
+            std::set<PoDoFo::PdfReference> visited;
+            h = _hashResources(page->GetResources(), h, visited, 0);
+
+            // Zero means not known in the text cache.
+            return h ? h : 1;
+        }
+
+        // Passes the text of a page to out in the order it is drawn, including the text of the forms it uses.
+        void extractPage(PoDoFo::PdfPage* page, const sink& out)
+        {
+            FSL_INSTRUMENT_PHASE(tokenize);
+            PoDoFo::PdfContentsTokenizer tok(page);
+            _interpret(tok, page->GetResources(), out, 0);
+        }
+    };
+}
+
+#endif // _PDF_TEXT_EXTRACTOR_HPP_
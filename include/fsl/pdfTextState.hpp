@@ -0,0 +1,148 @@
+/**************************************************************************
+The text and line matrices of a PDF content stream and the boxes of the
+text it shows.
+
+Copyright (C) 2021 Chris Morrison (gnosticist@protonmail.com)
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <http://www.gnu.org/licenses/>.
+**************************************************************************/
+
+#ifndef _PDF_TEXT_STATE_HPP_
+#define _PDF_TEXT_STATE_HPP_
+
+#include "textLayout.hpp"
+
+namespace fsl::_private
+{
+    // A PDF transformation matrix [a b c d e f].
+    struct _pdfMatrix
+    {
+        double a = 1;
+        double b = 0;
+        double c = 0;
+        double d = 1;
+        double e = 0;
+        double f = 0;
+
+        [[nodiscard]] static _pdfMatrix translation(double tx, double ty)
+        {
+            return { 1, 0, 0, 1, tx, ty };
+        }
+
+        // This matrix followed by other, i.e. this x other.
+        [[nodiscard]] _pdfMatrix then(const _pdfMatrix& other) const
+        {
+            return { a * other.a + b * other.c, a * other.b + b * other.d,
+                     c * other.a + d * other.c, c * other.b + d * other.d,
+                     e * other.a + f * other.c + other.e, e * other.b + f * other.d + other.f };
+        }
+
+        // The axis aligned bounds of a transformed box.
+        [[nodiscard]] fsl::text::textLayout::box apply(const fsl::text::textLayout::box& bx) const
+        {
+            const double xs[4] = { bx.x0, bx.x1, bx.x0, bx.x1 };
+            const double ys[4] = { bx.y0, bx.y0, bx.y1, bx.y1 };
+            double x0 = 0, y0 = 0, x1 = 0, y1 = 0;
+            for (int i = 0; i < 4; ++i)
+            {
+                double x = a * xs[i] + c * ys[i] + e;
+                double y = b * xs[i] + d * ys[i] + f;
+                if ((i == 0) || (x < x0)) x0 = x;
+                if ((i == 0) || (x > x1)) x1 = x;
+                if ((i == 0) || (y < y0)) y0 = y;
+                if ((i == 0) || (y > y1)) y1 = y;
+            }
+
+            return { static_cast<float>(x0), static_cast<float>(y0), static_cast<float>(x1), static_cast<float>(y1) };
+        }
+
+        [[nodiscard]] bool identity() const
+        {
+            return (a == 1) && (b == 0) && (c == 0) && (d == 1) && (e == 0) && (f == 0);
+        }
+    };
+
+    // Where shown text lands on the page: the text matrix Tm, the line matrix Tlm and the text state and
+    // transformation that map text space to user space. Widths, ascents and descents are in text space units
+    // at the font size set by Tf, that is already multiplied by it, as the font metrics give them.
+    class _pdfTextState
+    {
+    private:
+        _pdfMatrix _tm;
+        _pdfMatrix _tlm;
+
+    public:
+        _pdfMatrix ctm;
+        double fontSize = 0;
+        double horizontalScale = 1;     // Tz, as a fraction rather than a percentage.
+        double rise = 0;
+        double leading = 0;
+
+        // BT.
+        void beginText()
+        {
+            _tm = _tlm = _pdfMatrix();
+        }
+
+        // Tm.
+        void setMatrix(const _pdfMatrix& m)
+        {
+            _tm = _tlm = m;
+        }
+
+        // Td, and TD after setting the leading.
+        void moveLine(double tx, double ty)
+        {
+            _tlm = _pdfMatrix::translation(tx, ty).then(_tlm);
+            _tm = _tlm;
+        }
+
+        // T*, ' and ".
+        void nextLine()
+        {
+            moveLine(0, -leading);
+        }
+
+        // The box in user space of text of the given width shown at the current position.
+        [[nodiscard]] fsl::text::textLayout::box run(double width, double ascent, double descent) const
+        {
+            fsl::text::textLayout::box bx = { 0, static_cast<float>(rise + descent), static_cast<float>(width * horizontalScale), static_cast<float>(rise + ascent) };
+            return _tm.then(ctm).apply(bx);
+        }
+
+        // Moves past text of the given width.
+        void advance(double width)
+        {
+            _tm = _pdfMatrix::translation(width * horizontalScale, 0).then(_tm);
+        }
+
+        // A number in a TJ array, in thousandths of a text space unit.
+        void adjust(double thousandths)
+        {
+            advance(-thousandths / 1000.0 * fontSize);
+        }
+
+        [[nodiscard]] const _pdfMatrix& textMatrix() const noexcept
+        {
+            return _tm;
+        }
+
+        [[nodiscard]] const _pdfMatrix& lineMatrix() const noexcept
+        {
+            return _tlm;
+        }
+    };
+}
+
+#endif // _PDF_TEXT_STATE_HPP_
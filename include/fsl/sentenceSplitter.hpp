@@ -0,0 +1,176 @@
+/**************************************************************************
+A single pass sentence boundary detector.
+
+Copyright (C) 2021 Chris Morrison (gnosticist@protonmail.com)
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <http://www.gnu.org/licenses/>.
+**************************************************************************/
+
+#ifndef _SENTENCE_SPLITTER_HPP_
+#define _SENTENCE_SPLITTER_HPP_
+
+#include <string>
+#include <vector>
+#include <unordered_set>
+
+namespace fsl::_private
+{
+    // Words that are followed by a full stop without ending a sentence. Entries are lower case and without the
+    // trailing full stop. Single letters (initials, "e.g.", "U.S.") never end a sentence so they are not listed.
+    inline const std::unordered_set<std::wstring>& _abbreviations()
+    {
+        static const std::unordered_set<std::wstring> lexicon =
+        {
+            L"mr", L"mrs", L"ms", L"mx", L"dr", L"prof", L"sr", L"jr", L"st", L"mt", L"ft", L"rev", L"hon",
+            L"gen", L"col", L"lt", L"sgt", L"capt", L"cmdr", L"adm", L"gov", L"sen", L"rep", L"pres", L"supt",
+            L"inc", L"ltd", L"co", L"corp", L"bros", L"dept", L"univ", L"assn", L"est", L"approx", L"ca",
+            L"vs", L"viz", L"cf", L"al", L"ibid", L"op", L"fig", L"figs", L"eq", L"eqs", L"no", L"nos", L"vol",
+            L"vols", L"pp", L"ch", L"sec", L"para", L"art", L"ed", L"eds", L"ave", L"blvd", L"rd", L"jan",
+            L"feb", L"mar", L"apr", L"jun", L"jul", L"aug", L"sep", L"sept", L"oct", L"nov", L"dec", L"mon",
+            L"tue", L"wed", L"thu", L"fri", L"sat", L"sun",
+        };
+
+        return lexicon;
+    }
+
+    // Splits a normalised string (see _prep_string()) into sentences in a single pass.
+    //
+    // Single line breaks are folded into spaces and the space that follows the end of a sentence is replaced
+    // with '\n'. Paragraph breaks ("\n\n") are kept. A sentence ends at '!' or '?', or at '.' when the preceding
+    // word is at least two letters long and not a known abbreviation or is a number of three or more digits.
+    // The terminal punctuation may be followed by closing quotes or brackets. The string is modified in place;
+    // if boundaries is not null the offset of each inserted '\n' is appended to it.
+    inline std::wstring& _split_sentences(std::wstring& text, std::vector<size_t>* boundaries = nullptr)
+    {
+        enum class state
+        {
+            text,       // Inside a sentence.
+            terminal,   // After one or more of . ! ?
+            closer,     // After closing quotes or brackets that follow the terminal punctuation.
+        };
+
+        const auto isLetter = [](wchar_t c) { return ((c >= 'a') && (c <= 'z')) || ((c >= 'A') && (c <= 'Z')); };
+        const auto isDigit = [](wchar_t c) { return (c >= '0') && (c <= '9'); };
+        const auto isCloser = [](wchar_t c) { return (c == '"') || (c == '\'') || (c == ')') || (c == ']') || (c == '}'); };
+        const auto isOpener = [](wchar_t c) { return (c == '"') || (c == '\'') || (c == '(') || (c == '[') || (c == '{'); };
+
+        state st = state::text;
+        bool boundary = false;  // Whether the current terminal cluster ends a sentence.
+        size_t letters = 0;     // Length of the run of letters immediately before the current position.
+        size_t digits = 0;      // Length of the run of digits immediately before the current position.
+        size_t wordStart = 0;   // Output offset of the first character of the current word.
+        size_t w = 0;           // Write position, never ahead of the read position.
+        std::wstring word;
+
+        for (size_t r = 0; r < text.size(); ++r)
+        {
+            wchar_t c = text[r];
+
+            if (c == '\n')
+            {
+                if ((r + 1 < text.size()) && (text[r + 1] == '\n'))
+                {
+                    // Paragraph break, always a boundary.
+                    if ((w > 0) && (text[w - 1] == ' ')) --w;
+                    text[w++] = '\n';
+                    text[w++] = '\n';
+                    ++r;
+                    st = state::text;
+                    letters = digits = 0;
+                    wordStart = w;
+                    continue;
+                }
+                c = ' ';
+            }
+
+            if (c == ' ')
+            {
+                if ((w == 0) || (text[w - 1] == ' ') || (text[w - 1] == '\n')) continue;
+                if ((st != state::text) && boundary)
+                {
+                    if (boundaries) boundaries->push_back(w);
+                    c = '\n';
+                }
+                text[w++] = c;
+                st = state::text;
+                letters = digits = 0;
+                wordStart = w;
+                continue;
+            }
+
+            if ((c == '.') || (c == '!') || (c == '?'))
+            {
+                if (st == state::text)
+                {
+                    if (c != '.')
+                    {
+                        boundary = true;
+                    }
+                    else if (letters >= 2)
+                    {
+                        // Check the word against the abbreviation lexicon.
+                        size_t s = wordStart;
+                        while ((s < w) && isOpener(text[s])) ++s;
+                        word.clear();
+                        for (size_t i = s; i < w; ++i) word.push_back(isLetter(text[i]) ? (text[i] | 0x20) : text[i]);
+                        boundary = (_abbreviations().find(word) == _abbreviations().end());
+                    }
+                    else
+                    {
+                        boundary = (digits >= 3);
+                    }
+                }
+                else if (c != '.')
+                {
+                    boundary = true;
+                }
+                st = state::terminal;
+                letters = digits = 0;
+                text[w++] = c;
+                continue;
+            }
+
+            if (isCloser(c))
+            {
+                // A bracket may close before the full stop, e.g. "(see above)." so keep the runs.
+                if (st != state::text) st = state::closer;
+                text[w++] = c;
+                continue;
+            }
+
+            st = state::text;
+            if (isLetter(c))
+            {
+                ++letters;
+                digits = 0;
+            }
+            else if (isDigit(c))
+            {
+                ++digits;
+                letters = 0;
+            }
+            else
+            {
+                letters = digits = 0;
+            }
+            text[w++] = c;
+        }
+
+        text.resize(w);
+
+        return text;
+    }
+}
+
+#endif // _SENTENCE_SPLITTER_HPP_
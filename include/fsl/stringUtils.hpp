@@ -23,6 +23,13 @@ along with this program.  If not, see <http://www.gnu.org/licenses/>.
 #include <windows.h>
 #endif
 
+#include <codecvt>
+#include <cstdlib>
+#include <cstring>
+#include <cwchar>
+#include <locale>
+#include <string>
+#include <string_view>
 #include <boost/algorithm/string.hpp>
 #include <boost/algorithm/string/replace.hpp>
 #include <boost/algorithm/string/regex.hpp>
@@ -69,14 +76,105 @@ namespace fsl::_private
 
 #else
 
+	// The same conversions done by hand, invalid UTF-8 and unpaired surrogates become U+FFFD.
 	inline wchar_t* _fromUTF8(const char* src, size_t src_length = 0, size_t* out_length = nullptr)
 	{
+		if (!src) return nullptr;
+
+		if (src_length == 0) src_length = strlen(src);
+		// No sequence gives more code units than it has bytes.
+		wchar_t* output_buffer = (wchar_t*)std::malloc((src_length + 1) * sizeof(wchar_t));
+		size_t length = 0;
+		if (output_buffer)
+		{
+			const unsigned char* p = reinterpret_cast<const unsigned char*>(src);
+			const unsigned char* end = p + src_length;
+			while (p < end)
+			{
+				unsigned long cp = *p;
+				int n = (cp >= 0xF0) ? 4 : (cp >= 0xE0) ? 3 : (cp >= 0xC0) ? 2 : 1;
+				bool valid = (cp < 0x80) || ((n > 1) && (cp < 0xF5) && (end - p >= n));
+				if (n > 1) cp &= (n == 4) ? 0x07 : (n == 3) ? 0x0F : 0x1F;
+				int i = 1;
+				for (; valid && (i < n) && ((p[i] & 0xC0) == 0x80); ++i) cp = (cp << 6) | (p[i] & 0x3F);
+				// A sequence cut short is skipped up to the byte that cut it.
+				p += valid ? i : 1;
+				if (valid && (i < n)) valid = false;
+				if (valid && (((n == 2) && (cp < 0x80)) || ((n == 3) && (cp < 0x800)) || ((n == 4) && (cp < 0x10000)))) valid = false;
+				if (valid && ((cp > 0x10FFFF) || ((cp >= 0xD800) && (cp <= 0xDFFF)))) valid = false;
+				if (!valid) cp = 0xFFFD;
+				if ((sizeof(wchar_t) == 2) && (cp > 0xFFFF))
+				{
+					cp -= 0x10000;
+					output_buffer[length++] = static_cast<wchar_t>(0xD800 + (cp >> 10));
+					cp = 0xDC00 + (cp & 0x3FF);
+				}
+				output_buffer[length++] = static_cast<wchar_t>(cp);
+			}
+			output_buffer[length] = L'\0';
+		}
+		if (out_length) *out_length = length;
 
+		return output_buffer;
 	}
 
 	inline char* _toUTF8(const wchar_t* src, size_t src_length = 0, size_t* out_length = nullptr)
 	{
+		if (!src) return nullptr;
+
+		if (src_length == 0) src_length = wcslen(src);
+		// No code unit gives more than four bytes.
+		char* output_buffer = (char*)std::malloc((src_length * 4 + 1) * sizeof(char));
+		size_t length = 0;
+		if (output_buffer)
+		{
+			for (size_t i = 0; i < src_length; ++i)
+			{
+				unsigned long cp = static_cast<unsigned long>(src[i]);
+				if ((cp >= 0xD800) && (cp <= 0xDBFF) && (i + 1 < src_length))
+				{
+					unsigned long low = static_cast<unsigned long>(src[i + 1]);
+					if ((low >= 0xDC00) && (low <= 0xDFFF))
+					{
+						cp = 0x10000 + ((cp - 0xD800) << 10) + (low - 0xDC00);
+						++i;
+					}
+				}
+				if (((cp >= 0xD800) && (cp <= 0xDFFF)) || (cp > 0x10FFFF)) cp = 0xFFFD;
+
+				unsigned char* out = reinterpret_cast<unsigned char*>(output_buffer) + length;
+				if (cp < 0x80)
+				{
+					out[0] = static_cast<unsigned char>(cp);
+					length += 1;
+				}
+				else if (cp < 0x800)
+				{
+					out[0] = static_cast<unsigned char>(0xC0 | (cp >> 6));
+					out[1] = static_cast<unsigned char>(0x80 | (cp & 0x3F));
+					length += 2;
+				}
+				else if (cp < 0x10000)
+				{
+					out[0] = static_cast<unsigned char>(0xE0 | (cp >> 12));
+					out[1] = static_cast<unsigned char>(0x80 | ((cp >> 6) & 0x3F));
+					out[2] = static_cast<unsigned char>(0x80 | (cp & 0x3F));
+					length += 3;
+				}
+				else
+				{
+					out[0] = static_cast<unsigned char>(0xF0 | (cp >> 18));
+					out[1] = static_cast<unsigned char>(0x80 | ((cp >> 12) & 0x3F));
+					out[2] = static_cast<unsigned char>(0x80 | ((cp >> 6) & 0x3F));
+					out[3] = static_cast<unsigned char>(0x80 | (cp & 0x3F));
+					length += 4;
+				}
+			}
+			output_buffer[length] = '\0';
+		}
+		if (out_length) *out_length = length;
 
+		return output_buffer;
 	}
 
 #endif
@@ -126,133 +224,499 @@ namespace fsl::_private
         return _wspc_pred(static_cast<wchar_t>(c));
     }
 
-    inline std::wstring& _prep_string(const std::wstring& in, std::wstring& out)
+    // The character by character normaliser behind _prep_string(). The state is kept between calls so that a
+    // string can be normalised in pieces, e.g. as it arrives. The output may be any wide string type, such as a
+    // std::pmr::wstring.
+    class _normalizer
     {
-        bool space_seen = false;
-        for (const auto& c : in)
+    private:
+        bool _spaceSeen = false;
+        unsigned int _newlines = 0; // Number of consecutive line breaks at the end of the output.
+
+        template <typename String>
+        void _newline(String& out)
+        {
+            if (_newlines == 2) return;
+            out.push_back('\n');
+            ++_newlines;
+        }
+
+        template <typename String>
+        void _append(String& out, const wchar_t* str)
         {
+            out.append(str);
+            _newlines = 0;
+        }
+
+    public:
+        unsigned int newlines() const
+        {
+            return _newlines;
+        }
+
+        template <typename String>
+        void put(wchar_t c, String& out)
+        {
+            if ((c > 0x20) && (c < 0x7F))
+            {
+                // Printable ASCII, the common case.
+                out.push_back(c);
+                _spaceSeen = false;
+                _newlines = 0;
+                return;
+            }
             if (c == 0x2029)
             {
-                out.push_back('\n');
-                out.push_back('\n');
-                continue;
+                _newline(out);
+                _newline(out);
+                return;
             }
             if ((c == 0x2028) || (c == 0x0A) || (c == 0x0D))
             {
-                out.push_back('\n');
-                continue;
+                _newline(out);
+                return;
             }
             if (_wspc_pred(c))
             {
-                if (space_seen) continue;
+                if (_spaceSeen) return;
                 out.push_back(' ');
-                space_seen = true;
-                continue;
+                _spaceSeen = true;
+                _newlines = 0;
+                return;
             }
             else
             {
-                space_seen = false;
+                _spaceSeen = false;
             }
-            if (c == 0x0085) { out.append(L"\n"); continue; } // Next line.
-            if (c == 0x2028) { out.append(L"\n"); continue; } // Line separator.
-            if (c == 0x2029) { out.append(L"\n\n"); continue; } // Paragraph separator.
-            if (c == 0x00AB) { out.append(L"\""); continue; } // LEFT-POINTING DOUBLE ANGLE QUOTATION MARK
-            if (c == 0x00AD) { out.append(L"-"); continue; }  // SOFT HYPHEN
-            if (c == 0x00B4) { out.append(L"'"); continue; }  // ACUTE ACCENT
-            if (c == 0x00BB) { out.append(L"\""); continue; } // RIGHT-POINTING DOUBLE ANGLE QUOTATION MARK
-            if (c == 0x00F7) { out.append(L"/"); continue; }  // DIVISION SIGN
-            if (c == 0x01C0) { out.append(L"|"); continue; }  // LATIN LETTER DENTAL CLICK
-            if (c == 0x01C3) { out.append(L"!"); continue; }  // LATIN LETTER RETROFLEX CLICK
-            if (c == 0x02B9) { out.append(L"'"); continue; }  // MODIFIER LETTER PRIME
-            if (c == 0x02BA) { out.append(L"\""); continue; } // MODIFIER LETTER DOUBLE PRIME
-            if (c == 0x02BC) { out.append(L"'"); continue; }  // MODIFIER LETTER APOSTROPHE
-            if (c == 0x02C4) { out.append(L"^"); continue; }  // MODIFIER LETTER UP ARROWHEAD
-            if (c == 0x02C6) { out.append(L"^"); continue; }  // MODIFIER LETTER CIRCUMFLEX ACCENT
-            if (c == 0x02C8) { out.append(L"'"); continue; }  // MODIFIER LETTER VERTICAL LINE
-            if (c == 0x02CB) { out.append(L"`"); continue; }  // MODIFIER LETTER GRAVE ACCENT
-            if (c == 0x02CD) { out.append(L"_"); continue; }  // MODIFIER LETTER LOW MACRON
-            if (c == 0x02DC) { out.append(L"~"); continue; }  // SMALL TILDE
-            if (c == 0x0300) { out.append(L"`"); continue; }  // COMBINING GRAVE ACCENT
-            if (c == 0x0301) { out.append(L"'"); continue; }  // COMBINING ACUTE ACCENT
-            if (c == 0x0302) { out.append(L"^"); continue; }  // COMBINING CIRCUMFLEX ACCENT
-            if (c == 0x0303) { out.append(L"~"); continue; }  // COMBINING TILDE
-            if (c == 0x030B) { out.append(L"\""); continue; } // COMBINING DOUBLE ACUTE ACCENT
-            if (c == 0x030E) { out.append(L"\""); continue; } // COMBINING DOUBLE VERTICAL LINE ABOVE
-            if (c == 0x0331) { out.append(L"_"); continue; }  // COMBINING MACRON BELOW
-            if (c == 0x0332) { out.append(L"_"); continue; }  // COMBINING LOW LINE
-            if (c == 0x0338) { out.append(L"/"); continue; }  // COMBINING LONG SOLIDUS OVERLAY
-            if (c == 0x0589) { out.append(L":"); continue; }  // ARMENIAN FULL STOP
-            if (c == 0x05C0) { out.append(L"|"); continue; }  // HEBREW PUNCTUATION PASEQ
-            if (c == 0x05C3) { out.append(L":"); continue; }  // HEBREW PUNCTUATION SOF PASUQ
-            if (c == 0x066A) { out.append(L"%"); continue; }  // ARABIC PERCENT SIGN
-            if (c == 0x066D) { out.append(L"*"); continue; }  // ARABIC FIVE POINTED STAR
-            if (c == 0x2010) { out.append(L"-"); continue; }  // HYPHEN
-            if (c == 0x2011) { out.append(L"-"); continue; }  // NON-BREAKING HYPHEN
-            if (c == 0x2012) { out.append(L"-"); continue; }  // FIGURE DASH
-            if (c == 0x2013) { out.append(L"-"); continue; }  // EN DASH
-            if (c == 0x2014) { out.append(L"-"); continue; }  // EM DASH
-            if (c == 0x2015) { out.append(L"--"); continue; } // HORIZONTAL BAR
-            if (c == 0x2016) { out.append(L"||"); continue; } // DOUBLE VERTICAL LINE
-            if (c == 0x2017) { out.append(L"_"); continue; }  // DOUBLE LOW LINE
-            if (c == 0x2018) { out.append(L"'"); continue; }  // LEFT SINGLE QUOTATION MARK
-            if (c == 0x2019) { out.append(L"'"); continue; }  // RIGHT SINGLE QUOTATION MARK
-            if (c == 0x201A) { out.append(L","); continue; }  // SINGLE LOW-9 QUOTATION MARK
-            if (c == 0x201B) { out.append(L"'"); continue; }  // SINGLE HIGH-REVERSED-9 QUOTATION MARK
-            if (c == 0x201C) { out.append(L"\""); continue; } // LEFT DOUBLE QUOTATION MARK
-            if (c == 0x201D) { out.append(L"\""); continue; } // RIGHT DOUBLE QUOTATION MARK
-            if (c == 0x201E) { out.append(L"\""); continue; } // DOUBLE LOW-9 QUOTATION MARK
-            if (c == 0x201F) { out.append(L"\""); continue; } // DOUBLE HIGH-REVERSED-9 QUOTATION MARK
-            if (c == 0x2032) { out.append(L"'"); continue; }  // PRIME
-            if (c == 0x2033) { out.append(L"\""); continue; } // DOUBLE PRIME
-            if (c == 0x2034) { out.append(L"'"); continue; }  // TRIPLE PRIME
-            if (c == 0x2035) { out.append(L"`"); continue; }  // REVERSED PRIME
-            if (c == 0x2036) { out.append(L"\""); continue; } // REVERSED DOUBLE PRIME
-            if (c == 0x2037) { out.append(L"'"); continue; }  // REVERSED TRIPLE PRIME
-            if (c == 0x2038) { out.append(L"^"); continue; }  // CARET
-            if (c == 0x2039) { out.append(L"<"); continue; }  // SINGLE LEFT-POINTING ANGLE QUOTATION MARK
-            if (c == 0x203A) { out.append(L">"); continue; }  // SINGLE RIGHT-POINTING ANGLE QUOTATION MARK
-            if (c == 0x203D) { out.append(L"?"); continue; }  // INTERROBANG
-            if (c == 0x2044) { out.append(L"/"); continue; }  // FRACTION SLASH
-            if (c == 0x204E) { out.append(L"*"); continue; }  // LOW ASTERISK
-            if (c == 0x2052) { out.append(L"%"); continue; }  // COMMERCIAL MINUS SIGN
-            if (c == 0x2053) { out.append(L"~"); continue; }  // SWUNG DASH
-            if (c == 0x20E5) { out.append(L"\\"); continue; }  // COMBINING REVERSE SOLIDUS OVERLAY
-            if (c == 0x2212) { out.append(L"-"); continue; }  // MINUS SIGN
-            if (c == 0x2215) { out.append(L"/"); continue; }  // DIVISION SLASH
-            if (c == 0x2216) { out.append(L"\\"); continue; }  // SET MINUS
-            if (c == 0x2217) { out.append(L"*"); continue; }  // ASTERISK OPERATOR
-            if (c == 0x2223) { out.append(L"|"); continue; }  // DIVIDES
-            if (c == 0x2236) { out.append(L":"); continue; }  // RATIO
-            if (c == 0x223C) { out.append(L"~"); continue; }  // TILDE OPERATOR
-            if (c == 0x2264) { out.append(L"<="); continue; } // LESS-THAN OR EQUAL TO
-            if (c == 0x2265) { out.append(L">="); continue; } // GREATER-THAN OR EQUAL TO
-            if (c == 0x2266) { out.append(L"<="); continue; } // LESS-THAN OVER EQUAL TO
-            if (c == 0x2267) { out.append(L">="); continue; } // GREATER-THAN OVER EQUAL TO
-            if (c == 0x2303) { out.append(L"^"); continue; }  // UP ARROWHEAD
-            if (c == 0x2329) { out.append(L"<"); continue; }  // LEFT-POINTING ANGLE BRACKET
-            if (c == 0x232A) { out.append(L">"); continue; }  // RIGHT-POINTING ANGLE BRACKET
-            if (c == 0x266F) { out.append(L"#"); continue; }  // MUSIC SHARP SIGN
-            if (c == 0x2731) { out.append(L"*"); continue; }  // HEAVY ASTERISK
-            if (c == 0x2758) { out.append(L"|"); continue; }  // LIGHT VERTICAL BAR
-            if (c == 0x2762) { out.append(L"!"); continue; }  // HEAVY EXCLAMATION MARK ORNAMENT
-            if (c == 0x27E6) { out.append(L"["); continue; }  // MATHEMATICAL LEFT WHITE SQUARE BRACKET
-            if (c == 0x27E8) { out.append(L"<"); continue; }  // MATHEMATICAL LEFT ANGLE BRACKET
-            if (c == 0x27E9) { out.append(L">"); continue; }  // MATHEMATICAL RIGHT ANGLE BRACKET
-            if (c == 0x2983) { out.append(L"{"); continue; }  // LEFT WHITE CURLY BRACKET
-            if (c == 0x2984) { out.append(L"}"); continue; }  // RIGHT WHITE CURLY BRACKET
-            if (c == 0x3003) { out.append(L"\""); continue; } // DITTO MARK
-            if (c == 0x3008) { out.append(L"<"); continue; }  // LEFT ANGLE BRACKET
-            if (c == 0x3009) { out.append(L">"); continue; }  // RIGHT ANGLE BRACKET
-            if (c == 0x301B) { out.append(L"]"); continue; }  // RIGHT WHITE SQUARE BRACKET
-            if (c == 0x301C) { out.append(L"~"); continue; }  // WAVE DASH
-            if (c == 0x301D) { out.append(L"\""); continue; } // REVERSED DOUBLE PRIME QUOTATION MARK
-            if (c == 0x301E) { out.append(L"\""); continue; } // DOUBLE PRIME QUOTATION MARK
+            if (c == 0x0085) { _newline(out); return; } // Next line.
+            if (c == 0x00AB) { _append(out, L"\""); return; } // LEFT-POINTING DOUBLE ANGLE QUOTATION MARK
+            if (c == 0x00AD) { _append(out, L"-"); return; }  // SOFT HYPHEN
+            if (c == 0x00B4) { _append(out, L"'"); return; }  // ACUTE ACCENT
+            if (c == 0x00BB) { _append(out, L"\""); return; } // RIGHT-POINTING DOUBLE ANGLE QUOTATION MARK
+            if (c == 0x00F7) { _append(out, L"/"); return; }  // DIVISION SIGN
+            if (c == 0x01C0) { _append(out, L"|"); return; }  // LATIN LETTER DENTAL CLICK
+            if (c == 0x01C3) { _append(out, L"!"); return; }  // LATIN LETTER RETROFLEX CLICK
+            if (c == 0x02B9) { _append(out, L"'"); return; }  // MODIFIER LETTER PRIME
+            if (c == 0x02BA) { _append(out, L"\""); return; } // MODIFIER LETTER DOUBLE PRIME
+            if (c == 0x02BC) { _append(out, L"'"); return; }  // MODIFIER LETTER APOSTROPHE
+            if (c == 0x02C4) { _append(out, L"^"); return; }  // MODIFIER LETTER UP ARROWHEAD
+            if (c == 0x02C6) { _append(out, L"^"); return; }  // MODIFIER LETTER CIRCUMFLEX ACCENT
+            if (c == 0x02C8) { _append(out, L"'"); return; }  // MODIFIER LETTER VERTICAL LINE
+            if (c == 0x02CB) { _append(out, L"`"); return; }  // MODIFIER LETTER GRAVE ACCENT
+            if (c == 0x02CD) { _append(out, L"_"); return; }  // MODIFIER LETTER LOW MACRON
+            if (c == 0x02DC) { _append(out, L"~"); return; }  // SMALL TILDE
+            if (c == 0x0300) { _append(out, L"`"); return; }  // COMBINING GRAVE ACCENT
+            if (c == 0x0301) { _append(out, L"'"); return; }  // COMBINING ACUTE ACCENT
+            if (c == 0x0302) { _append(out, L"^"); return; }  // COMBINING CIRCUMFLEX ACCENT
+            if (c == 0x0303) { _append(out, L"~"); return; }  // COMBINING TILDE
+            if (c == 0x030B) { _append(out, L"\""); return; } // COMBINING DOUBLE ACUTE ACCENT
+            if (c == 0x030E) { _append(out, L"\""); return; } // COMBINING DOUBLE VERTICAL LINE ABOVE
+            if (c == 0x0331) { _append(out, L"_"); return; }  // COMBINING MACRON BELOW
+            if (c == 0x0332) { _append(out, L"_"); return; }  // COMBINING LOW LINE
+            if (c == 0x0338) { _append(out, L"/"); return; }  // COMBINING LONG SOLIDUS OVERLAY
+            if (c == 0x0589) { _append(out, L":"); return; }  // ARMENIAN FULL STOP
+            if (c == 0x05C0) { _append(out, L"|"); return; }  // HEBREW PUNCTUATION PASEQ
+            if (c == 0x05C3) { _append(out, L":"); return; }  // HEBREW PUNCTUATION SOF PASUQ
+            if (c == 0x066A) { _append(out, L"%"); return; }  // ARABIC PERCENT SIGN
+            if (c == 0x066D) { _append(out, L"*"); return; }  // ARABIC FIVE POINTED STAR
+            if (c == 0x2010) { _append(out, L"-"); return; }  // HYPHEN
+            if (c == 0x2011) { _append(out, L"-"); return; }  // NON-BREAKING HYPHEN
+            if (c == 0x2012) { _append(out, L"-"); return; }  // FIGURE DASH
+            if (c == 0x2013) { _append(out, L"-"); return; }  // EN DASH
+            if (c == 0x2014) { _append(out, L"-"); return; }  // EM DASH
+            if (c == 0x2015) { _append(out, L"--"); return; } // HORIZONTAL BAR
+            if (c == 0x2016) { _append(out, L"||"); return; } // DOUBLE VERTICAL LINE
+            if (c == 0x2017) { _append(out, L"_"); return; }  // DOUBLE LOW LINE
+            if (c == 0x2018) { _append(out, L"'"); return; }  // LEFT SINGLE QUOTATION MARK
+            if (c == 0x2019) { _append(out, L"'"); return; }  // RIGHT SINGLE QUOTATION MARK
+            if (c == 0x201A) { _append(out, L","); return; }  // SINGLE LOW-9 QUOTATION MARK
+            if (c == 0x201B) { _append(out, L"'"); return; }  // SINGLE HIGH-REVERSED-9 QUOTATION MARK
+            if (c == 0x201C) { _append(out, L"\""); return; } // LEFT DOUBLE QUOTATION MARK
+            if (c == 0x201D) { _append(out, L"\""); return; } // RIGHT DOUBLE QUOTATION MARK
+            if (c == 0x201E) { _append(out, L"\""); return; } // DOUBLE LOW-9 QUOTATION MARK
+            if (c == 0x201F) { _append(out, L"\""); return; } // DOUBLE HIGH-REVERSED-9 QUOTATION MARK
+            if (c == 0x2032) { _append(out, L"'"); return; }  // PRIME
+            if (c == 0x2033) { _append(out, L"\""); return; } // DOUBLE PRIME
+            if (c == 0x2034) { _append(out, L"'"); return; }  // TRIPLE PRIME
+            if (c == 0x2035) { _append(out, L"`"); return; }  // REVERSED PRIME
+            if (c == 0x2036) { _append(out, L"\""); return; } // REVERSED DOUBLE PRIME
+            if (c == 0x2037) { _append(out, L"'"); return; }  // REVERSED TRIPLE PRIME
+            if (c == 0x2038) { _append(out, L"^"); return; }  // CARET
+            if (c == 0x2039) { _append(out, L"<"); return; }  // SINGLE LEFT-POINTING ANGLE QUOTATION MARK
+            if (c == 0x203A) { _append(out, L">"); return; }  // SINGLE RIGHT-POINTING ANGLE QUOTATION MARK
+            if (c == 0x203D) { _append(out, L"?"); return; }  // INTERROBANG
+            if (c == 0x2044) { _append(out, L"/"); return; }  // FRACTION SLASH
+            if (c == 0x204E) { _append(out, L"*"); return; }  // LOW ASTERISK
+            if (c == 0x2052) { _append(out, L"%"); return; }  // COMMERCIAL MINUS SIGN
+            if (c == 0x2053) { _append(out, L"~"); return; }  // SWUNG DASH
+            if (c == 0x20E5) { _append(out, L"\\"); return; }  // COMBINING REVERSE SOLIDUS OVERLAY
+            if (c == 0x2212) { _append(out, L"-"); return; }  // MINUS SIGN
+            if (c == 0x2215) { _append(out, L"/"); return; }  // DIVISION SLASH
+            if (c == 0x2216) { _append(out, L"\\"); return; }  // SET MINUS
+            if (c == 0x2217) { _append(out, L"*"); return; }  // ASTERISK OPERATOR
+            if (c == 0x2223) { _append(out, L"|"); return; }  // DIVIDES
+            if (c == 0x2236) { _append(out, L":"); return; }  // RATIO
+            if (c == 0x223C) { _append(out, L"~"); return; }  // TILDE OPERATOR
+            if (c == 0x2264) { _append(out, L"<="); return; } // LESS-THAN OR EQUAL TO
+            if (c == 0x2265) { _append(out, L">="); return; } // GREATER-THAN OR EQUAL TO
+            if (c == 0x2266) { _append(out, L"<="); return; } // LESS-THAN OVER EQUAL TO
+            if (c == 0x2267) { _append(out, L">="); return; } // GREATER-THAN OVER EQUAL TO
+            if (c == 0x2303) { _append(out, L"^"); return; }  // UP ARROWHEAD
+            if (c == 0x2329) { _append(out, L"<"); return; }  // LEFT-POINTING ANGLE BRACKET
+            if (c == 0x232A) { _append(out, L">"); return; }  // RIGHT-POINTING ANGLE BRACKET
+            if (c == 0x266F) { _append(out, L"#"); return; }  // MUSIC SHARP SIGN
+            if (c == 0x2731) { _append(out, L"*"); return; }  // HEAVY ASTERISK
+            if (c == 0x2758) { _append(out, L"|"); return; }  // LIGHT VERTICAL BAR
+            if (c == 0x2762) { _append(out, L"!"); return; }  // HEAVY EXCLAMATION MARK ORNAMENT
+            if (c == 0x27E6) { _append(out, L"["); return; }  // MATHEMATICAL LEFT WHITE SQUARE BRACKET
+            if (c == 0x27E8) { _append(out, L"<"); return; }  // MATHEMATICAL LEFT ANGLE BRACKET
+            if (c == 0x27E9) { _append(out, L">"); return; }  // MATHEMATICAL RIGHT ANGLE BRACKET
+            if (c == 0x2983) { _append(out, L"{"); return; }  // LEFT WHITE CURLY BRACKET
+            if (c == 0x2984) { _append(out, L"}"); return; }  // RIGHT WHITE CURLY BRACKET
+            if (c == 0x3003) { _append(out, L"\""); return; } // DITTO MARK
+            if (c == 0x3008) { _append(out, L"<"); return; }  // LEFT ANGLE BRACKET
+            if (c == 0x3009) { _append(out, L">"); return; }  // RIGHT ANGLE BRACKET
+            if (c == 0x301B) { _append(out, L"]"); return; }  // RIGHT WHITE SQUARE BRACKET
+            if (c == 0x301C) { _append(out, L"~"); return; }  // WAVE DASH
+            if (c == 0x301D) { _append(out, L"\""); return; } // REVERSED DOUBLE PRIME QUOTATION MARK
+            if (c == 0x301E) { _append(out, L"\""); return; } // DOUBLE PRIME QUOTATION MARK
 
             out.push_back(c);
+            _newlines = 0;
+        }
+    };
+
+    template <typename String>
+    inline String& _prep_string(std::wstring_view in, String& out)
+    {
+        // Sequences of more than two newlines are collapsed to two as the string is normalised.
+        _normalizer normalizer;
+        out.reserve(out.size() + in.size());
+        for (const auto& c : in) normalizer.put(c, out);
+
+        return out;
+    }
+
+    inline void _append_code_point(std::wstring& out, unsigned long cp)
+    {
+        if ((cp == 0) || (cp > 0x10FFFF) || ((cp >= 0xD800) && (cp <= 0xDFFF))) cp = 0xFFFD;
+        if ((sizeof(wchar_t) == 2) && (cp > 0xFFFF))
+        {
+            cp -= 0x10000;
+            out.push_back(static_cast<wchar_t>(0xD800 + (cp >> 10)));
+            out.push_back(static_cast<wchar_t>(0xDC00 + (cp & 0x3FF)));
+            return;
+        }
+        out.push_back(static_cast<wchar_t>(cp));
+    }
+
+    // Appends UTF-16 code units, e.g. a poppler::ustring, to a wide string. Unpaired surrogates become U+FFFD.
+    template <typename CharT>
+    inline void _append_utf16(std::wstring& out, const CharT* data, size_t length)
+    {
+        for (size_t i = 0; i < length; ++i)
+        {
+            unsigned long c = static_cast<unsigned long>(data[i]) & 0xFFFF;
+            if ((c >= 0xD800) && (c <= 0xDBFF) && (i + 1 < length))
+            {
+                unsigned long low = static_cast<unsigned long>(data[i + 1]) & 0xFFFF;
+                if ((low >= 0xDC00) && (low <= 0xDFFF))
+                {
+                    _append_code_point(out, 0x10000 + ((c - 0xD800) << 10) + (low - 0xDC00));
+                    ++i;
+                    continue;
+                }
+            }
+            _append_code_point(out, c);
+        }
+    }
+
+    inline bool _decode_entity(const std::wstring& entity, std::wstring& out)
+    {
+        // entity holds everything between '&' and ';'.
+        if (entity.empty()) return false;
+
+        if (entity[0] == '#')
+        {
+            unsigned long cp = 0;
+            size_t i = 1;
+            int base = 10;
+            if ((entity.size() > 1) && ((entity[1] == 'x') || (entity[1] == 'X')))
+            {
+                base = 16;
+                i = 2;
+            }
+            if (i >= entity.size()) return false;
+            for (; i < entity.size(); ++i)
+            {
+                wchar_t c = entity[i];
+                unsigned long d;
+                if ((c >= '0') && (c <= '9')) d = c - '0';
+                else if ((base == 16) && (c >= 'a') && (c <= 'f')) d = c - 'a' + 10;
+                else if ((base == 16) && (c >= 'A') && (c <= 'F')) d = c - 'A' + 10;
+                else return false;
+                cp = cp * base + d;
+                if (cp > 0x10FFFF) cp = 0x110000; // Clamp, it will be replaced below.
+            }
+            _append_code_point(out, cp);
+            return true;
         }
 
-        // Replace all instances of more than two newlines with two.
-        boost::replace_all_regex(out, boost::wregex(L"\\n{2,}"), std::wstring(L"\n\n"));
+        static const std::pair<const wchar_t*, wchar_t> named[] =
+        {
+            { L"amp", L'&' }, { L"lt", L'<' }, { L"gt", L'>' }, { L"quot", L'"' }, { L"apos", L'\'' },
+            { L"nbsp", 0x00A0 }, { L"shy", 0x00AD }, { L"copy", 0x00A9 }, { L"reg", 0x00AE }, { L"trade", 0x2122 },
+            { L"laquo", 0x00AB }, { L"raquo", 0x00BB }, { L"lsquo", 0x2018 }, { L"rsquo", 0x2019 },
+            { L"ldquo", 0x201C }, { L"rdquo", 0x201D }, { L"ndash", 0x2013 }, { L"mdash", 0x2014 },
+            { L"hellip", 0x2026 }, { L"bull", 0x2022 }, { L"middot", 0x00B7 }, { L"deg", 0x00B0 },
+            { L"times", 0x00D7 }, { L"divide", 0x00F7 }, { L"euro", 0x20AC }, { L"pound", 0x00A3 },
+        };
+        for (const auto& e : named)
+        {
+            if (entity == e.first)
+            {
+                out.push_back(e.second);
+                return true;
+            }
+        }
+
+        return false;
+    }
+
+    // A single pass HTML/XML tag and entity stripper.
+    //
+    // Characters are fed in one at a time so that the state can be carried across buffer boundaries. Block
+    // level elements are replaced with a paragraph break, <br> with a line break and table cells with a space.
+    // Comments and the contents of <script> and <style> elements are dropped, the common named and numeric
+    // character entities are decoded and all other markup is discarded. A '<' that does not start a tag, or
+    // that is followed by another '<' before the closing '>', is copied through unchanged.
+    class _htmlStripper
+    {
+    private:
+        enum class _state
+        {
+            text,
+            tag,
+            comment,
+            entity,
+            rawText,
+        };
+
+        // Longest tag looked ahead for. A '<' with no '>' within this many characters, e.g. "a<b and so on", is
+        // not markup and is kept as text.
+        static constexpr size_t _max_tag = 4096;
+
+        _state _st = _state::text;
+        std::wstring _pending;      // Unfinished tag or entity.
+        const wchar_t* _rawEnd = nullptr;
+        size_t _matched = 0;
+
+        static bool _is_alpha(wchar_t c)
+        {
+            return ((c >= 'a') && (c <= 'z')) || ((c >= 'A') && (c <= 'Z'));
+        }
+
+        static bool _is_alnum(wchar_t c)
+        {
+            return _is_alpha(c) || ((c >= '0') && (c <= '9'));
+        }
+
+        static wchar_t _lower(wchar_t c)
+        {
+            return ((c >= 'A') && (c <= 'Z')) ? static_cast<wchar_t>(c + 32) : c;
+        }
+
+        void _endTag(std::wstring& out)
+        {
+            // _pending holds the tag without the closing '>'.
+            size_t i = 1;
+            bool closing = false;
+            if ((i < _pending.size()) && (_pending[i] == '/'))
+            {
+                closing = true;
+                ++i;
+            }
+
+            wchar_t name[12];
+            size_t n = 0;
+            for (; (i < _pending.size()) && _is_alnum(_pending[i]); ++i)
+            {
+                if (n == 11) break;
+                name[n++] = _lower(_pending[i]);
+            }
+            name[n] = 0;
+            bool selfClosing = (_pending.back() == '/');
+            _pending.clear();
+            _st = _state::text;
+            if (n == 0) return; // <!DOCTYPE>, <?xml?> and friends.
+
+            static const wchar_t* blocks[] =
+            {
+                L"p", L"div", L"h1", L"h2", L"h3", L"h4", L"h5", L"h6", L"li", L"ul", L"ol", L"dl", L"dt", L"dd",
+                L"table", L"tr", L"blockquote", L"pre", L"section", L"article", L"header", L"footer", L"aside",
+                L"nav", L"main", L"figure", L"figcaption", L"hr", L"title", L"address", L"form", L"fieldset",
+            };
+
+            if (std::wcscmp(name, L"br") == 0)
+            {
+                out.push_back('\n');
+                return;
+            }
+            if ((std::wcscmp(name, L"td") == 0) || (std::wcscmp(name, L"th") == 0))
+            {
+                out.push_back(' ');
+                return;
+            }
+            for (auto b : blocks)
+            {
+                if (std::wcscmp(name, b) == 0)
+                {
+                    out.append(L"\n\n");
+                    return;
+                }
+            }
+            if (!closing && !selfClosing)
+            {
+                if (std::wcscmp(name, L"script") == 0) _rawEnd = L"</script";
+                else if (std::wcscmp(name, L"style") == 0) _rawEnd = L"</style";
+                else return;
+                _st = _state::rawText;
+                _matched = 0;
+            }
+        }
+
+    public:
+        void put(wchar_t c, std::wstring& out)
+        {
+            switch (_st)
+            {
+            case _state::text:
+                if (c == '<')
+                {
+                    _pending.assign(1, c);
+                    _st = _state::tag;
+                }
+                else if (c == '&')
+                {
+                    _pending.assign(1, c);
+                    _st = _state::entity;
+                }
+                else
+                {
+                    out.push_back(c);
+                }
+                break;
+
+            case _state::tag:
+                if ((_pending.size() == 1) && !_is_alpha(c) && (c != '/') && (c != '!') && (c != '?'))
+                {
+                    // Not a tag, e.g. "a < b".
+                    out.push_back('<');
+                    _pending.clear();
+                    _st = _state::text;
+                    put(c, out);
+                    break;
+                }
+                if (c == '<')
+                {
+                    out.append(_pending);
+                    _pending.assign(1, c);
+                    break;
+                }
+                if (c == '>')
+                {
+                    _endTag(out);
+                    break;
+                }
+                _pending.push_back(c);
+                if ((_pending.size() == 4) && (_pending.compare(0, 4, L"<!--") == 0))
+                {
+                    _matched = 0;
+                    _st = _state::comment;
+                }
+                else if (_pending.size() >= _max_tag)
+                {
+                    out.append(_pending);
+                    _pending.clear();
+                    _st = _state::text;
+                }
+                break;
+
+            case _state::comment:
+                // _matched counts the trailing '-' characters seen.
+                if ((c == '>') && (_matched >= 2))
+                {
+                    _pending.clear();
+                    _st = _state::text;
+                    break;
+                }
+                _matched = (c == '-') ? _matched + 1 : 0;
+                break;
+
+            case _state::entity:
+                if (c == ';')
+                {
+                    std::wstring name(_pending, 1);
+                    if (!_decode_entity(name, out))
+                    {
+                        out.append(_pending);
+                        out.push_back(c);
+                    }
+                    _pending.clear();
+                    _st = _state::text;
+                    break;
+                }
+                if ((_is_alnum(c) || ((c == '#') && (_pending.size() == 1))) && (_pending.size() < 12))
+                {
+                    _pending.push_back(c);
+                    break;
+                }
+                out.append(_pending);
+                _pending.clear();
+                _st = _state::text;
+                put(c, out);
+                break;
+
+            case _state::rawText:
+                if (_lower(c) == _rawEnd[_matched])
+                {
+                    if (_rawEnd[++_matched] == 0)
+                    {
+                        // Hand the closing tag over to the tag state to consume the rest of it.
+                        _pending.assign(_rawEnd);
+                        _st = _state::tag;
+                    }
+                }
+                else
+                {
+                    _matched = (c == '<') ? 1 : 0;
+                }
+                break;
+            }
+        }
+
+        // True when the stripper is not inside any markup.
+        bool idle() const
+        {
+            return _st == _state::text;
+        }
+
+        void finish(std::wstring& out)
+        {
+            // An unterminated tag or entity is kept as text, an unterminated comment or script is dropped.
+            if ((_st == _state::tag) || (_st == _state::entity)) out.append(_pending);
+            _pending.clear();
+            _st = _state::text;
+            _matched = 0;
+        }
+    };
+
+    inline std::wstring& _strip_html(const std::wstring& in, std::wstring& out)
+    {
+        _htmlStripper stripper;
+        out.reserve(out.size() + in.size());
+        for (const auto& c : in) stripper.put(c, out);
+        stripper.finish(out);
 
         return out;
     }
@@ -0,0 +1,100 @@
+/**************************************************************************
+Builds the pages of a structured document from its blocks of text.
+
+Copyright (C) 2021 Chris Morrison (gnosticist@protonmail.com)
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <http://www.gnu.org/licenses/>.
+**************************************************************************/
+
+#ifndef _STRUCTURED_DOCUMENT_HPP_
+#define _STRUCTURED_DOCUMENT_HPP_
+
+#include <memory_resource>
+#include <string_view>
+#include <vector>
+
+#include "textCorpus.hpp"
+
+namespace fsl::_private
+{
+    // Builds the pages of a word processor document, such as ODT or DOCX, as its headings, paragraphs and list
+    // items are read, splitting them into pages where the document records a page break. Each block goes
+    // straight into the corpus of its page with the split options given, the text is not kept anywhere else.
+    class _structuredDocument
+    {
+    private:
+        std::vector<fsl::text::textCorpus> _pages;
+        std::pmr::memory_resource* _resource;
+        bool _splitSentences;
+        bool _splitParagraphs;
+        bool _open;             // Whether the last page has had a block added to it.
+
+        void _newPage()
+        {
+            _pages.emplace_back(_resource);
+            _pages.back().setSplitSentences(_splitSentences);
+            _pages.back().setSplitParagraphs(_splitParagraphs);
+            _open = false;
+        }
+
+    public:
+        // The corpora of the pages allocate from resource.
+        _structuredDocument(std::pmr::memory_resource* resource, bool splitSentences, bool splitParagraphs)
+        {
+            _resource = resource;
+            _splitSentences = splitSentences;
+            _splitParagraphs = splitParagraphs;
+            _open = false;
+        }
+
+        // Adds a block to the current page.
+        void block(std::wstring_view text, fsl::text::textCorpusItem::itemType type)
+        {
+            if (text.empty()) return;
+            if (_pages.empty()) _newPage();
+            _pages.back().appendBlock(text, type);
+            _open = true;
+        }
+
+        // Starts a new page before the next block. Breaks with no blocks between them count as one, so a
+        // document never starts with or holds empty pages.
+        void pageBreak()
+        {
+            if (!_pages.empty() && _open) _newPage();
+        }
+
+        // The number of pages, at least one.
+        [[nodiscard]] unsigned int pages() const noexcept
+        {
+            size_t n = _pages.size();
+            if ((n > 0) && !_open) --n;
+
+            return (n == 0) ? 1 : static_cast<unsigned int>(n);
+        }
+
+        // Hands over the pages, pages() of them, and starts again.
+        std::vector<fsl::text::textCorpus> release()
+        {
+            if (!_pages.empty() && !_open) _pages.pop_back();
+            if (_pages.empty()) _newPage();
+            std::vector<fsl::text::textCorpus> pages;
+            pages.swap(_pages);
+            _open = false;
+
+            return pages;
+        }
+    };
+}
+
+#endif // _STRUCTURED_DOCUMENT_HPP_
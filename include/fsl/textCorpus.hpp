@@ -27,11 +27,21 @@ along with this program.  If not, see <http://www.gnu.org/licenses/>.
 #include <iostream>
 #include <codecvt>
 #include <string>
+#include <string_view>
 #include <algorithm>
 #include <filesystem>
+#include <thread>
+#include <atomic>
+#include <mutex>
+#include <exception>
+#include <memory>
+#include <memory_resource>
 
 #include "stringUtils.hpp"
+#include "sentenceSplitter.hpp"
 #include "textCorpusItem.hpp"
+#include "textLayout.hpp"
+#include "instrumentation.hpp"
 
 #ifndef MAX_PATH
 #define MAX_PATH 512
@@ -41,25 +51,336 @@ namespace fsl::text
 {
     class textCorpus
     {
+    public:
+        // An item in a corpus that uses compact storage, the text is held in the corpus' shared buffer.
+        struct itemRecord
+        {
+            size_t offset;
+            size_t length;
+            textCorpusItem::itemType type;
+        };
+
     private:
-        std::vector<textCorpusItem> _items;
+        std::pmr::vector<textCorpusItem> _items;
+        std::pmr::wstring _arena;               // Text of all the items in compact mode, append only.
+        std::pmr::vector<itemRecord> _records;  // Items in compact mode.
+        std::shared_ptr<const void> _owner; // Keeps _external alive, see attach().
+        std::wstring_view _external;        // Text of the items when it is held outside the corpus.
+        textLayout _layout;
+        bool _compact;
         bool _splitSentences;
         bool _splitParagraphs;
         bool _removeHtmlTags;
+
+        std::wstring_view _arenaView() const
+        {
+            return _owner ? _external : std::wstring_view(_arena);
+        }
+
+        // Takes a private copy of attached text before the corpus is changed.
+        void _detach()
+        {
+            if (!_owner) return;
+            _arena.assign(_external);
+            _external = std::wstring_view();
+            _owner.reset();
+        }
+
+        void _appendDelimiter()
+        {
+            if (_compact)
+            {
+                if (!_records.empty() && (_records.back().length != 0)) _records.push_back({ _arena.size(), 0, textCorpusItem::itemType::paragraph });
+            }
+            else
+            {
+                if (!_items.empty() && !_items.back().empty()) _items.emplace_back();
+            }
+        }
+
+        // Splits a normalised string into one span per non empty line, trimmed of spaces. If paragraphs are to
+        // be split an empty span follows the last line of each paragraph to delimit it.
+        void _split(const std::wstring& text, std::vector<textCorpusItem::span>& spans) const
+        {
+            size_t pos = 0;
+            bool paragraphHasLines = false;
+            while (pos <= text.size())
+            {
+                size_t end = text.find('\n', pos);
+                if (end == std::wstring::npos) end = text.size();
+
+                size_t first = pos;
+                size_t last = end;
+                while ((first < last) && (text[first] == ' ')) ++first;
+                while ((last > first) && (text[last - 1] == ' ')) --last;
+                if (last > first)
+                {
+                    spans.push_back({ first, last - first, textCorpusItem::itemType::paragraph });
+                    paragraphHasLines = true;
+                }
+
+                bool paragraphEnd = (end == text.size()) || ((end + 1 < text.size()) && (text[end + 1] == '\n'));
+                if (paragraphEnd)
+                {
+                    if (_splitParagraphs && paragraphHasLines) spans.push_back({ end, 0, textCorpusItem::itemType::paragraph });
+                    paragraphHasLines = false;
+                    while ((end < text.size()) && (text[end] == '\n')) ++end;
+                    pos = end;
+                    if (pos == text.size()) break;
+                    continue;
+                }
+                pos = end + 1;
+            }
+        }
+
+        void _begin(bool append)
+        {
+            if (append)
+            {
+                _detach();
+                if (_splitParagraphs) _appendDelimiter();
+            }
+            else
+            {
+                clear();
+            }
+        }
+
+        // Moves the items of another corpus, in the same storage mode, to the end of this one.
+        void _take(textCorpus& other)
+        {
+            if (_compact)
+            {
+                size_t base = _arena.size();
+                _arena.append(other._arenaView());
+                for (auto r : other._records)
+                {
+                    r.offset += base;
+                    _records.push_back(r);
+                }
+            }
+            else
+            {
+                for (auto& itm : other._items) _items.emplace_back(std::move(itm));
+            }
+            other.clear();
+        }
+
+        // Adds the items of a normalised string made up of complete paragraphs, the string is modified.
+        void _emit(std::wstring& copy)
+        {
+            std::vector<textCorpusItem::span> spans;
+
+            // ---------------------------------------------------------------------------------------------------------
+            // Phase 4 - If the caller has requested it, split the paragraphs into sentences.
+            // ---------------------------------------------------------------------------------------------------------
+            if (_splitSentences)
+            {
+                // Fold single line breaks into spaces and put each sentence on its own line.
+                fsl::_private::_split_sentences(copy);
+            }
+
+            // ---------------------------------------------------------------------------------------------------------
+            // Phase 5 - Split the normalised string into lines and paragraphs in one walk over the buffer and
+            // construct the items straight from the resulting spans.
+            // ---------------------------------------------------------------------------------------------------------
+            _split(copy, spans);
+            FSL_INSTRUMENT_COUNT(itemsProduced, spans.size());
+            if (_compact)
+            {
+#ifdef FSL_ENABLE_INSTRUMENTATION
+                size_t arenaCapacity = _arena.capacity();
+                size_t recordsCapacity = _records.capacity();
+#endif
+                for (const auto& s : spans)
+                {
+                    _records.push_back({ _arena.size(), s.length, s.type });
+                    _arena.append(copy, s.offset, s.length);
+                }
+                FSL_INSTRUMENT_COUNT(allocations, (_arena.capacity() != arenaCapacity) + (_records.capacity() != recordsCapacity));
+                return;
+            }
+
+            // Each item owns its text.
+            FSL_INSTRUMENT_COUNT(allocations, spans.size());
+            for (const auto& s : spans)
+            {
+                _items.emplace_back(copy, s);
+            }
+        }
+
     public:
 
-        textCorpus()
+        textCorpus() : textCorpus(std::pmr::get_default_resource())
         {
+        }
+
+        // The items and their text are allocated from resource, which must outlive the corpus. A monotonic
+        // arena per document, released when the document is closed, saves a trip to the heap for every item.
+        // The resource is only used by the thread working on the corpus, it need not be synchronised. Copies
+        // use the default resource, moves keep the resource of the corpus moved from.
+        explicit textCorpus(std::pmr::memory_resource* resource) : _items(resource), _arena(resource), _records(resource)
+        {
+            _compact = false;
             _splitSentences = false;
             _splitParagraphs = false;
             _removeHtmlTags = true;
         }
 
+        textCorpus(const textCorpus&) = default;
+        textCorpus(textCorpus&&) noexcept = default;
+        textCorpus& operator=(const textCorpus&) = default;
+        textCorpus& operator=(textCorpus&&) = default;
         ~textCorpus() = default;
 
+        [[nodiscard]] std::pmr::memory_resource* resource() const noexcept
+        {
+            return _items.get_allocator().resource();
+        }
+
         bool empty() const noexcept
         {
-            return _items.empty();
+            return _compact ? _records.empty() : _items.empty();
+        }
+
+        // Removes all the items, the settings are kept.
+        void clear()
+        {
+            _items.clear();
+            _records.clear();
+            _arena.clear();
+            _external = std::wstring_view();
+            _owner.reset();
+            _layout.clear();
+        }
+
+        // The number of items in the corpus, regardless of the storage mode.
+        size_t size() const noexcept
+        {
+            return _compact ? _records.size() : _items.size();
+        }
+
+        // The text of the item at index. In compact mode the view refers to the corpus' shared buffer and is
+        // invalidated by the next call to parseString().
+        std::wstring_view text(size_t index) const
+        {
+            if (index >= size()) throw std::out_of_range("index out of range.");
+            if (!_compact) return _items[index].wideStringView();
+            const auto& r = _records[index];
+            return _arenaView().substr(r.offset, r.length);
+        }
+
+        textCorpusItem::itemType type(size_t index) const
+        {
+            if (index >= size()) throw std::out_of_range("index out of range.");
+            return _compact ? _records[index].type : _items[index].type();
+        }
+
+        bool compactStorage() const
+        {
+            return _compact;
+        }
+
+        // In compact mode the text of all the items is kept in one contiguous buffer and the items are stored as
+        // offset/length records, this saves an allocation per item and frees the whole corpus in two steps.
+        // Items are then accessed through size(), text() and type(); parts() and records() only return the items
+        // of their own mode. Any existing items are converted.
+        void setCompactStorage(bool compact)
+        {
+            if (compact == _compact) return;
+            if (compact)
+            {
+                size_t length = 0;
+                for (const auto& itm : _items) length += itm.wideStringView().size();
+                _arena.reserve(length);
+                _records.reserve(_items.size());
+                for (const auto& itm : _items)
+                {
+                    auto view = itm.wideStringView();
+                    _records.push_back({ _arena.size(), view.size(), itm.type() });
+                    _arena.append(view);
+                }
+                std::pmr::vector<textCorpusItem>(resource()).swap(_items);
+            }
+            else
+            {
+                _items.reserve(_records.size());
+                for (const auto& r : _records) _items.emplace_back(_arenaView(), textCorpusItem::span{ r.offset, r.length, r.type });
+                std::pmr::vector<itemRecord>(resource()).swap(_records);
+                std::pmr::wstring(resource()).swap(_arena);
+                _external = std::wstring_view();
+                _owner.reset();
+            }
+            _compact = compact;
+        }
+
+        const std::pmr::vector<itemRecord>& records() const
+        {
+            return _records;
+        }
+
+        // Replaces the contents with compact items whose text is held outside the corpus, e.g. in a memory
+        // mapped file. The record offsets are relative to the start of text and owner keeps the text alive for
+        // as long as the corpus refers to it. The text is copied if more items are added later. The records are
+        // copied unless they use the memory resource of the corpus.
+        void attach(std::shared_ptr<const void> owner, std::wstring_view text, std::pmr::vector<itemRecord> records)
+        {
+            for (const auto& r : records)
+            {
+                if ((r.offset > text.size()) || (r.length > text.size() - r.offset)) throw std::out_of_range("record out of range.");
+            }
+            clear();
+            std::pmr::vector<textCorpusItem>(resource()).swap(_items);
+            _records = std::move(records);
+            _external = text;
+            _owner = std::move(owner);
+            _compact = true;
+        }
+
+        // Removes the items for which remove(index) returns true. Paragraph delimiters left at the start or next
+        // to each other are removed too. Returns the number of items removed. Attached text is not copied.
+        template <typename Predicate>
+        size_t removeItems(Predicate remove)
+        {
+            size_t before = size();
+            if (_compact)
+            {
+                size_t w = 0;
+                for (size_t r = 0; r < before; ++r)
+                {
+                    if (remove(r)) continue;
+                    if ((_records[r].length == 0) && ((w == 0) || (_records[w - 1].length == 0))) continue;
+                    _records[w++] = _records[r];
+                }
+                _records.resize(w);
+            }
+            else
+            {
+                // The survivors are moved to a new vector, which keeps the order of the items in one pass.
+                std::pmr::vector<textCorpusItem> kept(resource());
+                kept.reserve(before);
+                for (size_t r = 0; r < before; ++r)
+                {
+                    if (remove(r)) continue;
+                    if (_items[r].empty() && (kept.empty() || kept.back().empty())) continue;
+                    kept.emplace_back(std::move(_items[r]));
+                }
+                _items.swap(kept);
+            }
+            if (!_layout.empty()) _layout.index(*this);
+
+            return before - size();
+        }
+
+        // Where the text of the items is on the page, if the source of the text provided it.
+        const textLayout& layout() const
+        {
+            return _layout;
+        }
+
+        textLayout& layout()
+        {
+            return _layout;
         }
 
         bool splitSentences() const
@@ -82,114 +403,314 @@ namespace fsl::text
             _splitParagraphs = splitParagraphs;
         }
 
-        const std::vector<textCorpusItem>& parts() const
+        const std::pmr::vector<textCorpusItem>& parts() const
         {
             return _items;
         }
 
         void parseString(const std::string& input, bool append)
         {
-
+            size_t length = 0;
+            std::unique_ptr<wchar_t, decltype(&std::free)> wide(fsl::_private::_fromUTF8(input.data(), input.size(), &length), &std::free);
+            if (!wide) throw std::bad_alloc();
+            parser p(*this, append);
+            p.feed(std::wstring_view(wide.get(), length));
+            p.finish();
         }
 
         void parseString(const std::wstring& input, bool append)
         {
-            OutputDebugString(input.c_str());
-            std::vector<std::wstring> paragraphs;
-            std::vector<std::wstring> temp;
-            if (append)
+            parser p(*this, append);
+            p.feed(input);
+            p.finish();
+        }
+
+        // Adds a block of a structured document, such as a heading or list item, as an item of the given type.
+        // The text is normalised as parseString() does but markup is not removed. Paragraphs are split into
+        // lines, and sentences if set, as parseString() splits them; titles and list items are kept whole. If
+        // paragraphs are split an empty item follows the block.
+        void appendBlock(std::wstring_view text, textCorpusItem::itemType type)
+        {
+            FSL_INSTRUMENT_PHASE(parse);
+            _detach();
+            std::wstring copy;
+            copy.reserve(text.size());
+            fsl::_private::_normalizer normalizer;
+            for (const auto& c : text) normalizer.put(c, copy);
+
+            if (type == textCorpusItem::itemType::paragraph)
+            {
+                // A paragraph made up of line breaks alone adds nothing.
+                if (copy.find_first_not_of(L" \n") != std::wstring::npos) _emit(copy);
+                return;
+            }
+
+            // Line breaks inside a title or list item become spaces.
+            size_t w = 0;
+            for (size_t r = 0; r < copy.size(); ++r)
             {
-                if (_splitParagraphs && !_items.empty() && !_items.back().empty()) _items.emplace_back();
+                wchar_t c = (copy[r] == '\n') ? L' ' : copy[r];
+                if ((c == ' ') && ((w == 0) || (copy[w - 1] == ' '))) continue;
+                copy[w++] = c;
+            }
+            if ((w > 0) && (copy[w - 1] == ' ')) --w;
+            if (w == 0) return;
+            copy.resize(w);
+
+            FSL_INSTRUMENT_COUNT(itemsProduced, 1);
+            if (_compact)
+            {
+                _records.push_back({ _arena.size(), copy.size(), type });
+                _arena.append(copy);
             }
             else
             {
-                _items.clear();
+                _items.emplace_back(std::wstring_view(copy), textCorpusItem::span{ 0, copy.size(), type });
             }
+            if (_splitParagraphs) _appendDelimiter();
+        }
 
-            // The parsing of of a string will be carried out in X discrete phases.
-            // ---------------------------------------------------------------------------------------------------------
-            // Phase 1 - Obtain a copy of the string with all leading and trailing newlines and whitespaces removed.
-            // ---------------------------------------------------------------------------------------------------------
-            std::wstring trimmed = boost::algorithm::trim_copy_if(input, [](wchar_t wc){ if (wc == 0x000D) return true; return fsl::_private::_wspc_pred(wc); });
+        // Parses a string as parseString() does, with the same result, but splits the work over several threads.
+        // The string is cut into chunks just after line break pairs, which always end a paragraph, and the chunks
+        // are parsed in parallel. If a cut turns out to be inside markup the chunks either side of it are parsed
+        // again as one, and if that is not enough the string is parsed serially. If threads is 0 the hardware
+        // concurrency is used. Strings shorter than minChunk characters per thread are parsed serially.
+        void parseStringParallel(const std::wstring& input, bool append, unsigned int threads = 0, size_t minChunk = 1 << 20)
+        {
+            if (threads == 0) threads = std::max(1u, std::thread::hardware_concurrency());
+            if ((threads == 1) || (input.size() / threads < minChunk))
+            {
+                parser p(*this, append);
+                p.feed(input);
+                p.finish();
+                return;
+            }
 
-            // ---------------------------------------------------------------------------------------------------------
-            // Phase 2 - Call _prep_string() which will:-
-            //
-            // - Replace all '\r' and unicode line breaks with '\n'
-            // - Replace all unicode paragraph breaks with '\n\n'
-            // - Replace all white space characters with ASCII 32.
-            // - Ensure that there are no sequences of two or more consecutive white spaces (32) in the string.
-            // - Ensure that there are no sequences of more that two consecutive line breaks (\n) in the string.
-            // - Convert decorative unicode characters such as curly quotation marks to their ASCII equivalents.
-            // ---------------------------------------------------------------------------------------------------------
+            // Phase 1, see parser::feed().
+            size_t first = 0;
+            while ((first < input.size()) && ((input[first] == 0x000D) || fsl::_private::_wspc_pred(input[first]))) ++first;
 
-            std::wstring copy;
-            fsl::_private::_prep_string(trimmed, copy);
+            const auto isBreak = [](wchar_t c) { return (c == 0x000A) || (c == 0x000D) || (c == 0x2028) || (c == 0x2029); };
+            struct chunk
+            {
+                size_t begin;
+                size_t end;
+                textCorpus part;
+                fsl::_private::_htmlStripper stripper;
+            };
+            std::vector<chunk> chunks;
+            size_t target = std::max<size_t>((input.size() - first) / (threads * 4), 2);
+            for (size_t begin = first; begin < input.size();)
+            {
+                size_t end = begin + target;
+                while ((end < input.size()) && !(isBreak(input[end - 1]) && isBreak(input[end - 2]))) ++end;
+                if (end > input.size()) end = input.size();
+                chunks.push_back({ begin, end, textCorpus(), fsl::_private::_htmlStripper() });
+                begin = end;
+            }
 
-            // ---------------------------------------------------------------------------------------------------------
-            // Phase 3 - If the caller has requested it, remove all the HTML/XML tabs. Replace paragraph ends
-            // with '\n\n' and line breaks with '\n'
-            // ---------------------------------------------------------------------------------------------------------
-            if (_removeHtmlTags)
+            // Phases 2 to 5 for one chunk, starting with a fresh stripper and normaliser.
+            const auto run = [&](chunk& c)
+            {
+                std::wstring stripped;
+                std::wstring copy;
+                std::wstring_view text(input.data() + c.begin, c.end - c.begin);
+                c.part.clear();
+                c.part._compact = _compact;
+                c.part._splitSentences = _splitSentences;
+                c.part._splitParagraphs = _splitParagraphs;
+                c.stripper = fsl::_private::_htmlStripper();
+                if (_removeHtmlTags)
+                {
+                    stripped.reserve(text.size());
+                    for (const auto& ch : text) c.stripper.put(ch, stripped);
+                    if (c.end == input.size()) c.stripper.finish(stripped);
+                    text = stripped;
+                }
+                fsl::_private::_normalizer normalizer;
+                copy.reserve(text.size());
+                for (const auto& ch : text) normalizer.put(ch, copy);
+                c.part._emit(copy);
+            };
+
+            std::atomic<size_t> next{ 0 };
+            std::mutex errorLock;
+            std::exception_ptr error;
+            const auto worker = [&]()
             {
-                boost::ireplace_all(copy, L"</p>", L"\n\n");
-                boost::ireplace_all(copy, L"<br>", "\n");
-                boost::erase_all_regex(copy, boost::wregex(L"<[^<>]+>"));
+                try
+                {
+                    for (size_t i = next++; i < chunks.size(); i = next++) run(chunks[i]);
+                }
+                catch (...)
+                {
+                    std::lock_guard<std::mutex> lock(errorLock);
+                    if (!error) error = std::current_exception();
+                    next = chunks.size();
+                }
+            };
+
+            std::vector<std::thread> pool;
+            try
+            {
+                for (unsigned int t = 1; t < std::min<size_t>(threads, chunks.size()); ++t) pool.emplace_back(worker);
+            }
+            catch (const std::system_error&)
+            {
+                // Carry on with the threads we have.
             }
+            worker();
+            for (auto& t : pool) t.join();
+            if (error) std::rethrow_exception(error);
 
-            // ---------------------------------------------------------------------------------------------------------
-            // Phase 4 - Split the string into paragraphs.
-            // ---------------------------------------------------------------------------------------------------------
-            if (_splitSentences)
+            // A chunk that ended inside markup did not end a paragraph, parse it again together with the next one.
+            // The chunk it was merged with then started outside markup, so a fresh stripper was the right state for
+            // it. Markup that runs past the merged chunk too, such as a comment that is never closed, would need
+            // more merges each parsing the text again, so the whole string is parsed serially instead.
+            for (size_t i = 0; i + 1 < chunks.size(); ++i)
             {
-                // Remove all single line breaks.
-                boost::wregex wrx(L"[^\\n]\\n {1,}");
-                boost::regex_replace(copy, wrx, L" ");
-                wrx.assign(L" \\n{1}");
-                boost::regex_replace(copy, wrx, L" ");
-
-                boost::wregex p1(L"!(\\s{1})");
-                boost::regex_replace(copy, p1, L"!\n");
-                boost::wregex p2(L"\\?(\\s{1})");
-                boost::regex_replace(copy, p2, L"!\n");
-                boost::wregex p3(L"!\"(\\s{1})");
-                boost::regex_replace(copy, p3, L"!\"\n");
-                boost::wregex p4(L"\\?\"(\\s{1})");
-                boost::regex_replace(copy, p4, L"?\"\n");
-                boost::wregex p5(L"\\.\"(\\s{1})");
-                boost::regex_replace(copy, p5, L".\"\n");
-                boost::wregex p6(L"!'(\\s{1})");
-                boost::regex_replace(copy, p6, L"!'\n");
-                boost::wregex p7(L"\\?'(\\s{1})");
-                boost::regex_replace(copy, p7, L"?'\n");
-                boost::wregex p8(L"\\.'(\\s{1})");
-                boost::regex_replace(copy, p8, L".'\n");
-                boost::wregex p9(L"(?<term>([a-zA-Z]{2,}|\\d{3,})(\\)|\\}|\\]{0,1})\\.)( {1})");
-                copy = boost::regex_replace(copy, p9, [](const boost::wsmatch& m)->std::wstring
-                    {
-                        return m["term"] + L"\n";
-                    });
-            }
-
-            boost::split_regex(paragraphs, copy, boost::wregex(L"\\n{2,}"));
-            for (auto& p : paragraphs)
-            {
-                copy = p;
-                
-                
-                boost::split_regex(temp, copy, boost::wregex(L"\\n{1}"));
-                for (const auto& s : temp)
+                if (chunks[i].stripper.idle()) continue;
+                chunks[i].end = chunks[i + 1].end;
+                chunks[i + 1].part.clear();
+                run(chunks[i]);
+                bool last = (chunks[i].end == input.size());
+                chunks.erase(chunks.begin() + static_cast<std::ptrdiff_t>(i) + 1);
+                if (!last && !chunks[i].stripper.idle())
                 {
-                    if (s.empty()) continue;
-                    textCorpusItem itm(s, textCorpusItem::itemType::paragraph);
-                    _items.push_back(std::move(itm));
+                    parser p(*this, append);
+                    p.feed(input);
+                    p.finish();
+                    return;
                 }
+            }
 
-                // If paragraphs are to be split, then add an empty item to delimit them.
-                if (_splitParagraphs) _items.emplace_back();
+            _begin(append);
+
+            size_t total = 0;
+            size_t length = 0;
+            for (const auto& c : chunks)
+            {
+                total += c.part.size();
+                length += c.part._arena.size();
             }
+            if (_compact)
+            {
+                _records.reserve(_records.size() + total);
+                _arena.reserve(_arena.size() + length);
+            }
+            else
+            {
+                _items.reserve(_items.size() + total);
+            }
+            for (auto& c : chunks) _take(c.part);
         }
 
+        // An incremental parser that accepts a string in arbitrary pieces. The whitespace, line break, markup and
+        // sentence state is carried from one piece to the next and the items of each paragraph are added to the
+        // corpus as soon as the paragraph is complete. The remainder is added by finish().
+        class parser
+        {
+        private:
+            textCorpus& _corpus;
+            fsl::_private::_htmlStripper _stripper;
+            fsl::_private::_normalizer _normalizer;
+            std::wstring _stripped;     // Output of the stripper for the current piece.
+            std::wstring _pending;      // Normalised text that has not been added to the corpus yet.
+            size_t _lastBreak;          // End of the last complete paragraph in _pending.
+            bool _started;
+
+            void _normalize(std::wstring_view text)
+            {
+                for (const auto& c : text)
+                {
+                    _normalizer.put(c, _pending);
+                    if (_normalizer.newlines() == 2) _lastBreak = _pending.size();
+                }
+            }
+
+            void _flush(size_t end)
+            {
+                std::wstring rest(_pending, end);
+                _pending.resize(end);
+                _corpus._emit(_pending);
+                _pending.swap(rest);
+                _lastBreak = 0;
+            }
+
+        public:
+            // If append is false the contents of the corpus are replaced.
+            parser(textCorpus& corpus, bool append) : _corpus(corpus)
+            {
+                _lastBreak = 0;
+                _started = false;
+                _corpus._begin(append);
+            }
+
+            parser(const parser&) = delete;
+            parser& operator=(const parser&) = delete;
+
+            void feed(std::wstring_view text)
+            {
+                FSL_INSTRUMENT_PHASE(parse);
+                // The parsing of of a string will be carried out in X discrete phases.
+                // -----------------------------------------------------------------------------------------------------
+                // Phase 1 - Skip all leading newlines and whitespaces. Trailing ones are dropped in phase 5.
+                // -----------------------------------------------------------------------------------------------------
+                if (!_started)
+                {
+                    size_t i = 0;
+                    while ((i < text.size()) && ((text[i] == 0x000D) || fsl::_private::_wspc_pred(text[i]))) ++i;
+                    text.remove_prefix(i);
+                    if (text.empty()) return;
+                    _started = true;
+                }
+
+                // -----------------------------------------------------------------------------------------------------
+                // Phase 2 - If the caller has requested it, remove all the HTML/XML tags and decode character
+                // entities in a single pass. Block level elements become '\n\n' and line breaks '\n'. This is done
+                // before the string is normalised so that decoded entities and the inserted breaks are normalised
+                // with the rest.
+                // -----------------------------------------------------------------------------------------------------
+                if (_corpus._removeHtmlTags)
+                {
+                    _stripped.clear();
+                    for (const auto& c : text) _stripper.put(c, _stripped);
+                    text = _stripped;
+                }
+
+                // -----------------------------------------------------------------------------------------------------
+                // Phase 3 - Normalise the string as _prep_string() does, this will:-
+                //
+                // - Replace all '\r' and unicode line breaks with '\n'
+                // - Replace all unicode paragraph breaks with '\n\n'
+                // - Replace all white space characters with ASCII 32.
+                // - Ensure that there are no sequences of two or more consecutive white spaces (32) in the string.
+                // - Ensure that there are no sequences of more that two consecutive line breaks (\n) in the string.
+                // - Convert decorative unicode characters such as curly quotation marks to their ASCII equivalents.
+                // -----------------------------------------------------------------------------------------------------
+                _pending.reserve(_pending.size() + text.size());
+                _normalize(text);
+
+                // Phases 4 and 5 are carried out on each complete paragraph.
+                if (_lastBreak != 0) _flush(_lastBreak);
+            }
+
+            void finish()
+            {
+                FSL_INSTRUMENT_PHASE(parse);
+                if (_corpus._removeHtmlTags)
+                {
+                    _stripped.clear();
+                    _stripper.finish(_stripped);
+                    _normalize(_stripped);
+                }
+                _flush(_pending.size());
+                _pending.clear();
+                _normalizer = fsl::_private::_normalizer();
+                _started = false;
+            }
+        };
+
         bool removeHtmlTags() const
         {
             return _removeHtmlTags;
@@ -20,6 +20,13 @@ along with this program.  If not, see <http://www.gnu.org/licenses/>.
 #ifndef _TEXT_CORPUS_ITEM_HPP_
 #define _TEXT_CORPUS_ITEM_HPP_
 
+#include <cstdlib>
+#include <memory>
+#include <memory_resource>
+#include <new>
+#include <string>
+#include <string_view>
+
 #include "stringUtils.hpp"
 
 namespace fsl::text
@@ -35,42 +42,86 @@ namespace fsl::text
             listItem,
         };
 
+        // A run of already normalised text inside a larger buffer.
+        struct span
+        {
+            size_t offset;
+            size_t length;
+            itemType type;
+        };
+
     private:
-        std::wstring _payload;
+        std::pmr::wstring _payload;
         itemType _type;
+
+        static std::wstring_view _trim(std::wstring_view text)
+        {
+            while (!text.empty() && fsl::_private::_wspc_pred(text.front())) text.remove_prefix(1);
+            while (!text.empty() && fsl::_private::_wspc_pred(text.back())) text.remove_suffix(1);
+
+            return text;
+        }
     public:
+        // The text of an item is allocated from the memory resource of its allocator, a pmr container of items
+        // passes its own to them.
+        using allocator_type = std::pmr::polymorphic_allocator<wchar_t>;
+
         textCorpusItem()
         {
             _type = itemType::paragraph;
         }
 
+        explicit textCorpusItem(const allocator_type& alloc) : _payload(alloc)
+        {
+            _type = itemType::paragraph;
+        }
+
         textCorpusItem(const textCorpusItem &other)
         {
             _payload = other._payload;
             _type = other._type;;
         }
 
-        textCorpusItem(textCorpusItem &&other) noexcept
+        textCorpusItem(const textCorpusItem &other, const allocator_type& alloc) : _payload(other._payload, alloc)
+        {
+            _type = other._type;
+        }
+
+        textCorpusItem(textCorpusItem &&other) noexcept : _payload(std::move(other._payload))
+        {
+            _type = other._type;
+        }
+
+        // The text is copied if alloc uses a different memory resource to other.
+        textCorpusItem(textCorpusItem &&other, const allocator_type& alloc) : _payload(std::move(other._payload), alloc)
         {
-            _payload = std::move(other._payload);
             _type = other._type;
         }
 
-        textCorpusItem(const std::wstring &str, itemType type)
+        textCorpusItem& operator=(const textCorpusItem&) = default;
+        textCorpusItem& operator=(textCorpusItem&&) = default;
+
+        textCorpusItem(const std::wstring &str, itemType type, const allocator_type& alloc = allocator_type()) : _payload(alloc)
         {
             _type = type;
-            auto temp = boost::algorithm::trim_copy_if(str, &fsl::_private::_wspc_pred);
-            fsl::_private::_prep_string(temp, _payload);
+            fsl::_private::_prep_string(_trim(str), _payload);
+        }
+
+        // Constructs an item from a span of a buffer that has already been through _prep_string() and trimmed,
+        // the text is copied as is.
+        textCorpusItem(std::wstring_view buffer, const span &s, const allocator_type& alloc = allocator_type()) : _payload(alloc)
+        {
+            _type = s.type;
+            _payload.assign(buffer.substr(s.offset, s.length));
         }
 
-        textCorpusItem(const std::string &str, itemType type)
+        textCorpusItem(const std::string &str, itemType type, const allocator_type& alloc = allocator_type()) : _payload(alloc)
         {
             _type = type;
-            auto wcs = fsl::_private::_fromUTF8(str.c_str());
-            std::wstring temp(wcs);
-            std::free(wcs);
-            boost::algorithm::trim_if(temp, &fsl::_private::_spc_pred);
-            fsl::_private::_prep_string(temp, _payload);
+            size_t length = 0;
+            std::unique_ptr<wchar_t, decltype(&std::free)> wcs(fsl::_private::_fromUTF8(str.c_str(), str.size(), &length), &std::free);
+            if (!wcs) throw std::bad_alloc();
+            fsl::_private::_prep_string(_trim(std::wstring_view(wcs.get(), length)), _payload);
             if ((_type == itemType::sentence) || (type == itemType::paragraph))
             {
 
@@ -86,6 +137,11 @@ namespace fsl::text
         }
 
         [[nodiscard]] std::wstring wideStringData() const
+        {
+            return std::wstring(_payload.data(), _payload.size());
+        }
+
+        [[nodiscard]] std::wstring_view wideStringView() const noexcept
         {
             return _payload;
         }
@@ -0,0 +1,250 @@
+/**************************************************************************
+Reads a plain text file a page at a time through a memory mapping.
+
+Copyright (C) 2021 Chris Morrison (gnosticist@protonmail.com)
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <http://www.gnu.org/licenses/>.
+**************************************************************************/
+
+#ifndef _TEXT_FILE_HPP_
+#define _TEXT_FILE_HPP_
+
+#include <algorithm>
+#include <cstdint>
+#include <filesystem>
+#include <memory>
+#include <stdexcept>
+#include <string>
+#include <string_view>
+
+#include "fileMapping.hpp"
+#include "stringUtils.hpp"
+
+namespace fsl::_private
+{
+    // A UTF-8 or UTF-16 text file split into pages of about the same size. Nothing is read when the file is
+    // opened apart from its byte order mark: where a page starts is worked out from its number alone, by
+    // looking for a paragraph break near the page size multiple, so a page is only read when it is decoded.
+    class _textFile
+    {
+    public:
+        enum class encoding
+        {
+            utf8,
+            utf16le,
+            utf16be
+        };
+
+    private:
+        static constexpr size_t _chunk_size = 16 * 1024;        // Characters decoded at a time.
+
+        std::unique_ptr<_fileMapping> _mapping;
+        encoding _encoding;
+        size_t _start;          // The first byte after the byte order mark.
+        size_t _end;            // The end of the last whole code unit.
+        size_t _pageSize;
+        unsigned int _pages;
+
+        [[nodiscard]] size_t _unitSize() const noexcept
+        {
+            return (_encoding == encoding::utf8) ? 1 : 2;
+        }
+
+        [[nodiscard]] unsigned int _unit(size_t offset) const noexcept
+        {
+            const uint8_t* p = _mapping->data() + offset;
+            if (_encoding == encoding::utf8) return p[0];
+            if (_encoding == encoding::utf16le) return static_cast<unsigned int>(p[0] | (p[1] << 8));
+
+            return static_cast<unsigned int>((p[0] << 8) | p[1]);
+        }
+
+        // Where the page after the given one, numbered from zero, starts. The page size multiple is moved on to
+        // just after the next blank line, or failing that the next line break, within half a page, or to the
+        // next character if there is neither. Pages never overlap, but only a cut at a blank line leaves the
+        // items unchanged: a cut at a line break or inside a line splits the paragraph, and the sentence if it
+        // runs on, into an item on each page.
+        [[nodiscard]] size_t _boundary(unsigned int page) const noexcept
+        {
+            if (page + 1 >= _pages) return _end;
+            size_t unit = _unitSize();
+            size_t target = _start + (static_cast<size_t>(page) + 1) * _pageSize;
+            size_t limit = std::min(_end, target + _pageSize / 2);
+
+            size_t lineBreak = 0;
+            for (size_t i = target; i < limit; i += unit)
+            {
+                if (_unit(i) != '\n') continue;
+                if (lineBreak == 0) lineBreak = i + unit;
+                size_t j = i + unit;
+                while ((j < _end) && ((_unit(j) == '\r') || (_unit(j) == ' ') || (_unit(j) == '\t'))) j += unit;
+                if ((j < _end) && (_unit(j) == '\n')) return j + unit;
+            }
+            if (lineBreak != 0) return lineBreak;
+
+            // Not in the middle of a UTF-8 sequence or a surrogate pair.
+            if (_encoding == encoding::utf8)
+            {
+                for (int n = 0; (n < 3) && (target < _end) && ((_unit(target) & 0xC0) == 0x80); ++n) ++target;
+            }
+            else if ((_unit(target) >= 0xDC00) && (_unit(target) <= 0xDFFF))
+            {
+                target += unit;
+            }
+
+            return target;
+        }
+
+        // Decodes UTF-8 from p up to end, returns where it stopped. Only whole sequences are decoded unless
+        // last is set, invalid ones become U+FFFD.
+        static const uint8_t* _decodeUtf8(const uint8_t* p, const uint8_t* end, bool last, std::wstring& out)
+        {
+            while (p < end)
+            {
+                // Runs of ASCII are widened in one go.
+                const uint8_t* ascii = p;
+                while ((ascii < end) && (*ascii < 0x80)) ++ascii;
+                if (ascii != p)
+                {
+                    size_t old = out.size();
+                    out.resize(old + static_cast<size_t>(ascii - p));
+                    wchar_t* o = &out[old];
+                    for (; p < ascii; ++p) *o++ = static_cast<wchar_t>(*p);
+                    continue;
+                }
+
+                unsigned int lead = *p;
+                int length = (lead >= 0xF0) ? 4 : (lead >= 0xE0) ? 3 : (lead >= 0xC0) ? 2 : 1;
+                if ((end - p < length) && !last) break;
+                unsigned long cp = (length == 4) ? (lead & 0x07) : (length == 3) ? (lead & 0x0F) : (lead & 0x1F);
+                bool valid = (length > 1) && (lead < 0xF5);
+                int n = 1;
+                for (; valid && (n < length); ++n)
+                {
+                    if ((p + n >= end) || ((p[n] & 0xC0) != 0x80))
+                    {
+                        valid = false;
+                        break;
+                    }
+                    cp = (cp << 6) | (p[n] & 0x3F);
+                }
+                // Overlong forms are invalid too.
+                if (valid && (((length == 2) && (cp < 0x80)) || ((length == 3) && (cp < 0x800)) || ((length == 4) && (cp < 0x10000)))) valid = false;
+                _append_code_point(out, valid ? cp : 0xFFFD);
+                p += valid ? length : std::max(n, 1);
+            }
+
+            return p;
+        }
+
+    public:
+        // Opens a text file split into pages of about pageSize bytes. Text without a byte order mark is taken to
+        // be UTF-8.
+        _textFile(const std::filesystem::path& file, size_t pageSize) : _mapping(std::make_unique<_fileMapping>(file))
+        {
+            if (pageSize < 1024) throw std::invalid_argument("pageSize must be at least 1024 bytes.");
+
+            const uint8_t* data = _mapping->data();
+            size_t size = _mapping->size();
+            _encoding = encoding::utf8;
+            _start = 0;
+            if ((size >= 4) && (data[0] == 0xFF) && (data[1] == 0xFE) && (data[2] == 0) && (data[3] == 0)) throw std::runtime_error("UTF-32 text files are not supported.");
+            if ((size >= 4) && (data[0] == 0) && (data[1] == 0) && (data[2] == 0xFE) && (data[3] == 0xFF)) throw std::runtime_error("UTF-32 text files are not supported.");
+            if ((size >= 3) && (data[0] == 0xEF) && (data[1] == 0xBB) && (data[2] == 0xBF))
+            {
+                _start = 3;
+            }
+            else if ((size >= 2) && (data[0] == 0xFF) && (data[1] == 0xFE))
+            {
+                _encoding = encoding::utf16le;
+                _start = 2;
+            }
+            else if ((size >= 2) && (data[0] == 0xFE) && (data[1] == 0xFF))
+            {
+                _encoding = encoding::utf16be;
+                _start = 2;
+            }
+
+            // Pages of UTF-16 text start on a code unit.
+            _pageSize = (_encoding == encoding::utf8) ? pageSize : pageSize & ~static_cast<size_t>(1);
+            _end = (_encoding == encoding::utf8) ? size : _start + ((size - _start) & ~static_cast<size_t>(1));
+            size_t pages = (_end - _start + _pageSize - 1) / _pageSize;
+            if (pages > 0xFFFFFFFFu) throw std::runtime_error("The text file has too many pages for the page size.");
+            _pages = std::max<unsigned int>(1, static_cast<unsigned int>(pages));
+        }
+
+        [[nodiscard]] unsigned int pages() const noexcept
+        {
+            return _pages;
+        }
+
+        [[nodiscard]] encoding textEncoding() const noexcept
+        {
+            return _encoding;
+        }
+
+        // Decodes a page, numbered from one, and hands it to out a piece at a time as a std::wstring_view.
+        template <typename Output>
+        void read(unsigned int page, Output&& out) const
+        {
+            if ((page == 0) || (page > _pages)) throw std::invalid_argument("page out of range.");
+            size_t from = (page == 1) ? _start : _boundary(page - 2);
+            size_t to = _boundary(page - 1);
+            const uint8_t* data = _mapping->data();
+
+            std::wstring text;
+            text.reserve(_chunk_size + 1);
+            if (_encoding == encoding::utf8)
+            {
+                const uint8_t* p = data + from;
+                const uint8_t* end = data + to;
+                while (p < end)
+                {
+                    text.clear();
+                    const uint8_t* stop = (static_cast<size_t>(end - p) > _chunk_size) ? p + _chunk_size : end;
+                    // A sequence cut by the end of the chunk is decoded with the next one.
+                    p = _decodeUtf8(p, stop, stop == end, text);
+                    out(std::wstring_view(text));
+                }
+            }
+            else
+            {
+                size_t i = from;
+                while (i < to)
+                {
+                    text.clear();
+                    size_t stop = std::min(to, i + 2 * _chunk_size);
+                    for (; i < stop; i += 2)
+                    {
+                        unsigned long c = _unit(i);
+                        if ((c >= 0xD800) && (c <= 0xDBFF) && (i + 2 < to))
+                        {
+                            unsigned long low = _unit(i + 2);
+                            if ((low >= 0xDC00) && (low <= 0xDFFF))
+                            {
+                                _append_code_point(text, 0x10000 + ((c - 0xD800) << 10) + (low - 0xDC00));
+                                i += 2;
+                                continue;
+                            }
+                        }
+                        _append_code_point(text, c);
+                    }
+                    out(std::wstring_view(text));
+                }
+            }
+        }
+    };
+}
+
+#endif // _TEXT_FILE_HPP_
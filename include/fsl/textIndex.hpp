@@ -0,0 +1,404 @@
+/**************************************************************************
+An inverted full text index over the pages of a document.
+
+Copyright (C) 2021 Chris Morrison (gnosticist@protonmail.com)
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <http://www.gnu.org/licenses/>.
+**************************************************************************/
+
+#ifndef _TEXT_INDEX_HPP_
+#define _TEXT_INDEX_HPP_
+
+#include <cstdint>
+#include <cstring>
+#include <cwctype>
+#include <algorithm>
+#include <istream>
+#include <map>
+#include <ostream>
+#include <set>
+#include <stdexcept>
+#include <string>
+#include <string_view>
+#include <vector>
+
+#include "textCorpus.hpp"
+
+namespace fsl::_private
+{
+    struct _posting
+    {
+        uint32_t page;
+        uint32_t item;
+        uint32_t position;  // Ordinal of the token in the item.
+        uint32_t offset;    // Offset of the token in the item, in characters.
+        uint32_t length;
+
+        bool operator<(const _posting& other) const
+        {
+            if (page != other.page) return page < other.page;
+            if (item != other.item) return item < other.item;
+            return position < other.position;
+        }
+    };
+
+    // The postings of one term, delta and variable length encoded in one buffer. The page is stored as a zig-zag
+    // encoded difference so pages may be added in any order, the item and position are differences from the
+    // previous posting when it is on the same page and item.
+    struct _postingList
+    {
+        std::vector<uint8_t> bytes;
+        uint32_t count = 0;
+        uint32_t lastPage = 0;
+        uint32_t lastItem = 0;
+        uint32_t lastPosition = 0;
+
+        static void _put(std::vector<uint8_t>& out, uint64_t v)
+        {
+            while (v >= 0x80)
+            {
+                out.push_back(static_cast<uint8_t>(v | 0x80));
+                v >>= 7;
+            }
+            out.push_back(static_cast<uint8_t>(v));
+        }
+
+        static uint64_t _get(const uint8_t*& p, const uint8_t* end)
+        {
+            uint64_t v = 0;
+            int shift = 0;
+            while ((p < end) && (*p & 0x80) && (shift < 63))
+            {
+                v |= static_cast<uint64_t>(*p++ & 0x7F) << shift;
+                shift += 7;
+            }
+            if (p < end) v |= static_cast<uint64_t>(*p++) << shift;
+
+            return v;
+        }
+
+        void add(uint32_t page, uint32_t item, uint32_t position, uint32_t offset)
+        {
+            int64_t pageDelta = static_cast<int64_t>(page) - static_cast<int64_t>(lastPage);
+            _put(bytes, (static_cast<uint64_t>(pageDelta) << 1) ^ static_cast<uint64_t>(pageDelta >> 63));
+            if ((pageDelta != 0) || (count == 0))
+            {
+                _put(bytes, item);
+                _put(bytes, position);
+            }
+            else if (item != lastItem)
+            {
+                _put(bytes, item - lastItem);
+                _put(bytes, position);
+            }
+            else
+            {
+                _put(bytes, 0);
+                _put(bytes, position - lastPosition);
+            }
+            _put(bytes, offset);
+            lastPage = page;
+            lastItem = item;
+            lastPosition = position;
+            ++count;
+        }
+
+        void decode(uint32_t length, std::vector<_posting>& out) const
+        {
+            const uint8_t* p = bytes.data();
+            const uint8_t* end = p + bytes.size();
+            uint32_t page = 0;
+            uint32_t item = 0;
+            uint32_t position = 0;
+            for (uint32_t i = 0; (i < count) && (p < end); ++i)
+            {
+                uint64_t z = _get(p, end);
+                int64_t pageDelta = static_cast<int64_t>(z >> 1) ^ -static_cast<int64_t>(z & 1);
+                page = static_cast<uint32_t>(page + pageDelta);
+                uint32_t a = static_cast<uint32_t>(_get(p, end));
+                uint32_t b = static_cast<uint32_t>(_get(p, end));
+                if ((pageDelta != 0) || (i == 0))
+                {
+                    item = a;
+                    position = b;
+                }
+                else if (a != 0)
+                {
+                    item += a;
+                    position = b;
+                }
+                else
+                {
+                    position += b;
+                }
+                uint32_t offset = static_cast<uint32_t>(_get(p, end));
+                out.push_back({ page, item, position, offset, length });
+            }
+        }
+    };
+}
+
+namespace fsl::text
+{
+    // An inverted index of the words in a set of textCorpus pages. Words are runs of letters and digits, folded
+    // to lower case. Pages can be added as they are extracted and the index can be saved alongside the document.
+    class textIndex
+    {
+    public:
+        // A match, offset and length are in characters within the text of the item.
+        struct hit
+        {
+            uint32_t page;
+            uint32_t item;
+            uint32_t offset;
+            uint32_t length;
+        };
+
+    private:
+        std::map<std::wstring, fsl::_private::_postingList, std::less<>> _terms;
+        std::set<uint32_t> _pages;
+
+        template <typename F>
+        static void _tokenize(std::wstring_view text, F&& f)
+        {
+            std::wstring token;
+            uint32_t position = 0;
+            size_t i = 0;
+            while (i < text.size())
+            {
+                while ((i < text.size()) && !std::iswalnum(text[i])) ++i;
+                if (i == text.size()) break;
+                size_t start = i;
+                token.clear();
+                while ((i < text.size()) && std::iswalnum(text[i])) token.push_back(static_cast<wchar_t>(std::towlower(text[i++])));
+                f(token, position++, static_cast<uint32_t>(start));
+            }
+        }
+
+        static std::vector<hit> _hits(std::vector<fsl::_private::_posting>& postings)
+        {
+            std::sort(postings.begin(), postings.end());
+            std::vector<hit> hits;
+            hits.reserve(postings.size());
+            for (const auto& p : postings) hits.push_back({ p.page, p.item, p.offset, p.length });
+
+            return hits;
+        }
+
+    public:
+        // Adds the words of a page. A page that has already been added is ignored.
+        void addPage(uint32_t page, const textCorpus& corpus)
+        {
+            if (!_pages.insert(page).second) return;
+            for (size_t i = 0; i < corpus.size(); ++i)
+            {
+                _tokenize(corpus.text(i), [&](const std::wstring& token, uint32_t position, uint32_t offset)
+                    {
+                        auto it = _terms.find(token);
+                        if (it == _terms.end()) it = _terms.emplace(token, fsl::_private::_postingList()).first;
+                        it->second.add(page, static_cast<uint32_t>(i), position, offset);
+                    });
+            }
+        }
+
+        [[nodiscard]] bool hasPage(uint32_t page) const
+        {
+            return _pages.count(page) != 0;
+        }
+
+        [[nodiscard]] size_t termCount() const
+        {
+            return _terms.size();
+        }
+
+        void clear()
+        {
+            _terms.clear();
+            _pages.clear();
+        }
+
+        // All the occurrences of a word, in page, item and position order.
+        [[nodiscard]] std::vector<hit> find(std::wstring_view word) const
+        {
+            std::vector<fsl::_private::_posting> postings;
+            _tokenize(word, [&](const std::wstring& token, uint32_t position, uint32_t)
+                {
+                    if (position != 0) return;
+                    auto it = _terms.find(token);
+                    if (it != _terms.end()) it->second.decode(static_cast<uint32_t>(token.size()), postings);
+                });
+
+            return _hits(postings);
+        }
+
+        // All the occurrences of words that start with prefix.
+        [[nodiscard]] std::vector<hit> findPrefix(std::wstring_view prefix) const
+        {
+            std::wstring folded;
+            for (auto c : prefix) folded.push_back(static_cast<wchar_t>(std::towlower(c)));
+            std::vector<fsl::_private::_posting> postings;
+            for (auto it = _terms.lower_bound(folded); (it != _terms.end()) && (it->first.compare(0, folded.size(), folded) == 0); ++it)
+            {
+                it->second.decode(static_cast<uint32_t>(it->first.size()), postings);
+            }
+
+            return _hits(postings);
+        }
+
+        // All the occurrences of the words of phrase next to each other, in order, within one item. Punctuation
+        // and spacing between the words is ignored.
+        [[nodiscard]] std::vector<hit> findPhrase(std::wstring_view phrase) const
+        {
+            std::vector<std::vector<fsl::_private::_posting>> lists;
+            bool missing = false;
+            _tokenize(phrase, [&](const std::wstring& token, uint32_t, uint32_t)
+                {
+                    auto it = _terms.find(token);
+                    if (it == _terms.end())
+                    {
+                        missing = true;
+                        return;
+                    }
+                    lists.emplace_back();
+                    it->second.decode(static_cast<uint32_t>(token.size()), lists.back());
+                    std::sort(lists.back().begin(), lists.back().end());
+                });
+            if (missing || lists.empty()) return std::vector<hit>();
+
+            std::vector<hit> hits;
+            for (const auto& first : lists[0])
+            {
+                const fsl::_private::_posting* last = &first;
+                for (size_t j = 1; (j < lists.size()) && last; ++j)
+                {
+                    fsl::_private::_posting key = first;
+                    key.position += static_cast<uint32_t>(j);
+                    auto it = std::lower_bound(lists[j].begin(), lists[j].end(), key);
+                    if ((it != lists[j].end()) && (it->page == key.page) && (it->item == key.item) && (it->position == key.position)) last = &*it;
+                    else last = nullptr;
+                }
+                if (last) hits.push_back({ first.page, first.item, first.offset, last->offset + last->length - first.offset });
+            }
+
+            return hits;
+        }
+
+        // Writes the index in a binary format. Characters are stored in the native wchar_t size and byte order.
+        void save(std::ostream& out) const
+        {
+            const auto put = [&](uint64_t v) { out.write(reinterpret_cast<const char*>(&v), sizeof(v)); };
+            out.write("FSLINDX", 8);
+            put(1);
+            put(sizeof(wchar_t));
+            put(_pages.size());
+            for (auto p : _pages) put(p);
+            put(_terms.size());
+            for (const auto& [term, list] : _terms)
+            {
+                put(term.size());
+                out.write(reinterpret_cast<const char*>(term.data()), term.size() * sizeof(wchar_t));
+                put(list.count);
+                put((static_cast<uint64_t>(list.lastPage) << 32) | list.lastItem);
+                put(list.lastPosition);
+                put(list.bytes.size());
+                out.write(reinterpret_cast<const char*>(list.bytes.data()), list.bytes.size());
+            }
+            if (!out) throw std::runtime_error("The index could not be written.");
+        }
+
+        // Replaces the contents with an index written by save(). Returns false, leaving the index empty, if the
+        // data is not a valid index for this platform. Lengths longer than what is left of the stream are rejected
+        // before anything is allocated for them; if the stream cannot tell, posting lists are read a block at a
+        // time so that a damaged length cannot allocate much more than the stream holds.
+        bool load(std::istream& in)
+        {
+            clear();
+            uint64_t v = 0;
+            const auto get = [&]() { in.read(reinterpret_cast<char*>(&v), sizeof(v)); return static_cast<bool>(in); };
+
+            std::streamoff end = -1;
+            std::streampos start = in.tellg();
+            if (start != std::streampos(-1))
+            {
+                in.seekg(0, std::ios::end);
+                end = in.tellg();
+                in.seekg(start);
+                if (!in) return false;
+            }
+            const auto holds = [&](uint64_t bytes)
+            {
+                if (end < 0) return true;
+                std::streamoff pos = in.tellg();
+                return (pos >= 0) && (pos <= end) && (static_cast<uint64_t>(end - pos) >= bytes);
+            };
+
+            char magic[8];
+            if (!in.read(magic, 8) || (std::memcmp(magic, "FSLINDX", 8) != 0)) return false;
+            if (!get() || (v != 1) || !get() || (v != sizeof(wchar_t)) || !get()) return false;
+            for (uint64_t n = v; n > 0; --n)
+            {
+                if (!get()) return false;
+                _pages.insert(static_cast<uint32_t>(v));
+            }
+            if (!get()) return false;
+            bool ok = true;
+            for (uint64_t n = v; ok && (n > 0); --n)
+            {
+                std::wstring term;
+                fsl::_private::_postingList list;
+                ok = get() && (v <= 4096) && holds(v * sizeof(wchar_t));
+                if (ok)
+                {
+                    term.resize(v);
+                    ok = in.read(reinterpret_cast<char*>(term.data()), term.size() * sizeof(wchar_t)) && get();
+                }
+                if (ok)
+                {
+                    list.count = static_cast<uint32_t>(v);
+                    ok = get();
+                }
+                if (ok)
+                {
+                    list.lastPage = static_cast<uint32_t>(v >> 32);
+                    list.lastItem = static_cast<uint32_t>(v);
+                    ok = get();
+                }
+                if (ok)
+                {
+                    list.lastPosition = static_cast<uint32_t>(v);
+                    ok = get() && (v <= 0xFFFFFFFF) && holds(v);
+                }
+                if (ok && (end >= 0)) list.bytes.reserve(static_cast<size_t>(v));
+                for (uint64_t left = v; ok && (left > 0);)
+                {
+                    size_t n = static_cast<size_t>(std::min<uint64_t>(left, 64 * 1024));
+                    size_t old = list.bytes.size();
+                    list.bytes.resize(old + n);
+                    ok = static_cast<bool>(in.read(reinterpret_cast<char*>(list.bytes.data() + old), static_cast<std::streamsize>(n)));
+                    left -= n;
+                }
+                if (ok) _terms.emplace(std::move(term), std::move(list));
+            }
+            if (!ok)
+            {
+                clear();
+                return false;
+            }
+
+            return true;
+        }
+    };
+}
+
+#endif // _TEXT_INDEX_HPP_
@@ -0,0 +1,359 @@
+/**************************************************************************
+The position of text on a page and a spatial index for hit testing.
+
+Copyright (C) 2021 Chris Morrison (gnosticist@protonmail.com)
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <http://www.gnu.org/licenses/>.
+**************************************************************************/
+
+#ifndef _TEXT_LAYOUT_HPP_
+#define _TEXT_LAYOUT_HPP_
+
+#include <cmath>
+#include <cstdint>
+#include <algorithm>
+#include <limits>
+#include <string>
+#include <string_view>
+#include <vector>
+
+namespace fsl::text
+{
+    // The bounding boxes of the runs of text shown on a page and of the items they ended up in.
+    //
+    // A run is the text of one text showing operator, its box is in the units and orientation of the page
+    // (PDF user space, origin bottom left). The boxes are stored as separate arrays of coordinates so queries
+    // only touch the data they test. After the items of the corpus have been built, index() aligns the runs
+    // with the items and builds a uniform grid over the runs for point and rectangle queries.
+    class textLayout
+    {
+    public:
+        struct box
+        {
+            float x0;
+            float y0;
+            float x1;
+            float y1;
+
+            [[nodiscard]] bool empty() const
+            {
+                return (x1 < x0) || (y1 < y0);
+            }
+
+            [[nodiscard]] bool contains(float x, float y) const
+            {
+                return (x >= x0) && (x <= x1) && (y >= y0) && (y <= y1);
+            }
+
+            [[nodiscard]] bool intersects(const box& other) const
+            {
+                return (other.x0 <= x1) && (other.x1 >= x0) && (other.y0 <= y1) && (other.y1 >= y0);
+            }
+        };
+
+        static constexpr uint32_t none = std::numeric_limits<uint32_t>::max();
+
+    private:
+        // Runs.
+        std::vector<float> _x0;
+        std::vector<float> _y0;
+        std::vector<float> _x1;
+        std::vector<float> _y1;
+        std::vector<uint32_t> _textStart;   // Offset of the text of each run in _text, plus one past the end.
+        std::vector<uint32_t> _firstItem;   // The first and last item each run contributed to, or none.
+        std::vector<uint32_t> _lastItem;
+        std::wstring _text;
+
+        // Items.
+        std::vector<box> _itemBoxes;
+
+        // Grid, the runs overlapping cell c are _cellRuns[_cellStart[c]] to _cellRuns[_cellStart[c + 1]].
+        box _bounds = { 0, 0, -1, -1 };
+        uint32_t _columns = 0;
+        uint32_t _rows = 0;
+        float _cellWidth = 0;
+        float _cellHeight = 0;
+        std::vector<uint32_t> _cellStart;
+        std::vector<uint32_t> _cellRuns;
+
+        static bool _space(wchar_t c)
+        {
+            return (c == ' ') || (c == '\t') || (c == '\n') || (c == '\r') || (c == 0x00A0);
+        }
+
+        uint32_t _column(float x) const
+        {
+            auto c = static_cast<int64_t>((x - _bounds.x0) / _cellWidth);
+            return static_cast<uint32_t>(std::clamp<int64_t>(c, 0, _columns - 1));
+        }
+
+        uint32_t _row(float y) const
+        {
+            auto r = static_cast<int64_t>((y - _bounds.y0) / _cellHeight);
+            return static_cast<uint32_t>(std::clamp<int64_t>(r, 0, _rows - 1));
+        }
+
+        // Matches the characters of the runs, in order, with the characters of the items, ignoring white space.
+        // The normaliser may replace or expand a character so on a mismatch the next few characters of the item
+        // are searched before the run character is given up on.
+        template <typename Corpus>
+        void _align(const Corpus& corpus)
+        {
+            constexpr size_t lookAhead = 4;
+
+            size_t items = corpus.size();
+            _firstItem.assign(runCount(), none);
+            _lastItem.assign(runCount(), none);
+            _itemBoxes.assign(items, box{ 0, 0, -1, -1 });
+
+            size_t item = 0;
+            size_t pos = 0;
+            std::wstring_view text = (items > 0) ? corpus.text(0) : std::wstring_view();
+            // Moves to the next character of the items that is not white space, returns false at the end.
+            const auto skip = [&](size_t& i, size_t& p, std::wstring_view& t)
+            {
+                while (i < items)
+                {
+                    while ((p < t.size()) && _space(t[p])) ++p;
+                    if (p < t.size()) return true;
+                    if (++i < items) t = corpus.text(i);
+                    p = 0;
+                }
+                return false;
+            };
+
+            for (size_t r = 0; r < runCount(); ++r)
+            {
+                auto run = runText(r);
+                for (wchar_t c : run)
+                {
+                    if (_space(c)) continue;
+                    if (!skip(item, pos, text)) break;
+
+                    size_t i = item;
+                    size_t p = pos;
+                    std::wstring_view t = text;
+                    bool found = false;
+                    for (size_t n = 0; (n <= lookAhead) && skip(i, p, t); ++n, ++p)
+                    {
+                        if (t[p] == c)
+                        {
+                            found = true;
+                            break;
+                        }
+                    }
+                    if (!found) continue;
+
+                    item = i;
+                    pos = p + 1;
+                    text = t;
+                    if (_firstItem[r] == none) _firstItem[r] = static_cast<uint32_t>(item);
+                    _lastItem[r] = static_cast<uint32_t>(item);
+                }
+
+                if (_firstItem[r] == none) continue;
+                box b = runBox(r);
+                for (size_t i = _firstItem[r]; i <= _lastItem[r]; ++i)
+                {
+                    box& ib = _itemBoxes[i];
+                    if (ib.empty()) ib = b;
+                    else ib = { std::min(ib.x0, b.x0), std::min(ib.y0, b.y0), std::max(ib.x1, b.x1), std::max(ib.y1, b.y1) };
+                }
+            }
+        }
+
+        void _buildGrid()
+        {
+            _cellStart.clear();
+            _cellRuns.clear();
+            _bounds = { 0, 0, -1, -1 };
+            _columns = _rows = 0;
+            if (runCount() == 0) return;
+
+            _bounds = { _x0[0], _y0[0], _x1[0], _y1[0] };
+            for (size_t r = 1; r < runCount(); ++r)
+            {
+                _bounds.x0 = std::min(_bounds.x0, _x0[r]);
+                _bounds.y0 = std::min(_bounds.y0, _y0[r]);
+                _bounds.x1 = std::max(_bounds.x1, _x1[r]);
+                _bounds.y1 = std::max(_bounds.y1, _y1[r]);
+            }
+
+            // About one cell per run, shaped like the page, so a cell holds a handful of runs.
+            float width = std::max(_bounds.x1 - _bounds.x0, 1.0f);
+            float height = std::max(_bounds.y1 - _bounds.y0, 1.0f);
+            double cells = static_cast<double>(runCount());
+            _columns = static_cast<uint32_t>(std::clamp(std::sqrt(cells * width / height), 1.0, 1024.0));
+            _rows = static_cast<uint32_t>(std::clamp(cells / _columns, 1.0, 1024.0));
+            _cellWidth = width / static_cast<float>(_columns);
+            _cellHeight = height / static_cast<float>(_rows);
+
+            // Count, prefix sum and fill.
+            _cellStart.assign(static_cast<size_t>(_columns) * _rows + 1, 0);
+            const auto cover = [&](size_t r, auto&& f)
+            {
+                uint32_t c0 = _column(_x0[r]);
+                uint32_t c1 = _column(_x1[r]);
+                uint32_t r0 = _row(_y0[r]);
+                uint32_t r1 = _row(_y1[r]);
+                for (uint32_t y = r0; y <= r1; ++y)
+                {
+                    for (uint32_t x = c0; x <= c1; ++x) f(static_cast<size_t>(y) * _columns + x);
+                }
+            };
+            for (size_t r = 0; r < runCount(); ++r) cover(r, [&](size_t cell) { ++_cellStart[cell + 1]; });
+            for (size_t c = 1; c < _cellStart.size(); ++c) _cellStart[c] += _cellStart[c - 1];
+            _cellRuns.resize(_cellStart.back());
+            std::vector<uint32_t> fill(_cellStart.begin(), _cellStart.end() - 1);
+            for (size_t r = 0; r < runCount(); ++r) cover(r, [&](size_t cell) { _cellRuns[fill[cell]++] = static_cast<uint32_t>(r); });
+        }
+
+    public:
+        [[nodiscard]] bool empty() const noexcept
+        {
+            return _x0.empty();
+        }
+
+        void clear()
+        {
+            _x0.clear();
+            _y0.clear();
+            _x1.clear();
+            _y1.clear();
+            _textStart.clear();
+            _firstItem.clear();
+            _lastItem.clear();
+            _text.clear();
+            _itemBoxes.clear();
+            _cellStart.clear();
+            _cellRuns.clear();
+            _bounds = { 0, 0, -1, -1 };
+            _columns = _rows = 0;
+        }
+
+        // Records a run of text as it is shown. The runs are not searchable until index() is called.
+        void addRun(std::wstring_view text, const box& b)
+        {
+            if (_textStart.empty()) _textStart.push_back(0);
+            _x0.push_back(std::min(b.x0, b.x1));
+            _y0.push_back(std::min(b.y0, b.y1));
+            _x1.push_back(std::max(b.x0, b.x1));
+            _y1.push_back(std::max(b.y0, b.y1));
+            _text.append(text);
+            _textStart.push_back(static_cast<uint32_t>(_text.size()));
+        }
+
+        // Works out which items each run ended up in and builds the spatial index. Must be called again after
+        // the items of the corpus change.
+        template <typename Corpus>
+        void index(const Corpus& corpus)
+        {
+            _align(corpus);
+            _buildGrid();
+        }
+
+        [[nodiscard]] size_t runCount() const noexcept
+        {
+            return _x0.size();
+        }
+
+        [[nodiscard]] box runBox(size_t run) const
+        {
+            return { _x0[run], _y0[run], _x1[run], _y1[run] };
+        }
+
+        [[nodiscard]] std::wstring_view runText(size_t run) const
+        {
+            return std::wstring_view(_text).substr(_textStart[run], _textStart[run + 1] - _textStart[run]);
+        }
+
+        // The first item the text of a run is in, or none if it could not be found in the items.
+        [[nodiscard]] uint32_t runItem(size_t run) const
+        {
+            return (run < _firstItem.size()) ? _firstItem[run] : none;
+        }
+
+        // The union of the boxes of the runs that make up an item, empty if none do (e.g. paragraph delimiters).
+        [[nodiscard]] box itemBox(size_t item) const
+        {
+            return (item < _itemBoxes.size()) ? _itemBoxes[item] : box{ 0, 0, -1, -1 };
+        }
+
+        // The run under a point, or none. If runs overlap the first one shown is returned.
+        [[nodiscard]] uint32_t runAt(float x, float y) const
+        {
+            if (_columns == 0 || !_bounds.contains(x, y)) return none;
+            size_t cell = static_cast<size_t>(_row(y)) * _columns + _column(x);
+            uint32_t found = none;
+            for (uint32_t i = _cellStart[cell]; i < _cellStart[cell + 1]; ++i)
+            {
+                uint32_t r = _cellRuns[i];
+                if ((r < found) && (x >= _x0[r]) && (x <= _x1[r]) && (y >= _y0[r]) && (y <= _y1[r])) found = r;
+            }
+
+            return found;
+        }
+
+        // The runs that intersect a rectangle, in the order they were shown.
+        [[nodiscard]] std::vector<uint32_t> runsIn(const box& area) const
+        {
+            std::vector<uint32_t> runs;
+            if ((_columns == 0) || area.empty() || !_bounds.intersects(area)) return runs;
+            uint32_t c0 = _column(area.x0);
+            uint32_t c1 = _column(area.x1);
+            uint32_t r0 = _row(area.y0);
+            uint32_t r1 = _row(area.y1);
+            for (uint32_t y = r0; y <= r1; ++y)
+            {
+                for (uint32_t x = c0; x <= c1; ++x)
+                {
+                    size_t cell = static_cast<size_t>(y) * _columns + x;
+                    for (uint32_t i = _cellStart[cell]; i < _cellStart[cell + 1]; ++i)
+                    {
+                        uint32_t r = _cellRuns[i];
+                        if (area.intersects(runBox(r))) runs.push_back(r);
+                    }
+                }
+            }
+            std::sort(runs.begin(), runs.end());
+            runs.erase(std::unique(runs.begin(), runs.end()), runs.end());
+
+            return runs;
+        }
+
+        // The item under a point, or none.
+        [[nodiscard]] uint32_t itemAt(float x, float y) const
+        {
+            uint32_t r = runAt(x, y);
+            return (r == none) ? none : _firstItem[r];
+        }
+
+        // The items with text inside a rectangle, in order.
+        [[nodiscard]] std::vector<uint32_t> itemsIn(const box& area) const
+        {
+            std::vector<uint32_t> items;
+            for (auto r : runsIn(area))
+            {
+                if (_firstItem[r] == none) continue;
+                for (uint32_t i = _firstItem[r]; i <= _lastItem[r]; ++i) items.push_back(i);
+            }
+            std::sort(items.begin(), items.end());
+            items.erase(std::unique(items.begin(), items.end()), items.end());
+
+            return items;
+        }
+    };
+}
+
+#endif // _TEXT_LAYOUT_HPP_
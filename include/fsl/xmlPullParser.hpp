@@ -0,0 +1,480 @@
+/**************************************************************************
+A streaming pull parser for XML documents.
+
+Copyright (C) 2021 Chris Morrison (gnosticist@protonmail.com)
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <http://www.gnu.org/licenses/>.
+**************************************************************************/
+
+#ifndef _XML_PULL_PARSER_HPP_
+#define _XML_PULL_PARSER_HPP_
+
+#include <algorithm>
+#include <cstdlib>
+#include <cstring>
+#include <functional>
+#include <stdexcept>
+#include <string>
+#include <string_view>
+#include <utility>
+#include <vector>
+
+#include "stringUtils.hpp"
+
+namespace fsl::_private
+{
+    // Pulls the elements and text of a UTF-8 XML document from a source one event at a time, without building
+    // a tree. The source is read a buffer at a time and long runs of text are returned in pieces, so the memory
+    // used does not depend on the size of the document. Names are returned as written, prefix included;
+    // namespaces are not resolved. Comments, processing instructions and the document type are skipped.
+    class _xmlPullParser
+    {
+    public:
+        enum class event
+        {
+            startElement,
+            endElement,
+            text,
+            end,
+        };
+
+        // Copies up to size bytes into buffer and returns the number copied, zero at the end of the document.
+        using source = std::function<size_t(char* buffer, size_t size)>;
+
+    private:
+        static constexpr size_t _buffer_size = 64 * 1024;
+        static constexpr size_t _max_text = 16 * 1024;      // Characters per text event.
+
+        source _read;
+        std::vector<char> _buffer;
+        size_t _pos;
+        size_t _length;
+        bool _eof;
+
+        std::string _name;
+        std::vector<std::pair<std::string, std::string>> _attributes;   // Reused, the first _attributeCount are set.
+        size_t _attributeCount;
+        std::wstring _text;
+        bool _pendingEnd;                               // The last start element closed itself.
+        bool _cdata;                                    // Inside a CDATA section longer than a text event.
+        size_t _depth;
+
+        [[noreturn]] static void _malformed()
+        {
+            throw std::runtime_error("The XML document is malformed.");
+        }
+
+        bool _fill()
+        {
+            if (_pos < _length) return true;
+            if (_eof) return false;
+            _pos = 0;
+            _length = _read(_buffer.data(), _buffer.size());
+            if (_length == 0) _eof = true;
+
+            return _length > 0;
+        }
+
+        int _peek()
+        {
+            return _fill() ? static_cast<unsigned char>(_buffer[_pos]) : -1;
+        }
+
+        int _get()
+        {
+            return _fill() ? static_cast<unsigned char>(_buffer[_pos++]) : -1;
+        }
+
+        void _expect(char c)
+        {
+            if (_get() != static_cast<unsigned char>(c)) _malformed();
+        }
+
+        static bool _space(int c)
+        {
+            return (c == ' ') || (c == '\t') || (c == '\r') || (c == '\n');
+        }
+
+        void _skipSpace()
+        {
+            while (_space(_peek())) ++_pos;
+        }
+
+        // Skips up to and including the terminator.
+        void _skipPast(const char* terminator)
+        {
+            size_t length = std::strlen(terminator);
+            size_t matched = 0;
+            while (matched < length)
+            {
+                int c = _get();
+                if (c < 0) _malformed();
+                if (c == static_cast<unsigned char>(terminator[matched])) ++matched;
+                else matched = (c == static_cast<unsigned char>(terminator[0])) ? 1 : 0;
+            }
+        }
+
+        // Skips a document type declaration, which may hold an internal subset in brackets.
+        void _skipDoctype()
+        {
+            int nesting = 0;
+            while (true)
+            {
+                int c = _get();
+                if (c < 0) _malformed();
+                if (c == '[') ++nesting;
+                else if (c == ']') --nesting;
+                else if ((c == '>') && (nesting <= 0)) return;
+            }
+        }
+
+        void _readName(std::string& out)
+        {
+            out.clear();
+            while (_fill())
+            {
+                // Copy what is in the buffer in one go, names are only split when they cross a refill.
+                size_t end = _pos;
+                while (end < _length)
+                {
+                    char c = _buffer[end];
+                    if (_space(c) || (c == '>') || (c == '/') || (c == '=')) break;
+                    ++end;
+                }
+                out.append(&_buffer[_pos], end - _pos);
+                _pos = end;
+                if (end < _length) break;
+            }
+            if (out.empty()) _malformed();
+        }
+
+        // Decodes one UTF-8 sequence whose first byte has been read. Invalid sequences become U+FFFD.
+        unsigned long _codePoint(int first)
+        {
+            int extra = 0;
+            unsigned long cp = 0;
+            if (first < 0x80) return static_cast<unsigned long>(first);
+            if ((first & 0xE0) == 0xC0) { extra = 1; cp = first & 0x1F; }
+            else if ((first & 0xF0) == 0xE0) { extra = 2; cp = first & 0x0F; }
+            else if ((first & 0xF8) == 0xF0) { extra = 3; cp = first & 0x07; }
+            else return 0xFFFD;
+            for (int i = 0; i < extra; ++i)
+            {
+                int c = _peek();
+                if ((c < 0) || ((c & 0xC0) != 0x80)) return 0xFFFD;
+                ++_pos;
+                cp = (cp << 6) | (c & 0x3F);
+            }
+
+            return cp;
+        }
+
+        // Reads an entity reference after the '&', returns its code point.
+        unsigned long _entity()
+        {
+            char name[12];
+            size_t n = 0;
+            while (true)
+            {
+                int c = _get();
+                if (c < 0) _malformed();
+                if (c == ';') break;
+                if (n + 1 >= sizeof(name)) _malformed();
+                name[n++] = static_cast<char>(c);
+            }
+            name[n] = '\0';
+            if (name[0] == '#')
+            {
+                bool hex = (name[1] == 'x') || (name[1] == 'X');
+                char* end = nullptr;
+                unsigned long cp = std::strtoul(name + (hex ? 2 : 1), &end, hex ? 16 : 10);
+                if (!end || (*end != '\0')) _malformed();
+                return cp;
+            }
+            if (std::strcmp(name, "lt") == 0) return '<';
+            if (std::strcmp(name, "gt") == 0) return '>';
+            if (std::strcmp(name, "amp") == 0) return '&';
+            if (std::strcmp(name, "quot") == 0) return '"';
+            if (std::strcmp(name, "apos") == 0) return '\'';
+            _malformed();
+        }
+
+        static void _appendUtf8(std::string& out, unsigned long cp)
+        {
+            if ((cp > 0x10FFFF) || ((cp >= 0xD800) && (cp <= 0xDFFF))) cp = 0xFFFD;
+            if (cp < 0x80)
+            {
+                out.push_back(static_cast<char>(cp));
+            }
+            else if (cp < 0x800)
+            {
+                out.push_back(static_cast<char>(0xC0 | (cp >> 6)));
+                out.push_back(static_cast<char>(0x80 | (cp & 0x3F)));
+            }
+            else if (cp < 0x10000)
+            {
+                out.push_back(static_cast<char>(0xE0 | (cp >> 12)));
+                out.push_back(static_cast<char>(0x80 | ((cp >> 6) & 0x3F)));
+                out.push_back(static_cast<char>(0x80 | (cp & 0x3F)));
+            }
+            else
+            {
+                out.push_back(static_cast<char>(0xF0 | (cp >> 18)));
+                out.push_back(static_cast<char>(0x80 | ((cp >> 12) & 0x3F)));
+                out.push_back(static_cast<char>(0x80 | ((cp >> 6) & 0x3F)));
+                out.push_back(static_cast<char>(0x80 | (cp & 0x3F)));
+            }
+        }
+
+        void _readAttributes()
+        {
+            _attributeCount = 0;
+            while (true)
+            {
+                _skipSpace();
+                int c = _peek();
+                if ((c == '>') || (c == '/')) return;
+                if (c < 0) _malformed();
+                if (_attributeCount == _attributes.size()) _attributes.emplace_back();
+                auto& attribute = _attributes[_attributeCount];
+                attribute.second.clear();
+                _readName(attribute.first);
+                _skipSpace();
+                _expect('=');
+                _skipSpace();
+                int quote = _get();
+                if ((quote != '"') && (quote != '\'')) _malformed();
+                while (true)
+                {
+                    if (!_fill()) _malformed();
+                    size_t end = _pos;
+                    while ((end < _length) && (_buffer[end] != quote) && (_buffer[end] != '&')) ++end;
+                    attribute.second.append(&_buffer[_pos], end - _pos);
+                    _pos = end;
+                    if (end == _length) continue;
+                    if (_buffer[_pos++] == quote) break;
+                    _appendUtf8(attribute.second, _entity());
+                }
+                ++_attributeCount;
+            }
+        }
+
+        // A line end whose carriage return has been read, taking the line feed of a CR LF pair with it. Both
+        // become a line feed, as XML 1.0 section 2.11 requires.
+        wchar_t _lineEnd()
+        {
+            if (_peek() == '\n') ++_pos;
+
+            return L'\n';
+        }
+
+        // Reads character data up to the next markup, or until a text event is full.
+        void _readText()
+        {
+            _text.clear();
+            while (_text.size() < _max_text)
+            {
+                if (!_fill()) return;
+
+                // Runs of plain ASCII, the bulk of most documents, are copied in one go.
+                size_t end = _pos;
+                size_t limit = std::min(_length, _pos + (_max_text - _text.size()));
+                while (end < limit)
+                {
+                    unsigned char c = static_cast<unsigned char>(_buffer[end]);
+                    if ((c == '<') || (c == '&') || (c == '\r') || (c >= 0x80)) break;
+                    ++end;
+                }
+                size_t old = _text.size();
+                _text.resize(old + (end - _pos));
+                wchar_t* out = &_text[old];
+                for (; _pos < end; ++_pos) *out++ = static_cast<unsigned char>(_buffer[_pos]);
+                if (end == limit) continue;
+
+                int c = static_cast<unsigned char>(_buffer[_pos]);
+                if (c == '<') return;
+                ++_pos;
+                if (c == '&') _append_code_point(_text, _entity());
+                else if (c >= 0x80) _append_code_point(_text, _codePoint(c));
+                else _text.push_back(_lineEnd());
+            }
+        }
+
+        // Reads a CDATA section after "<![CDATA[" into a text event, in pieces if it is long.
+        void _readCdata()
+        {
+            _text.clear();
+            while (_text.size() < _max_text)
+            {
+                int c = _get();
+                if (c < 0) _malformed();
+                if ((c == ']') && (_peek() == ']'))
+                {
+                    // Look for "]]>" without consuming a lone "]]".
+                    ++_pos;
+                    if (_peek() == '>')
+                    {
+                        ++_pos;
+                        _cdata = false;
+                        return;
+                    }
+                    _text.append(L"]]");
+                    continue;
+                }
+                if (c == '\r') _text.push_back(_lineEnd());
+                else if (c < 0x80) _text.push_back(static_cast<wchar_t>(c));
+                else _append_code_point(_text, _codePoint(c));
+            }
+        }
+
+    public:
+        explicit _xmlPullParser(source read) : _read(std::move(read)), _buffer(_buffer_size)
+        {
+            _pos = 0;
+            _length = 0;
+            _eof = false;
+            _attributeCount = 0;
+            _pendingEnd = false;
+            _depth = 0;
+            _cdata = false;
+
+            // Skip a byte order mark.
+            if ((_peek() == 0xEF) && (_length - _pos >= 3) && (static_cast<unsigned char>(_buffer[_pos + 1]) == 0xBB) && (static_cast<unsigned char>(_buffer[_pos + 2]) == 0xBF)) _pos += 3;
+        }
+
+        _xmlPullParser(const _xmlPullParser&) = delete;
+        _xmlPullParser& operator=(const _xmlPullParser&) = delete;
+
+        event next()
+        {
+            if (_pendingEnd)
+            {
+                _pendingEnd = false;
+                --_depth;
+                return event::endElement;
+            }
+            if (_cdata)
+            {
+                _readCdata();
+                return event::text;
+            }
+
+            while (true)
+            {
+                int c = _peek();
+                if (c < 0)
+                {
+                    if (_depth != 0) _malformed();
+                    return event::end;
+                }
+                if (c != '<')
+                {
+                    _readText();
+                    if (_depth == 0) continue;      // Whitespace around the root element.
+                    return event::text;
+                }
+
+                ++_pos;
+                c = _peek();
+                if (c == '?')
+                {
+                    _skipPast("?>");
+                    continue;
+                }
+                if (c == '!')
+                {
+                    ++_pos;
+                    if (_peek() == '-')
+                    {
+                        _skipPast("-->");
+                        continue;
+                    }
+                    if (_peek() == '[')
+                    {
+                        const char* open = "[CDATA[";
+                        for (const char* p = open; *p; ++p) _expect(*p);
+                        _cdata = true;
+                        _readCdata();
+                        return event::text;
+                    }
+                    _skipDoctype();
+                    continue;
+                }
+                if (c == '/')
+                {
+                    ++_pos;
+                    _readName(_name);
+                    _skipSpace();
+                    _expect('>');
+                    if (_depth == 0) _malformed();
+                    --_depth;
+                    _attributeCount = 0;
+                    return event::endElement;
+                }
+
+                _readName(_name);
+                _readAttributes();
+                if (_peek() == '/')
+                {
+                    ++_pos;
+                    _pendingEnd = true;
+                }
+                _expect('>');
+                ++_depth;
+                return event::startElement;
+            }
+        }
+
+        // The name of the element of a start or end event.
+        [[nodiscard]] const std::string& name() const noexcept
+        {
+            return _name;
+        }
+
+        // The value of an attribute of the element of a start event, null if it does not have it.
+        [[nodiscard]] const std::string* attribute(std::string_view name) const
+        {
+            for (size_t i = 0; i < _attributeCount; ++i)
+            {
+                if (_attributes[i].first == name) return &_attributes[i].second;
+            }
+
+            return nullptr;
+        }
+
+        // The text of a text event, entities decoded. Consecutive text events belong to the same run of text.
+        [[nodiscard]] const std::wstring& text() const noexcept
+        {
+            return _text;
+        }
+
+        // The number of elements open, including the one just started.
+        [[nodiscard]] size_t depth() const noexcept
+        {
+            return _depth;
+        }
+
+        // Skips the rest of the element just started, including its children.
+        void skipElement()
+        {
+            size_t depth = _depth;
+            while (_depth >= depth)
+            {
+                if (next() == event::end) _malformed();
+            }
+        }
+    };
+}
+
+#endif // _XML_PULL_PARSER_HPP_
@@ -0,0 +1,264 @@
+/**************************************************************************
+Reads the entries of a zip archive, such as an ODF or OOXML document.
+
+Copyright (C) 2021 Chris Morrison (gnosticist@protonmail.com)
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <http://www.gnu.org/licenses/>.
+**************************************************************************/
+
+#ifndef _ZIP_ARCHIVE_HPP_
+#define _ZIP_ARCHIVE_HPP_
+
+#include <algorithm>
+#include <cstdint>
+#include <cstring>
+#include <filesystem>
+#include <memory>
+#include <stdexcept>
+#include <string>
+#include <string_view>
+#include <vector>
+#include <zlib.h>
+
+#include "fileMapping.hpp"
+
+#ifdef _MSC_VER
+#ifdef DEBUG
+#pragma comment(lib, "zlibd.lib")
+#else
+#pragma comment(lib, "zlib.lib")
+#endif
+#endif
+
+namespace fsl::_private
+{
+    // A zip archive read through a memory mapping. Only the central directory is read when the archive is
+    // opened; entries are inflated as they are read, a buffer at a time.
+    class _zipArchive
+    {
+    public:
+        struct entry
+        {
+            std::string name;
+            uint16_t flags;
+            uint16_t method;            // 0 stored, 8 deflated.
+            uint32_t crc;
+            uint64_t compressedSize;
+            uint64_t size;
+            uint64_t localHeader;       // Offset of the local file header.
+        };
+
+        // Reads an entry from start to finish. The data is checked against its CRC when the end is reached.
+        class reader
+        {
+        private:
+            const uint8_t* _data;       // The stored or deflated bytes.
+            const entry& _entry;
+            z_stream _z;
+            bool _inflating;
+            bool _finished;
+            uint64_t _read;             // Bytes of the entry handed out so far.
+            uLong _crc;
+
+            void _finish()
+            {
+                _finished = true;
+                if ((_read != _entry.size) || (_crc != _entry.crc)) throw std::runtime_error("The zip entry " + _entry.name + " is damaged.");
+            }
+
+        public:
+            reader(const uint8_t* data, const entry& e) : _data(data), _entry(e)
+            {
+                std::memset(&_z, 0, sizeof(_z));
+                _inflating = false;
+                _finished = false;
+                _read = 0;
+                _crc = crc32(0L, Z_NULL, 0);
+                if (e.method == 8)
+                {
+                    // Raw deflate, zip entries have no zlib header.
+                    if (inflateInit2(&_z, -MAX_WBITS) != Z_OK) throw std::runtime_error("The zip entry " + e.name + " could not be inflated.");
+                    _inflating = true;
+                    _z.next_in = const_cast<Bytef*>(data);
+                    _z.avail_in = 0;
+                }
+            }
+
+            reader(const reader&) = delete;
+            reader& operator=(const reader&) = delete;
+
+            ~reader()
+            {
+                if (_inflating) inflateEnd(&_z);
+            }
+
+            // Copies up to size bytes of the entry into buffer, returns the number copied, zero at the end.
+            size_t read(char* buffer, size_t size)
+            {
+                if (_finished || (size == 0)) return 0;
+                size_t n = 0;
+                if (_entry.method == 0)
+                {
+                    n = static_cast<size_t>(std::min<uint64_t>(size, _entry.size - _read));
+                    std::memcpy(buffer, _data + _read, n);
+                }
+                else
+                {
+                    size = std::min<size_t>(size, UINT32_MAX);
+                    _z.next_out = reinterpret_cast<Bytef*>(buffer);
+                    _z.avail_out = static_cast<uInt>(size);
+                    while (_z.avail_out > 0)
+                    {
+                        // zlib counts its input in 32 bits, hand the mapped bytes over in slices.
+                        if (_z.avail_in == 0)
+                        {
+                            uint64_t consumed = static_cast<uint64_t>(_z.next_in - _data);
+                            _z.avail_in = static_cast<uInt>(std::min<uint64_t>(_entry.compressedSize - consumed, UINT32_MAX));
+                        }
+                        int result = inflate(&_z, Z_NO_FLUSH);
+                        if (result == Z_STREAM_END) break;
+                        // Running out of input before the end of the stream shows up as Z_BUF_ERROR.
+                        if (result != Z_OK) throw std::runtime_error("The zip entry " + _entry.name + " is damaged.");
+                    }
+                    n = size - _z.avail_out;
+                }
+                _crc = crc32(_crc, reinterpret_cast<const Bytef*>(buffer), static_cast<uInt>(n));
+                _read += n;
+                if ((n < size) || (_read == _entry.size)) _finish();
+
+                return n;
+            }
+        };
+
+    private:
+        std::shared_ptr<_fileMapping> _mapping;
+        std::vector<entry> _entries;
+
+        static uint16_t _u16(const uint8_t* p)
+        {
+            return static_cast<uint16_t>(p[0] | (p[1] << 8));
+        }
+
+        static uint32_t _u32(const uint8_t* p)
+        {
+            return static_cast<uint32_t>(p[0]) | (static_cast<uint32_t>(p[1]) << 8) | (static_cast<uint32_t>(p[2]) << 16) | (static_cast<uint32_t>(p[3]) << 24);
+        }
+
+        [[noreturn]] static void _damaged()
+        {
+            throw std::runtime_error("The file is not a zip archive or is damaged.");
+        }
+
+        void _readDirectory()
+        {
+            const uint8_t* data = _mapping->data();
+            size_t size = _mapping->size();
+            if (size < 22) _damaged();
+
+            // The end of central directory record is followed by a comment of up to 64 KB.
+            size_t eocd = size - 22;
+            size_t lowest = (size > 22 + 0xFFFF) ? size - 22 - 0xFFFF : 0;
+            while (_u32(data + eocd) != 0x06054b50)
+            {
+                if (eocd == lowest) _damaged();
+                --eocd;
+            }
+            uint16_t count = _u16(data + eocd + 10);
+            uint32_t directorySize = _u32(data + eocd + 12);
+            uint32_t directoryOffset = _u32(data + eocd + 16);
+            if ((count == 0xFFFF) || (directoryOffset == 0xFFFFFFFF)) throw std::runtime_error("Zip64 archives are not supported.");
+            if ((directoryOffset > eocd) || (directorySize > eocd - directoryOffset)) _damaged();
+
+            const uint8_t* p = data + directoryOffset;
+            const uint8_t* end = p + directorySize;
+            _entries.reserve(count);
+            for (uint16_t i = 0; i < count; ++i)
+            {
+                if ((end - p < 46) || (_u32(p) != 0x02014b50)) _damaged();
+                entry e;
+                e.flags = _u16(p + 8);
+                e.method = _u16(p + 10);
+                e.crc = _u32(p + 16);
+                e.compressedSize = _u32(p + 20);
+                e.size = _u32(p + 24);
+                uint16_t nameLength = _u16(p + 28);
+                uint16_t extraLength = _u16(p + 30);
+                uint16_t commentLength = _u16(p + 32);
+                e.localHeader = _u32(p + 42);
+                if (end - p < 46 + nameLength + extraLength + commentLength) _damaged();
+                e.name.assign(reinterpret_cast<const char*>(p + 46), nameLength);
+                if ((e.compressedSize == 0xFFFFFFFF) || (e.size == 0xFFFFFFFF) || (e.localHeader == 0xFFFFFFFF)) throw std::runtime_error("Zip64 archives are not supported.");
+                _entries.push_back(std::move(e));
+                p += 46 + nameLength + extraLength + commentLength;
+            }
+        }
+
+    public:
+        explicit _zipArchive(const std::filesystem::path& file) : _mapping(std::make_shared<_fileMapping>(file))
+        {
+            _readDirectory();
+        }
+
+        [[nodiscard]] const std::vector<entry>& entries() const noexcept
+        {
+            return _entries;
+        }
+
+        // The entry with the given name, null if there is none.
+        [[nodiscard]] const entry* find(std::string_view name) const
+        {
+            for (const auto& e : _entries)
+            {
+                if (e.name == name) return &e;
+            }
+
+            return nullptr;
+        }
+
+        // Opens an entry for reading. The reader must not outlive the archive.
+        [[nodiscard]] std::unique_ptr<reader> open(const entry& e) const
+        {
+            if (e.flags & 0x0001) throw std::runtime_error("The zip entry " + e.name + " is encrypted.");
+            if ((e.method != 0) && (e.method != 8)) throw std::runtime_error("The zip entry " + e.name + " uses an unsupported compression method.");
+
+            const uint8_t* data = _mapping->data();
+            size_t size = _mapping->size();
+            if ((e.localHeader > size) || (size - e.localHeader < 30) || (_u32(data + e.localHeader) != 0x04034b50)) _damaged();
+            uint64_t start = e.localHeader + 30 + _u16(data + e.localHeader + 26) + _u16(data + e.localHeader + 28);
+            if ((start > size) || (e.compressedSize > size - start)) _damaged();
+            if ((e.method == 0) && (e.compressedSize != e.size)) _damaged();
+
+            return std::make_unique<reader>(data + start, e);
+        }
+
+        // Reads a small entry, such as a manifest, in full.
+        [[nodiscard]] std::string readAll(const entry& e) const
+        {
+            auto r = open(e);
+            std::string out(static_cast<size_t>(e.size), '\0');
+            size_t n = 0;
+            while (n < out.size())
+            {
+                size_t got = r->read(&out[n], out.size() - n);
+                if (got == 0) break;
+                n += got;
+            }
+            out.resize(n);
+
+            return out;
+        }
+    };
+}
+
+#endif // _ZIP_ARCHIVE_HPP_
@@ -0,0 +1,243 @@
+/**************************************************************************
+Checks the pages and items _readDocx() builds from small DOCX files,
+stored and deflated, and that damaged archives are refused.
+
+Copyright (C) 2021 Chris Morrison (gnosticist@protonmail.com)
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <http://www.gnu.org/licenses/>.
+**************************************************************************/
+
+#include <iostream>
+#include <memory_resource>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+#include <fsl/docxReader.hpp>
+
+#include "zipFixture.hpp"
+
+namespace
+{
+    using fsl::text::textCorpusItem;
+    using itemType = textCorpusItem::itemType;
+
+    struct expectedItem
+    {
+        itemType type;
+        std::wstring text;
+    };
+
+    using expectedPages = std::vector<std::vector<expectedItem>>;
+
+    const std::string contentTypes =
+        "<?xml version=\"1.0\" encoding=\"UTF-8\" standalone=\"yes\"?>\n"
+        "<Types xmlns=\"http://schemas.openxmlformats.org/package/2006/content-types\">"
+        "<Default Extension=\"xml\" ContentType=\"application/xml\"/>"
+        "<Override PartName=\"/word/main.xml\" ContentType=\"application/vnd.openxmlformats-officedocument.wordprocessingml.document.main+xml\"/>"
+        "</Types>\n";
+
+    // The main part and its styles have names other than the usual ones, so they are only found through the
+    // relationships.
+    const std::string packageRelationships =
+        "<?xml version=\"1.0\" encoding=\"UTF-8\" standalone=\"yes\"?>\n"
+        "<Relationships xmlns=\"http://schemas.openxmlformats.org/package/2006/relationships\">"
+        "<Relationship Id=\"rId2\" Type=\"http://schemas.openxmlformats.org/package/2006/relationships/metadata/core-properties\" Target=\"docProps/core.xml\"/>"
+        "<Relationship Id=\"rId1\" Type=\"http://schemas.openxmlformats.org/officeDocument/2006/relationships/officeDocument\" Target=\"word/main.xml\"/>"
+        "</Relationships>\n";
+
+    const std::string documentRelationships =
+        "<?xml version=\"1.0\" encoding=\"UTF-8\" standalone=\"yes\"?>\n"
+        "<Relationships xmlns=\"http://schemas.openxmlformats.org/package/2006/relationships\">"
+        "<Relationship Id=\"rId1\" Type=\"http://schemas.openxmlformats.org/officeDocument/2006/relationships/styles\" Target=\"fancyStyles.xml\"/>"
+        "</Relationships>\n";
+
+    const std::string styles =
+        "<?xml version=\"1.0\" encoding=\"UTF-8\" standalone=\"yes\"?>\n"
+        "<w:styles xmlns:w=\"http://schemas.openxmlformats.org/wordprocessingml/2006/main\">\n"
+        " <w:style w:type=\"paragraph\" w:default=\"1\" w:styleId=\"Normal\"><w:name w:val=\"Normal\"/></w:style>\n"
+        " <w:style w:type=\"paragraph\" w:styleId=\"Heading1\"><w:name w:val=\"heading 1\"/><w:basedOn w:val=\"Normal\"/>"
+        "<w:rPr><w:b/></w:rPr></w:style>\n"
+        " <w:style w:type=\"paragraph\" w:styleId=\"Chapter\"><w:name w:val=\"Chapter\"/><w:basedOn w:val=\"Heading1\"/></w:style>\n"
+        " <w:style w:type=\"paragraph\" w:styleId=\"ListBullet\"><w:name w:val=\"List Bullet\"/>"
+        "<w:pPr><w:numPr><w:numId w:val=\"5\"/></w:numPr></w:pPr></w:style>\n"
+        " <w:style w:type=\"paragraph\" w:styleId=\"Break\"><w:name w:val=\"Break\"/><w:pPr><w:pageBreakBefore/></w:pPr></w:style>\n"
+        " <w:style w:type=\"character\" w:styleId=\"Emphasis\"><w:name w:val=\"heading 9\"/></w:style>\n"
+        "</w:styles>\n";
+
+    // Headings by style and inheritance, notes, tracked changes, lists, hard, section and rendered page breaks,
+    // entities, astral characters, CDATA, a lone carriage return and the fallback of a drawing.
+    const std::string document =
+        "<?xml version=\"1.0\" encoding=\"UTF-8\" standalone=\"yes\"?>\n"
+        "<w:document xmlns:w=\"http://schemas.openxmlformats.org/wordprocessingml/2006/main\" "
+        "xmlns:mc=\"http://schemas.openxmlformats.org/markup-compatibility/2006\">\n"
+        "<w:body>\n"
+        "<w:p><w:pPr><w:pStyle w:val=\"Chapter\"/></w:pPr><w:r><w:t>Intro &amp; aims</w:t></w:r></w:p>\n"
+        "<w:p><w:r><w:t xml:space=\"preserve\">Fish </w:t></w:r><w:r><w:rPr><w:rStyle w:val=\"Emphasis\"/></w:rPr>"
+        "<w:footnoteReference w:id=\"1\"/></w:r><w:r><w:t>chips</w:t></w:r></w:p>\n"
+        "<w:p><w:pPr><w:numPr><w:ilvl w:val=\"0\"/><w:numId w:val=\"1\"/></w:numPr></w:pPr><w:r><w:t>Item one</w:t></w:r></w:p>\n"
+        "<w:p><w:pPr><w:pStyle w:val=\"ListBullet\"/></w:pPr><w:r><w:t>Item two</w:t></w:r></w:p>\n"
+        "<w:p><w:pPr><w:pStyle w:val=\"ListBullet\"/><w:numPr><w:numId w:val=\"0\"/></w:numPr></w:pPr><w:r><w:t>Not an item</w:t></w:r></w:p>\n"
+        "<w:p><w:r><w:t xml:space=\"preserve\">Only </w:t></w:r><w:del w:id=\"2\"><w:r><w:delText>gone </w:delText></w:r></w:del>"
+        "<w:ins w:id=\"3\"><w:r><w:t>kept</w:t></w:r></w:ins><w:moveFrom w:id=\"4\"><w:r><w:t> moved away</w:t></w:r></w:moveFrom></w:p>\n"
+        "<w:p><w:r><w:t>Before</w:t><w:br w:type=\"page\"/><w:t>after</w:t></w:r></w:p>\n"
+        "<w:p><w:r><w:t>Smile \xF0\x9F\x98\x80 and &#x1F609;.</w:t></w:r></w:p>\n"
+        "<w:p><w:r><w:t xml:space=\"preserve\">Code </w:t><w:t><![CDATA[a < b && c]]></w:t></w:r></w:p>\n"
+        "<w:p><w:r><w:t>Line one</w:t><w:br/><w:t>line two</w:t><w:cr/><w:t>three\rfour</w:t></w:r></w:p>\n"
+        "<w:p><w:r><w:t>Picture</w:t></w:r><w:r><mc:AlternateContent><mc:Choice Requires=\"wps\"><w:drawing/></mc:Choice>"
+        "<mc:Fallback><w:pict><w:p><w:r><w:t>A fallback copy</w:t></w:r></w:p></w:pict></mc:Fallback></mc:AlternateContent></w:r></w:p>\n"
+        "<w:p><w:pPr><w:pStyle w:val=\"Break\"/></w:pPr><w:r><w:t>New page</w:t></w:r></w:p>\n"
+        "<w:p><w:pPr><w:sectPr><w:pgSz w:w=\"11906\" w:h=\"16838\"/></w:sectPr></w:pPr><w:r><w:t>End of section</w:t></w:r></w:p>\n"
+        "<w:p><w:pPr><w:sectPr><w:type w:val=\"continuous\"/></w:sectPr></w:pPr><w:r><w:t>Continuous</w:t></w:r></w:p>\n"
+        "<w:p><w:r><w:t>Still here</w:t></w:r></w:p>\n"
+        "<w:p><w:r><w:lastRenderedPageBreak/><w:t>Rendered</w:t></w:r></w:p>\n"
+        "<w:p><w:pPr><w:outlineLvl w:val=\"0\"/></w:pPr><w:r><w:t>The end</w:t></w:r></w:p>\n"
+        "<w:sectPr><w:pgSz w:w=\"11906\" w:h=\"16838\"/></w:sectPr>\n"
+        "</w:body>\n"
+        "</w:document>\n";
+
+    const expectedPages expected =
+    {
+        {
+            { itemType::title, L"Intro & aims" },
+            { itemType::paragraph, L"Fish chips" },
+            { itemType::listItem, L"Item one" },
+            { itemType::listItem, L"Item two" },
+            { itemType::paragraph, L"Not an item" },
+            { itemType::paragraph, L"Only kept" },
+            { itemType::paragraph, L"Before" },
+        },
+        {
+            { itemType::paragraph, L"after" },
+            { itemType::paragraph, L"Smile \U0001F600 and \U0001F609." },
+            { itemType::paragraph, L"Code a < b && c" },
+            { itemType::paragraph, L"Line one" },
+            { itemType::paragraph, L"line two" },
+            { itemType::paragraph, L"three" },
+            { itemType::paragraph, L"four" },
+            { itemType::paragraph, L"Picture" },
+        },
+        {
+            { itemType::paragraph, L"New page" },
+            { itemType::paragraph, L"End of section" },
+        },
+        {
+            { itemType::paragraph, L"Continuous" },
+            { itemType::paragraph, L"Still here" },
+        },
+        {
+            { itemType::paragraph, L"Rendered" },
+            { itemType::title, L"The end" },
+        },
+    };
+
+    int failures = 0;
+
+    void fail(const std::string& what)
+    {
+        ++failures;
+        std::cerr << what << '\n';
+    }
+
+    std::vector<fsl::text::textCorpus> read(const std::string& bytes)
+    {
+        fsl::test::tempFile file("fsl-docx-reader-test.docx", bytes);
+        fsl::_private::_structuredDocument doc(std::pmr::get_default_resource(), false, false);
+        fsl::_private::_readDocx(file.path(), doc);
+
+        return doc.release();
+    }
+
+    void check(const std::string& what, const std::vector<fsl::text::textCorpus>& pages)
+    {
+        if (pages.size() != expected.size())
+        {
+            fail(what + ": " + std::to_string(pages.size()) + " pages instead of " + std::to_string(expected.size()));
+            return;
+        }
+        for (size_t p = 0; p < pages.size(); ++p)
+        {
+            const auto& tc = pages[p];
+            bool same = tc.size() == expected[p].size();
+            for (size_t i = 0; same && (i < tc.size()); ++i) same = (tc.type(i) == expected[p][i].type) && (tc.text(i) == expected[p][i].text);
+            if (same) continue;
+            fail(what + ": page " + std::to_string(p + 1) + " differs");
+            for (size_t i = 0; i < tc.size(); ++i) std::wcerr << L"    " << static_cast<int>(tc.type(i)) << L' ' << std::wstring(tc.text(i)) << L'\n';
+        }
+    }
+
+    void expectThrow(const std::string& what, const std::string& bytes)
+    {
+        try
+        {
+            read(bytes);
+            fail(what + ": no exception");
+        }
+        catch (const std::runtime_error&)
+        {
+        }
+    }
+
+    std::vector<fsl::test::zipEntry> entries(bool deflate)
+    {
+        return
+        {
+            { "[Content_Types].xml", contentTypes, deflate },
+            { "_rels/.rels", packageRelationships, deflate },
+            { "word/_rels/main.xml.rels", documentRelationships, deflate },
+            { "word/fancyStyles.xml", styles, deflate },
+            { "word/main.xml", document, deflate },
+        };
+    }
+}
+
+int main()
+{
+    try
+    {
+        check("stored", read(fsl::test::buildZip(entries(false)).bytes));
+        check("deflated", read(fsl::test::buildZip(entries(true)).bytes));
+    }
+    catch (const std::exception& e)
+    {
+        fail(std::string("unexpected exception: ") + e.what());
+    }
+
+    for (bool deflate : { false, true })
+    {
+        auto damaged = entries(deflate);
+        damaged[4].badCrc = true;
+        expectThrow("word/main.xml with a bad CRC", fsl::test::buildZip(damaged).bytes);
+
+        auto zip = fsl::test::buildZip(entries(deflate));
+        expectThrow("central directory cut short", zip.bytes.substr(0, zip.directory + 30));
+        std::string shortened = zip.bytes;
+        shortened.erase(zip.directory + 10, 20);
+        expectThrow("central directory shorter than the end record says", shortened);
+
+        auto missing = entries(deflate);
+        missing.pop_back();
+        expectThrow("no main part", fsl::test::buildZip(missing).bytes);
+    }
+    expectThrow("a Word 97-2003 file", std::string("\xD0\xCF\x11\xE0\xA1\xB1\x1A\xE1", 8) + std::string(504, '\0'));
+    expectThrow("not a zip archive", document);
+
+    if (failures != 0)
+    {
+        std::cerr << failures << " checks failed.\n";
+        return 1;
+    }
+
+    return 0;
+}
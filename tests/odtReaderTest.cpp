@@ -0,0 +1,216 @@
+/**************************************************************************
+Checks the pages and items _readOdt() builds from small ODT files, stored
+and deflated, and that damaged archives are refused.
+
+Copyright (C) 2021 Chris Morrison (gnosticist@protonmail.com)
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <http://www.gnu.org/licenses/>.
+**************************************************************************/
+
+#include <iostream>
+#include <memory_resource>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+#include <fsl/odtReader.hpp>
+
+#include "zipFixture.hpp"
+
+namespace
+{
+    using fsl::text::textCorpusItem;
+    using itemType = textCorpusItem::itemType;
+
+    struct expectedItem
+    {
+        itemType type;
+        std::wstring text;
+    };
+
+    using expectedPages = std::vector<std::vector<expectedItem>>;
+
+    const std::string mimetype = "application/vnd.oasis.opendocument.text";
+
+    const std::string manifest =
+        "<?xml version=\"1.0\" encoding=\"UTF-8\"?>\n"
+        "<manifest:manifest xmlns:manifest=\"urn:oasis:names:tc:opendocument:xmlns:manifest:1.0\" manifest:version=\"1.2\">\n"
+        " <manifest:file-entry manifest:full-path=\"/\" manifest:media-type=\"application/vnd.oasis.opendocument.text\"/>\n"
+        " <manifest:file-entry manifest:full-path=\"content.xml\" manifest:media-type=\"text/xml\"/>\n"
+        "</manifest:manifest>\n";
+
+    const std::string styles =
+        "<?xml version=\"1.0\" encoding=\"UTF-8\"?>\n"
+        "<office:document-styles xmlns:office=\"urn:oasis:names:tc:opendocument:xmlns:office:1.0\" xmlns:style=\"urn:oasis:names:tc:opendocument:xmlns:style:1.0\">\n"
+        " <office:styles>\n"
+        "  <style:style style:name=\"Standard\" style:family=\"paragraph\"/>\n"
+        "  <style:style style:name=\"Title\" style:family=\"paragraph\" style:parent-style-name=\"Standard\"/>\n"
+        " </office:styles>\n"
+        "</office:document-styles>\n";
+
+    // Headings, notes, entities, lists, soft and hard page breaks, astral characters, CDATA, a lone carriage
+    // return and an annotation.
+    const std::string content =
+        "<?xml version=\"1.0\" encoding=\"UTF-8\"?>\n"
+        "<office:document-content xmlns:office=\"urn:oasis:names:tc:opendocument:xmlns:office:1.0\" xmlns:style=\"urn:oasis:names:tc:opendocument:xmlns:style:1.0\" "
+        "xmlns:text=\"urn:oasis:names:tc:opendocument:xmlns:text:1.0\" xmlns:fo=\"urn:oasis:names:tc:opendocument:xmlns:xsl-fo-compatible:1.0\">\n"
+        " <office:automatic-styles>\n"
+        "  <style:style style:name=\"P1\" style:family=\"paragraph\" style:parent-style-name=\"Standard\">\n"
+        "   <style:paragraph-properties fo:break-before=\"page\"/>\n"
+        "  </style:style>\n"
+        "  <style:style style:name=\"P2\" style:family=\"paragraph\" style:parent-style-name=\"Title\"/>\n"
+        " </office:automatic-styles>\n"
+        " <office:body>\n"
+        "  <office:text>\n"
+        "   <text:sequence-decls><text:sequence-decl text:display-outline-level=\"0\" text:name=\"Table\"/></text:sequence-decls>\n"
+        "   <text:h text:outline-level=\"1\">Chapter &amp; One</text:h>\n"
+        "   <text:p text:style-name=\"Standard\">Fish &lt;and&gt; chips<text:note text:note-class=\"footnote\"><text:note-citation>1</text:note-citation>"
+        "<text:note-body><text:p>A note.</text:p></text:note-body></text:note> here.</text:p>\n"
+        "   <text:list>\n"
+        "    <text:list-item><text:p>First item</text:p></text:list-item>\n"
+        "    <text:list-item><text:p>Second<text:s text:c=\"3\"/>item</text:p></text:list-item>\n"
+        "   </text:list>\n"
+        "   <text:soft-page-break/>\n"
+        "   <text:p>Smile \xF0\x9F\x98\x80 and &#x1F609;.</text:p>\n"
+        "   <text:p>Code <![CDATA[a < b && c]]> end</text:p>\n"
+        "   <text:p>Line one<text:line-break/>line two\rjoined</text:p>\n"
+        "   <text:p text:style-name=\"P1\">Page three</text:p>\n"
+        "   <text:p text:style-name=\"P2\">Styled title</text:p>\n"
+        "   <office:annotation><text:p>A comment</text:p></office:annotation>\n"
+        "  </office:text>\n"
+        " </office:body>\n"
+        "</office:document-content>\n";
+
+    const expectedPages expected =
+    {
+        {
+            { itemType::title, L"Chapter & One" },
+            { itemType::paragraph, L"Fish <and> chips here." },
+            { itemType::listItem, L"First item" },
+            { itemType::listItem, L"Second item" },
+        },
+        {
+            { itemType::paragraph, L"Smile \U0001F600 and \U0001F609." },
+            { itemType::paragraph, L"Code a < b && c end" },
+            { itemType::paragraph, L"Line one" },
+            { itemType::paragraph, L"line two" },
+            { itemType::paragraph, L"joined" },
+        },
+        {
+            { itemType::paragraph, L"Page three" },
+            { itemType::title, L"Styled title" },
+        },
+    };
+
+    int failures = 0;
+
+    void fail(const std::string& what)
+    {
+        ++failures;
+        std::cerr << what << '\n';
+    }
+
+    std::vector<fsl::text::textCorpus> read(const std::string& name, const std::string& bytes)
+    {
+        fsl::test::tempFile file(name, bytes);
+        fsl::_private::_structuredDocument doc(std::pmr::get_default_resource(), false, false);
+        fsl::_private::_readOdt(file.path(), doc);
+
+        return doc.release();
+    }
+
+    void check(const std::string& what, const std::vector<fsl::text::textCorpus>& pages)
+    {
+        if (pages.size() != expected.size())
+        {
+            fail(what + ": " + std::to_string(pages.size()) + " pages instead of " + std::to_string(expected.size()));
+            return;
+        }
+        for (size_t p = 0; p < pages.size(); ++p)
+        {
+            const auto& tc = pages[p];
+            bool same = tc.size() == expected[p].size();
+            for (size_t i = 0; same && (i < tc.size()); ++i) same = (tc.type(i) == expected[p][i].type) && (tc.text(i) == expected[p][i].text);
+            if (same) continue;
+            fail(what + ": page " + std::to_string(p + 1) + " differs");
+            for (size_t i = 0; i < tc.size(); ++i) std::wcerr << L"    " << static_cast<int>(tc.type(i)) << L' ' << std::wstring(tc.text(i)) << L'\n';
+        }
+    }
+
+    void expectThrow(const std::string& what, const std::string& bytes)
+    {
+        try
+        {
+            read("fsl-odt-reader-test.odt", bytes);
+            fail(what + ": no exception");
+        }
+        catch (const std::runtime_error&)
+        {
+        }
+    }
+
+    std::vector<fsl::test::zipEntry> entries(bool deflate)
+    {
+        return
+        {
+            { "mimetype", mimetype, false },
+            { "META-INF/manifest.xml", manifest, deflate },
+            { "styles.xml", styles, deflate },
+            { "content.xml", content, deflate },
+        };
+    }
+}
+
+int main()
+{
+    try
+    {
+        check("stored", read("fsl-odt-reader-test.odt", fsl::test::buildZip(entries(false)).bytes));
+        check("deflated", read("fsl-odt-reader-test.odt", fsl::test::buildZip(entries(true)).bytes));
+    }
+    catch (const std::exception& e)
+    {
+        fail(std::string("unexpected exception: ") + e.what());
+    }
+
+    for (bool deflate : { false, true })
+    {
+        auto damaged = entries(deflate);
+        damaged[3].badCrc = true;
+        expectThrow("content.xml with a bad CRC", fsl::test::buildZip(damaged).bytes);
+
+        auto zip = fsl::test::buildZip(entries(deflate));
+        expectThrow("central directory cut short", zip.bytes.substr(0, zip.directory + 30));
+        std::string shortened = zip.bytes;
+        shortened.erase(zip.directory + 10, 20);
+        expectThrow("central directory shorter than the end record says", shortened);
+
+        auto encrypted = entries(deflate);
+        encrypted[1].data.insert(encrypted[1].data.find(" <manifest:file-entry manifest:full-path=\"content.xml\""), " <manifest:encryption-data/>\n");
+        expectThrow("encrypted", fsl::test::buildZip(encrypted).bytes);
+
+        auto missing = entries(deflate);
+        missing.pop_back();
+        expectThrow("no content.xml", fsl::test::buildZip(missing).bytes);
+    }
+    expectThrow("not a zip archive", content);
+
+    if (failures != 0)
+    {
+        std::cerr << failures << " checks failed.\n";
+        return 1;
+    }
+
+    return 0;
+}
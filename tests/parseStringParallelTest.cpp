@@ -0,0 +1,157 @@
+/**************************************************************************
+Checks that textCorpus::parseStringParallel() gives the same items as
+textCorpus::parseString() for input cut in awkward places.
+
+Copyright (C) 2021 Chris Morrison (gnosticist@protonmail.com)
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <http://www.gnu.org/licenses/>.
+**************************************************************************/
+
+#include <cstdint>
+#include <iostream>
+#include <random>
+#include <string>
+#include <vector>
+
+#include <fsl/textCorpus.hpp>
+
+namespace
+{
+    using namespace fsl::text;
+
+    // Pieces that a chunk cut, which always falls just after a pair of line breaks, can land inside or next to.
+    const std::vector<std::wstring> pieces =
+    {
+        L"The quick brown fox jumps over the lazy dog. ",
+        L"Dr. Smith met Mr. J. R. Jones at 3.30 p.m. on the 4th. ",
+        L"\"Is it?\" she asked (twice). ",
+        L"Wait... what? ",
+        L"\n\n",
+        L"\r\n\r\n",
+        L"\n",
+        L"\r\n",
+        L"\n \n\t\n",
+        L" ",
+        L" ",
+        L"<p>A paragraph.</p>",
+        L"<br>",
+        L"<!-- a comment\n\nthat spans a paragraph break -->",
+        L"<script>var s = \"a.\n\nb\";</script>",
+        L"<style>p {\n\n}</style>",
+        L"<a title=\"one\n\ntwo\">link</a> ",
+        L"&amp; &lt;b&gt; &#x263A; &#9731; &eacute; ",
+        L"&amp\n\n",
+        L"&#x1F600;",
+        L"Faces \U0001F600 and \U0001F609 here. ",
+        std::wstring{ L'H', L'i', L' ', static_cast<wchar_t>(0xD83D), static_cast<wchar_t>(0xDE00), L'.', L' ' },
+        std::wstring{ L'\n', L'\n', static_cast<wchar_t>(0xDE00), L' ', static_cast<wchar_t>(0xD83D), L'\n', L'\n' },
+        L"“Curly quotes” and ‘single’ ones. ",
+        L"a<b and c>d ",
+        L"   \t  ",
+    };
+
+    std::wstring makeInput(std::mt19937& rng, size_t count)
+    {
+        std::uniform_int_distribution<size_t> pick(0, pieces.size() - 1);
+        std::wstring input;
+        for (size_t i = 0; i < count; ++i) input += pieces[pick(rng)];
+
+        return input;
+    }
+
+    bool same(const textCorpus& a, const textCorpus& b)
+    {
+        if (a.size() != b.size()) return false;
+        for (size_t i = 0; i < a.size(); ++i)
+        {
+            if ((a.text(i) != b.text(i)) || (a.type(i) != b.type(i))) return false;
+        }
+        if (a.parts().size() != b.parts().size()) return false;
+        for (size_t i = 0; i < a.parts().size(); ++i)
+        {
+            if ((a.parts()[i].wideStringView() != b.parts()[i].wideStringView()) || (a.parts()[i].type() != b.parts()[i].type())) return false;
+        }
+        if (a.records().size() != b.records().size()) return false;
+        for (size_t i = 0; i < a.records().size(); ++i)
+        {
+            const auto& x = a.records()[i];
+            const auto& y = b.records()[i];
+            if ((x.offset != y.offset) || (x.length != y.length) || (x.type != y.type)) return false;
+        }
+
+        return true;
+    }
+
+    int failures = 0;
+
+    void check(const std::wstring& input, unsigned int settings, unsigned int threads, const char* what)
+    {
+        textCorpus serial;
+        textCorpus parallel;
+        for (auto* tc : { &serial, &parallel })
+        {
+            tc->setSplitSentences((settings & 1) != 0);
+            tc->setSplitParagraphs((settings & 2) != 0);
+            tc->setCompactStorage((settings & 4) != 0);
+            tc->setRemoveHtmlTags((settings & 8) == 0);
+            // Something to append to, so that the joins are checked too.
+            if ((settings & 16) != 0) tc->parseString(std::wstring(L"Already here."), false);
+        }
+        bool append = (settings & 16) != 0;
+        serial.parseString(input, append);
+        parallel.parseStringParallel(input, append, threads, 1);
+        if (!same(serial, parallel))
+        {
+            ++failures;
+            std::cerr << "parseStringParallel differs from parseString: " << what << ", settings " << settings << ", threads " << threads << '\n';
+        }
+    }
+}
+
+int main()
+{
+    std::mt19937 rng(20210611);
+    for (int round = 0; round < 200; ++round)
+    {
+        std::wstring input = makeInput(rng, 20 + round);
+        for (unsigned int settings = 0; settings < 32; ++settings) check(input, settings, 2 + round % 7, "random pieces");
+    }
+
+    // Markup left open to the end, so that every cut after it is inside the markup.
+    std::wstring body = makeInput(rng, 400);
+    for (const wchar_t* open : { L"<!-- never closed\n\n", L"<script>\n\n", L"<a href=\"x\n\n", L"&amp" })
+    {
+        for (unsigned int settings = 0; settings < 32; ++settings)
+        {
+            check(open + body, settings, 8, "unterminated markup at the start");
+            check(body + open + body, settings, 8, "unterminated markup in the middle");
+        }
+    }
+
+    // Nothing to cut at, or nothing at all.
+    for (unsigned int settings = 0; settings < 32; ++settings)
+    {
+        check(std::wstring(5000, L'x'), settings, 4, "no line breaks");
+        check(std::wstring(5000, L'\n'), settings, 4, "only line breaks");
+        check(std::wstring(), settings, 4, "empty input");
+    }
+
+    if (failures != 0)
+    {
+        std::cerr << failures << " comparisons failed.\n";
+        return 1;
+    }
+
+    return 0;
+}
@@ -0,0 +1,108 @@
+/**************************************************************************
+Checks the sentence boundaries found by _split_sentences() against a
+corpus of awkward cases.
+
+Copyright (C) 2021 Chris Morrison (gnosticist@protonmail.com)
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <http://www.gnu.org/licenses/>.
+**************************************************************************/
+
+#include <iostream>
+#include <string>
+#include <vector>
+
+#include <fsl/sentenceSplitter.hpp>
+
+namespace
+{
+    struct testCase
+    {
+        std::wstring input;                 // Normalised text, as _prep_string() leaves it.
+        std::wstring expected;              // The text once split, sentence ends become '\n'.
+        std::vector<size_t> boundaries;     // The offsets of those '\n' in expected.
+    };
+
+    const std::vector<testCase> corpus =
+    {
+        // Abbreviations.
+        { L"Mr. Smith went to Washington. He arrived on Tuesday.",
+          L"Mr. Smith went to Washington.\nHe arrived on Tuesday.", { 29 } },
+        { L"(Mr. Brown) agreed. See Fig. 3 and Vol. 2 now. Done.",
+          L"(Mr. Brown) agreed.\nSee Fig. 3 and Vol. 2 now.\nDone.", { 19, 46 } },
+        { L"Smith et al. found it. Prices rose approx. ten percent.",
+          L"Smith et al. found it.\nPrices rose approx. ten percent.", { 22 } },
+
+        // Initials and single letter abbreviations.
+        { L"J. R. R. Tolkien wrote it. U.S. troops left.",
+          L"J. R. R. Tolkien wrote it.\nU.S. troops left.", { 26 } },
+        { L"e.g. this one. i.e. that one.",
+          L"e.g. this one.\ni.e. that one.", { 14 } },
+
+        // Numbers and decimals.
+        { L"It costs 3.50 dollars. The year was 1999. Chapter 12. ends here.",
+          L"It costs 3.50 dollars.\nThe year was 1999.\nChapter 12. ends here.", { 22, 41 } },
+        { L"Pi is 3.14159 roughly. It is 0.5 percent.",
+          L"Pi is 3.14159 roughly.\nIt is 0.5 percent.", { 22 } },
+
+        // Closing quotes and brackets.
+        { L"He said \"Stop.\" Then he left.",
+          L"He said \"Stop.\"\nThen he left.", { 15 } },
+        { L"She wrote 'done.' and left. It ended.",
+          L"She wrote 'done.'\nand left.\nIt ended.", { 17, 27 } },
+        { L"(See above.) Next one. (see fig.) Last one.",
+          L"(See above.)\nNext one.\n(see fig.) Last one.", { 12, 22 } },
+        { L"It is here (see above). Next [one.] Last.",
+          L"It is here (see above).\nNext [one.]\nLast.", { 23, 35 } },
+
+        // Ellipses and runs of terminal punctuation.
+        { L"Wait... what? Really?! Yes.",
+          L"Wait...\nwhat?\nReally?!\nYes.", { 7, 13, 22 } },
+        { L"Go on... Mr... no.",
+          L"Go on...\nMr... no.", { 8 } },
+
+        // Line and paragraph breaks.
+        { L"One here.\n\nTwo here. Three",
+          L"One here.\n\nTwo here.\nThree", { 20 } },
+        { L"Line one\ncontinues. Next.",
+          L"Line one continues.\nNext.", { 19 } },
+        { L"No boundary here", L"No boundary here", {} },
+        { L"", L"", {} },
+    };
+}
+
+int main()
+{
+    int failures = 0;
+    for (const auto& tc : corpus)
+    {
+        std::wstring text = tc.input;
+        std::vector<size_t> boundaries;
+        fsl::_private::_split_sentences(text, &boundaries);
+        if ((text != tc.expected) || (boundaries != tc.boundaries))
+        {
+            ++failures;
+            std::wcerr << L"sentence boundaries differ for: " << tc.input << L"\n    got:";
+            for (auto b : boundaries) std::wcerr << L' ' << b;
+            std::wcerr << L"\n    text: " << text << L'\n';
+        }
+    }
+
+    if (failures != 0)
+    {
+        std::wcerr << failures << L" cases failed.\n";
+        return 1;
+    }
+
+    return 0;
+}
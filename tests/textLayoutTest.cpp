@@ -0,0 +1,170 @@
+/**************************************************************************
+Checks the boxes of text shown under scaled, flipped and moved text
+matrices, and hit testing them through the layout of a corpus.
+
+Copyright (C) 2021 Chris Morrison (gnosticist@protonmail.com)
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <http://www.gnu.org/licenses/>.
+**************************************************************************/
+
+#include <cmath>
+#include <iostream>
+#include <string>
+
+#include <fsl/pdfTextState.hpp>
+#include <fsl/textCorpus.hpp>
+
+namespace
+{
+    using fsl::_private::_pdfTextState;
+    using fsl::text::textCorpus;
+    using fsl::text::textLayout;
+
+    int failures = 0;
+
+    // A font whose glyphs are half an em wide, with an ascent of 0.75 em and a descent of 0.25 em.
+    double width(const _pdfTextState& state, const std::wstring& text)
+    {
+        return 0.5 * state.fontSize * static_cast<double>(text.size());
+    }
+
+    // Shows text as the extractor does: the box of the run, then the text matrix moves past it.
+    textLayout::box show(_pdfTextState& state, const std::wstring& text)
+    {
+        double w = width(state, text);
+        auto bx = state.run(w, 0.75 * state.fontSize, -0.25 * state.fontSize);
+        state.advance(w);
+
+        return bx;
+    }
+
+    void expect(const textLayout::box& got, const textLayout::box& want, const char* what)
+    {
+        const auto near = [](float a, float b) { return std::fabs(a - b) < 1e-3f; };
+        if (near(got.x0, want.x0) && near(got.y0, want.y0) && near(got.x1, want.x1) && near(got.y1, want.y1)) return;
+        ++failures;
+        std::cerr << what << ": got " << got.x0 << ' ' << got.y0 << ' ' << got.x1 << ' ' << got.y1
+                  << ", expected " << want.x0 << ' ' << want.y0 << ' ' << want.x1 << ' ' << want.y1 << '\n';
+    }
+
+    void expect(bool ok, const char* what)
+    {
+        if (ok) return;
+        ++failures;
+        std::cerr << what << '\n';
+    }
+}
+
+int main()
+{
+    // 12 0 0 12 100 700 Tm /F1 1 Tf (Hello) Tj 0 -1.2 Td (world.) Tj
+    {
+        _pdfTextState state;
+        state.beginText();
+        state.setMatrix({ 12, 0, 0, 12, 100, 700 });
+        state.fontSize = 1;
+        expect(show(state, L"Hello"), { 100, 697, 130, 709 }, "scaled Tm");
+        state.moveLine(0, -1.2);
+        expect(show(state, L"world."), { 100, 682.6f, 136, 694.6f }, "Td under a scaled Tm");
+        state.leading = 1.2;
+        state.nextLine();
+        expect(show(state, L"x"), { 100, 668.2f, 106, 680.2f }, "T* under a scaled Tm");
+    }
+
+    // 1 0 0 -1 50 100 Tm /F1 10 Tf (Down) Tj, text space y runs down the page.
+    {
+        _pdfTextState state;
+        state.beginText();
+        state.setMatrix({ 1, 0, 0, -1, 50, 100 });
+        state.fontSize = 10;
+        expect(show(state, L"Down"), { 50, 92.5f, 70, 102.5f }, "flipped Tm");
+        state.moveLine(0, 20);
+        expect(show(state, L"Next"), { 50, 72.5f, 70, 82.5f }, "Td under a flipped Tm");
+    }
+
+    // 2 0 0 2 0 0 Tm /F1 10 Tf [(A) -500 (B) 1000 (C)] TJ, adjustments move the text matrix too.
+    {
+        _pdfTextState state;
+        state.beginText();
+        state.setMatrix({ 2, 0, 0, 2, 0, 0 });
+        state.fontSize = 10;
+        expect(show(state, L"A"), { 0, -5, 10, 15 }, "first of TJ");
+        state.adjust(-500);
+        expect(show(state, L"B"), { 20, -5, 30, 15 }, "TJ adjustment apart");
+        state.adjust(1000);
+        expect(show(state, L"C"), { 10, -5, 20, 15 }, "TJ adjustment back");
+    }
+
+    // 50 Tz 4 Ts under 2 0 0 2 10 10 cm, rotated a quarter turn by 0 1 -1 0 0 0 Tm.
+    {
+        _pdfTextState state;
+        state.ctm = { 2, 0, 0, 2, 10, 10 };
+        state.horizontalScale = 0.5;
+        state.rise = 4;
+        state.beginText();
+        state.setMatrix({ 0, 1, -1, 0, 0, 0 });
+        state.fontSize = 10;
+        expect(show(state, L"Up"), { -13, 10, 7, 20 }, "Tz, Ts, cm and a rotated Tm");
+        expect(show(state, L"Up"), { -13, 20, 7, 30 }, "advance under Tz and a rotated Tm");
+    }
+
+    // BT resets the text and line matrices.
+    {
+        _pdfTextState state;
+        state.setMatrix({ 3, 0, 0, 3, 40, 40 });
+        state.beginText();
+        expect(state.textMatrix().identity() && state.lineMatrix().identity(), "BT does not reset the matrices");
+    }
+
+    // Hit testing the runs of a page written with a scaled Tm and a flipped one.
+    {
+        textCorpus tc;
+        textLayout& layout = tc.layout();
+        textCorpus::parser parser(tc, true);
+        const auto feed = [&](const std::wstring& text, const textLayout::box& bx)
+        {
+            parser.feed(text);
+            layout.addRun(text, bx);
+        };
+
+        _pdfTextState state;
+        state.beginText();
+        state.setMatrix({ 12, 0, 0, 12, 100, 700 });
+        state.fontSize = 1;
+        feed(L"Scaled text here.", show(state, L"Scaled text here."));
+        parser.feed(L"\n\n");
+        state.setMatrix({ 1, 0, 0, -1, 100, 100 });
+        state.fontSize = 10;
+        feed(L"Flipped text here.", show(state, L"Flipped text here."));
+        parser.finish();
+        layout.index(tc);
+
+        expect(tc.size() >= 2, "the page did not parse into two items");
+        uint32_t scaled = layout.itemAt(200, 703);
+        uint32_t flipped = layout.itemAt(150, 97);
+        expect((scaled != textLayout::none) && (tc.text(scaled) == L"Scaled text here."), "no hit on the scaled run");
+        expect((flipped != textLayout::none) && (tc.text(flipped) == L"Flipped text here."), "no hit on the flipped run");
+        expect(layout.itemAt(200, 690) == textLayout::none, "hit below the scaled run");
+        expect(layout.itemAt(150, 106) == textLayout::none, "hit above the flipped run");
+        expect(layout.itemsIn({ 0, 0, 1000, 200 }).size() == 1, "wrong items in the flipped run's area");
+    }
+
+    if (failures != 0)
+    {
+        std::cerr << failures << " checks failed.\n";
+        return 1;
+    }
+
+    return 0;
+}
@@ -0,0 +1,169 @@
+/**************************************************************************
+Writes small zip archives for the tests of the document readers.
+
+Copyright (C) 2021 Chris Morrison (gnosticist@protonmail.com)
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <http://www.gnu.org/licenses/>.
+**************************************************************************/
+
+#ifndef _ZIP_FIXTURE_HPP_
+#define _ZIP_FIXTURE_HPP_
+
+#include <cstdint>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <stdexcept>
+#include <string>
+#include <vector>
+#include <zlib.h>
+
+namespace fsl::test
+{
+    struct zipEntry
+    {
+        std::string name;
+        std::string data;
+        bool deflate = true;
+        bool badCrc = false;        // Record a CRC that does not match the data.
+    };
+
+    // The bytes of an archive and where its central directory starts, so that tests can damage it.
+    struct zipBytes
+    {
+        std::string bytes;
+        size_t directory = 0;
+    };
+
+    inline void putU16(std::string& out, uint32_t v)
+    {
+        out.push_back(static_cast<char>(v & 0xFF));
+        out.push_back(static_cast<char>((v >> 8) & 0xFF));
+    }
+
+    inline void putU32(std::string& out, uint32_t v)
+    {
+        putU16(out, v & 0xFFFF);
+        putU16(out, v >> 16);
+    }
+
+    // Raw deflate, as zip entries hold it.
+    inline std::string deflateRaw(const std::string& data)
+    {
+        z_stream z;
+        std::memset(&z, 0, sizeof(z));
+        if (deflateInit2(&z, Z_BEST_SPEED, Z_DEFLATED, -MAX_WBITS, 8, Z_DEFAULT_STRATEGY) != Z_OK) throw std::runtime_error("deflateInit2 failed.");
+        std::string out(deflateBound(&z, static_cast<uLong>(data.size())), '\0');
+        z.next_in = reinterpret_cast<Bytef*>(const_cast<char*>(data.data()));
+        z.avail_in = static_cast<uInt>(data.size());
+        z.next_out = reinterpret_cast<Bytef*>(&out[0]);
+        z.avail_out = static_cast<uInt>(out.size());
+        int result = deflate(&z, Z_FINISH);
+        deflateEnd(&z);
+        if (result != Z_STREAM_END) throw std::runtime_error("deflate failed.");
+        out.resize(z.total_out);
+
+        return out;
+    }
+
+    inline zipBytes buildZip(const std::vector<zipEntry>& entries)
+    {
+        zipBytes zip;
+        std::string directory;
+        for (const auto& e : entries)
+        {
+            std::string stored = e.deflate ? deflateRaw(e.data) : e.data;
+            uint32_t crc = static_cast<uint32_t>(crc32(0L, reinterpret_cast<const Bytef*>(e.data.data()), static_cast<uInt>(e.data.size())));
+            if (e.badCrc) crc ^= 0x5A5A5A5A;
+            uint32_t offset = static_cast<uint32_t>(zip.bytes.size());
+
+            putU32(zip.bytes, 0x04034b50);
+            putU16(zip.bytes, 20);
+            putU16(zip.bytes, 0);
+            putU16(zip.bytes, e.deflate ? 8 : 0);
+            putU16(zip.bytes, 0);
+            putU16(zip.bytes, 0x21);
+            putU32(zip.bytes, crc);
+            putU32(zip.bytes, static_cast<uint32_t>(stored.size()));
+            putU32(zip.bytes, static_cast<uint32_t>(e.data.size()));
+            putU16(zip.bytes, static_cast<uint32_t>(e.name.size()));
+            putU16(zip.bytes, 0);
+            zip.bytes += e.name;
+            zip.bytes += stored;
+
+            putU32(directory, 0x02014b50);
+            putU16(directory, 20);
+            putU16(directory, 20);
+            putU16(directory, 0);
+            putU16(directory, e.deflate ? 8 : 0);
+            putU16(directory, 0);
+            putU16(directory, 0x21);
+            putU32(directory, crc);
+            putU32(directory, static_cast<uint32_t>(stored.size()));
+            putU32(directory, static_cast<uint32_t>(e.data.size()));
+            putU16(directory, static_cast<uint32_t>(e.name.size()));
+            putU16(directory, 0);
+            putU16(directory, 0);
+            putU16(directory, 0);
+            putU16(directory, 0);
+            putU32(directory, 0);
+            putU32(directory, offset);
+            directory += e.name;
+        }
+
+        zip.directory = zip.bytes.size();
+        zip.bytes += directory;
+        putU32(zip.bytes, 0x06054b50);
+        putU16(zip.bytes, 0);
+        putU16(zip.bytes, 0);
+        putU16(zip.bytes, static_cast<uint32_t>(entries.size()));
+        putU16(zip.bytes, static_cast<uint32_t>(entries.size()));
+        putU32(zip.bytes, static_cast<uint32_t>(directory.size()));
+        putU32(zip.bytes, static_cast<uint32_t>(zip.directory));
+        putU16(zip.bytes, 0);
+
+        return zip;
+    }
+
+    // A file in the temporary directory that is removed when it goes out of scope.
+    class tempFile
+    {
+    private:
+        std::filesystem::path _path;
+
+    public:
+        tempFile(const std::string& name, const std::string& bytes) : _path(std::filesystem::temp_directory_path() / name)
+        {
+            std::ofstream out(_path, std::ios::binary | std::ios::trunc);
+            out.write(bytes.data(), static_cast<std::streamsize>(bytes.size()));
+            if (!out) throw std::runtime_error("The fixture could not be written.");
+        }
+
+        tempFile(const tempFile&) = delete;
+        tempFile& operator=(const tempFile&) = delete;
+
+        ~tempFile()
+        {
+            std::error_code ec;
+            std::filesystem::remove(_path, ec);
+        }
+
+        [[nodiscard]] const std::filesystem::path& path() const noexcept
+        {
+            return _path;
+        }
+    };
+}
+
+#endif // _ZIP_FIXTURE_HPP_